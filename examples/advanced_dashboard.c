@@ -1,3 +1,4 @@
+#include "group.h"
 #include "gthread.h"
 #include "io.h"
 #include "runtime_stats.h"
@@ -55,36 +56,30 @@ void serve_static(int client_fd, const char *path, const char *type) {
   fclose(f);
 }
 
-// Build JSON for /threads
+// Build JSON for /threads. Runs under the registry lock: no blocking here.
+static void add_thread(gthread_t *curr, void *arg) {
+  int *offset = arg;
+  if (*offset >= JSON_BUF_SIZE - 200)
+    return;
+  if (*offset > 1)
+    json_buf[(*offset)++] = ',';
+
+  stack_stats_t ss = runtime_get_thread_stack_stats(curr);
+
+  *offset +=
+      snprintf(json_buf + *offset, JSON_BUF_SIZE - *offset,
+               "{\"id\":%lu,\"tickets\":%lu,\"pass\":%lu,\"state\":%d,"
+               "\"stride\":%lu,\"stack_used\":%zu,\"waiting_fd\":%d,\"wake_"
+               "time\":%lu,\"throttled\":%d,\"group\":%d}",
+               curr->id, curr->tickets, curr->pass, curr->state, curr->stride,
+               ss.stack_used, curr->waiting_fd, curr->wake_time_ms,
+               curr->throttled, curr->group ? curr->group->id : -1);
+}
+
 void handle_threads(int fd) {
   int offset = 0;
   json_buf[offset++] = '[';
-
-  gthread_t *curr = gthread_get_all_threads();
-  int first = 1;
-
-  while (curr) {
-    if (!first)
-      json_buf[offset++] = ',';
-    first = 0;
-
-    // printf("DEBUG: Processing thread ID %lu\n", curr->id); // Debug Log
-    stack_stats_t ss = runtime_get_stack_stats(curr->id);
-    // printf("DEBUG: Got stack stats for ID %lu (Used: %zu)\n", curr->id,
-    // ss.stack_used);
-
-    offset +=
-        snprintf(json_buf + offset, JSON_BUF_SIZE - offset,
-                 "{\"id\":%lu,\"tickets\":%lu,\"pass\":%lu,\"state\":%d,"
-                 "\"stride\":%lu,\"stack_used\":%zu,\"waiting_fd\":%d,\"wake_"
-                 "time\":%lu}",
-                 curr->id, curr->tickets, curr->pass, curr->state, curr->stride,
-                 ss.stack_used, curr->waiting_fd, curr->wake_time_ms);
-
-    curr = curr->global_next;
-    if (offset >= JSON_BUF_SIZE - 200)
-      break;
-  }
+  gthread_for_each(add_thread, &offset);
   json_buf[offset++] = ']';
   json_buf[offset] = '\0';
   // printf("DEBUG: JSON built successfully, length %d\n", offset);
@@ -99,6 +94,63 @@ void handle_threads(int fd) {
   gthread_write(fd, json_buf, offset);
 }
 
+// Phase 37: CPU pools, see runtime_get_quota_stats
+void handle_quotas(int fd) {
+  quota_stats_t qs[16];
+  int n = runtime_get_quota_stats(qs, 16);
+
+  int offset = 0;
+  json_buf[offset++] = '[';
+  for (int i = 0; i < n; i++) {
+    offset += snprintf(
+        json_buf + offset, JSON_BUF_SIZE - offset,
+        "%s{\"id\":%d,\"name\":\"%s\",\"runtime_us\":%lu,\"period_us\":%lu,"
+        "\"used_us\":%lu,\"total_us\":%lu,\"throttles\":%lu,\"threads\":%d,"
+        "\"throttled\":%d}",
+        i ? "," : "", qs[i].id, qs[i].name, qs[i].runtime_ns / 1000,
+        qs[i].period_ns / 1000, qs[i].used_ns / 1000, qs[i].total_ns / 1000,
+        qs[i].throttles, qs[i].threads, qs[i].throttled);
+  }
+  json_buf[offset++] = ']';
+
+  char hdr[512];
+  snprintf(
+      hdr, sizeof(hdr),
+      "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: "
+      "%d\r\nConnection: close\r\n\r\n",
+      offset);
+  gthread_write(fd, hdr, strlen(hdr));
+  gthread_write(fd, json_buf, offset);
+}
+
+// Phase 38: Scheduling groups, see runtime_get_group_stats
+void handle_groups(int fd) {
+  group_stats_t gs[32];
+  int n = runtime_get_group_stats(gs, 32);
+
+  int offset = 0;
+  json_buf[offset++] = '[';
+  for (int i = 0; i < n; i++) {
+    offset += snprintf(json_buf + offset, JSON_BUF_SIZE - offset,
+                       "%s{\"id\":%d,\"parent\":%d,\"name\":\"%s\","
+                       "\"tickets\":%d,\"active\":%ld,\"threads\":%d,"
+                       "\"cpu_us\":%lu}",
+                       i ? "," : "", gs[i].id, gs[i].parent, gs[i].name,
+                       gs[i].tickets, gs[i].active, gs[i].threads,
+                       (unsigned long)(gs[i].cpu_ns / 1000));
+  }
+  json_buf[offset++] = ']';
+
+  char hdr[512];
+  snprintf(
+      hdr, sizeof(hdr),
+      "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: "
+      "%d\r\nConnection: close\r\n\r\n",
+      offset);
+  gthread_write(fd, hdr, strlen(hdr));
+  gthread_write(fd, json_buf, offset);
+}
+
 void handle_client_adv(void *arg) {
   long client_fd = (long)arg;
   char buffer[2048] = {0};
@@ -118,17 +170,38 @@ void handle_client_adv(void *arg) {
     serve_static(client_fd, "dashboard.js", "application/javascript");
   } else if (strncmp(buffer, "GET /threads ", 13) == 0) {
     handle_threads(client_fd);
+  } else if (strncmp(buffer, "GET /quotas ", 12) == 0) {
+    handle_quotas(client_fd);
+  } else if (strncmp(buffer, "GET /groups ", 12) == 0) {
+    handle_groups(client_fd);
+  } else if (strncmp(buffer, "POST /group_tickets", 19) == 0) {
+    // Same body as /tickets, with a group id
+    char *body = strstr(buffer, "\r\n\r\n");
+    int id = -1, tix = 10;
+    if (body) {
+      char *id_ptr = strstr(body + 4, "id=");
+      if (id_ptr)
+        id = atoi(id_ptr + 3);
+      char *tix_ptr = strstr(body + 4, "tickets=");
+      if (tix_ptr)
+        tix = atoi(tix_ptr + 8);
+    }
+    const char *msg = runtime_set_group_tickets(id, tix) == 0
+                          ? "HTTP/1.1 200 OK\r\n\r\nOK"
+                          : "HTTP/1.1 404 Not Found\r\n\r\nNo group";
+    gthread_write(client_fd, msg, strlen(msg));
   } else if (strncmp(buffer, "POST /tickets", 13) == 0) {
     // Simple manual parsing: expects "id=X&tickets=Y" in body
     char *body = strstr(buffer, "\r\n\r\n");
     if (body) {
       body += 4;
       // Parse (demo quality)
-      int id = 0, tix = 10;
+      uint64_t id = 0;
+      int tix = 10;
       // Find id=
       char *id_ptr = strstr(body, "id=");
       if (id_ptr)
-        id = atoi(id_ptr + 3);
+        id = strtoull(id_ptr + 3, NULL, 10);
 
       char *tix_ptr = strstr(body, "tickets=");
       if (tix_ptr)
@@ -171,11 +244,16 @@ void advanced_server_loop(void *arg) {
 
   printf("Advanced Dashboard listening on :%d\n", PORT);
 
+  // Never joined: detached handlers are reaped as soon as they finish
+  gthread_attr_t attr;
+  gthread_attr_init(&attr);
+  attr.detached = 1;
+
   while (1) {
     int new_socket = gthread_accept(server_fd, NULL, NULL);
     if (new_socket >= 0) {
       gthread_t *t;
-      gthread_create(&t, handle_client_adv, (void *)(long)new_socket);
+      gthread_create_ex(&t, &attr, handle_client_adv, (void *)(long)new_socket);
     }
   }
 }
@@ -193,7 +271,7 @@ void advanced_server_loop(void *arg) {
 // syscalls" AND "The solution is correct only if: Both dashboards run at the
 // same time: ./build/web_dashboard ... ./build/advanced_dashboard". This
 // implies they are separate processes. BUT `green_threads` is a user-space
-// library linked INTO the binary. Accessing `gthread_get_all_threads()` from a
+// library linked INTO the binary. Accessing `gthread_for_each()` from a
 // separate binary `advanced_dashboard` will only show the threads OF THAT
 // DASHBOARD. It WON'T show the threads of the OTHER dashboard
 // (`web_dashboard`). THE USER MIGHT BE CONFUSED or implies I should use Shared
@@ -269,6 +347,29 @@ int main(void) {
   gthread_t *s;
   gthread_create(&s, sleep_task, NULL);
 
+  // A background job capped at 5% of the CPU, however many tickets it has
+  gthread_attr_t bg;
+  gthread_attr_init(&bg);
+  bg.name = "compaction";
+  bg.tickets = 200;
+  bg.quota = gquota_create("background", 5000000, 100000000);
+  gthread_t *b;
+  gthread_create_ex(&b, &bg, cpu_task, NULL);
+
+  // Two tenants with equal tickets: one thread in "interactive" gets as
+  // much CPU as the eight in "batch" do between them
+  ggroup_t *tenants = ggroup_create(NULL, "tenants", 400);
+  ggroup_t *groups[2] = {ggroup_create(tenants, "interactive", 100),
+                         ggroup_create(tenants, "batch", 100)};
+  for (int i = 0; i < 9; i++) {
+    gthread_attr_t ga;
+    gthread_attr_init(&ga);
+    ga.name = i ? "batch" : "interactive";
+    ga.group = groups[i ? 1 : 0];
+    gthread_t *g;
+    gthread_create_ex(&g, &ga, cpu_task, NULL);
+  }
+
   gthread_join(t, NULL); // Wait for server
   return 0;
 }
@@ -14,6 +14,96 @@ function fetchData() {
             document.getElementById('connectionStatus').style.backgroundColor = 'red';
             console.error(err);
         });
+
+    fetch('/quotas')
+        .then(res => res.json())
+        .then(updateQuotas)
+        .catch(err => console.error(err));
+
+    fetch('/groups')
+        .then(res => res.json())
+        .then(updateGroups)
+        .catch(err => console.error(err));
+}
+
+// CPU use is the growth of total_us between two polls
+let lastQuotas = {};
+let lastQuotaTime = 0;
+
+function updateQuotas(pools) {
+    const tbody = document.querySelector('#quotaTable tbody');
+    if (!tbody) return;
+    tbody.innerHTML = '';
+
+    const now = performance.now();
+    const elapsedUs = (now - lastQuotaTime) * 1000;
+    const seen = {};
+
+    pools.forEach(q => {
+        const cap = q.runtime_us / q.period_us * 100;
+        const prev = lastQuotas[q.id];
+        const used = prev !== undefined && elapsedUs > 0
+            ? (q.total_us - prev) / elapsedUs * 100 : 0;
+        seen[q.id] = q.total_us;
+
+        const tr = document.createElement('tr');
+        tr.innerHTML = `
+            <td>${q.name}</td>
+            <td>${cap.toFixed(1)}%</td>
+            <td>${used.toFixed(1)}%</td>
+            <td>${(q.used_us / 1000).toFixed(1)} / ${(q.runtime_us / 1000).toFixed(1)} ms</td>
+            <td>${q.threads}</td>
+            <td>${q.throttled}</td>
+            <td>${q.throttles}</td>
+        `;
+        tbody.appendChild(tr);
+    });
+
+    lastQuotas = seen;
+    lastQuotaTime = now;
+}
+
+// Same idea for groups, from cpu_us; subgroups are indented under parents
+let lastGroups = {};
+let lastGroupTime = 0;
+
+function updateGroups(groups) {
+    const tbody = document.querySelector('#groupTable tbody');
+    if (!tbody) return;
+    // Leave the rows alone while a ticket box is being edited
+    if (tbody.contains(document.activeElement)) return;
+    tbody.innerHTML = '';
+
+    const now = performance.now();
+    const elapsedUs = (now - lastGroupTime) * 1000;
+    const seen = {};
+    const depth = {};
+
+    groups.forEach(g => {
+        depth[g.id] = g.parent >= 0 ? (depth[g.parent] || 0) + 1 : 0;
+        const prev = lastGroups[g.id];
+        const used = prev !== undefined && elapsedUs > 0
+            ? (g.cpu_us - prev) / elapsedUs * 100 : 0;
+        seen[g.id] = g.cpu_us;
+
+        const tr = document.createElement('tr');
+        tr.innerHTML = `
+            <td style="padding-left: ${depth[g.id] * 20 + 8}px">${g.name}</td>
+            <td>${used.toFixed(1)}%</td>
+            <td>${g.active}</td>
+            <td>${g.threads}</td>
+            <td>
+                <div class="control-group">
+                    <input type="number" id="gtix-${g.id}" value="${g.tickets}" min="1" max="10000" style="width: 70px;">
+                    <button onclick="setGroupTickets(${g.id})">Set</button>
+                </div>
+            </td>
+        `;
+        tbody.appendChild(tr);
+    });
+
+    lastGroups = seen;
+    lastGroupTime = now;
 }
 
 function updateScheduler(threads) {
@@ -34,7 +124,8 @@ function updateScheduler(threads) {
             3: 'BLOCKED',
             4: 'TERMINATED'
         };
-        const stateStr = states[t.state] || 'UNKNOWN';
+        // Parked until its CPU pool's next period
+        const stateStr = t.throttled ? 'THROTTLED' : (states[t.state] || 'UNKNOWN');
 
         // CPU Share Control: Input + Button
         const controlHtml = `
@@ -133,3 +224,14 @@ window.setTickets = function (tid) {
         body: `id=${tid}&tickets=${val}`
     }).then(() => fetchData()); // Refresh immediately
 };
+
+window.setGroupTickets = function (gid) {
+    const input = document.getElementById(`gtix-${gid}`);
+    const val = input.value;
+    input.blur();
+
+    fetch('/group_tickets', {
+        method: 'POST',
+        body: `id=${gid}&tickets=${val}`
+    }).then(() => fetchData());
+};
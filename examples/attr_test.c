@@ -0,0 +1,155 @@
+#include "gthread.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Phase 32: Thread attributes. Usage: attr_test [workers] */
+
+#define MS 1000000ULL
+
+static int failures = 0;
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);                   \
+      failures++;                                                              \
+    }                                                                          \
+  } while (0)
+
+/* A thread that never gives the CPU back shows up as a hang: fail instead */
+static void *watchdog(void *arg) {
+  (void)arg;
+  sleep(20);
+  printf("FAIL: hung\n");
+  fflush(stdout);
+  _exit(1);
+}
+
+void nothing(void *arg) { (void)arg; }
+
+void test_stack(void) {
+  gthread_attr_t attr;
+  gthread_attr_init(&attr);
+  CHECK(attr.stack_size == GTHREAD_STACK_DEFAULT &&
+        attr.guard_size == GTHREAD_GUARD_DEFAULT &&
+        attr.tickets == GTHREAD_TICKETS_DEFAULT && !attr.detached);
+
+  // Default guard: rounded up to the stack cache's class
+  gthread_t *t;
+  attr.stack_size = 40 * 1024;
+  CHECK(gthread_create_ex(&t, &attr, nothing, NULL) == 0);
+  CHECK(t->stack_size == 64 * 1024 && t->guard_size == GTHREAD_GUARD_DEFAULT);
+  gthread_join(t, NULL);
+
+  // Other guards are mapped as asked; too small a stack is enlarged
+  attr.stack_size = 1024;
+  attr.guard_size = 0;
+  CHECK(gthread_create_ex(&t, &attr, nothing, NULL) == 0);
+  CHECK(t->stack_size == GTHREAD_STACK_MIN && t->guard_size == 0);
+  gthread_join(t, NULL);
+  printf("stack and guard sizes: ok\n");
+}
+
+void test_name(void) {
+  gthread_attr_t attr;
+  gthread_attr_init(&attr);
+  gthread_t *t;
+  CHECK(gthread_create_ex(&t, &attr, nothing, NULL) == 0);
+  CHECK(strcmp(t->name, "GTHREAD") == 0);
+  gthread_join(t, NULL);
+
+  char long_name[64];
+  memset(long_name, 'n', sizeof(long_name) - 1);
+  long_name[sizeof(long_name) - 1] = 0;
+  attr.name = long_name;
+  CHECK(gthread_create_ex(&t, &attr, nothing, NULL) == 0);
+  CHECK(strlen(t->name) == GTHREAD_NAME_MAX - 1);
+  gthread_join(t, NULL);
+  printf("names: ok\n");
+}
+
+int detached_ran = 0;
+
+void detached_fn(void *arg) {
+  (void)arg;
+  __atomic_store_n(&detached_ran, 1, __ATOMIC_RELEASE);
+}
+
+void test_detached(void) {
+  gthread_attr_t attr;
+  gthread_attr_init(&attr);
+  attr.detached = 1;
+  gthread_t *t;
+  CHECK(gthread_create_ex(&t, &attr, detached_fn, NULL) == 0);
+  CHECK(gthread_join(t, NULL) == -1);
+  while (!__atomic_load_n(&detached_ran, __ATOMIC_ACQUIRE))
+    gthread_yield();
+  printf("detached: ok\n");
+}
+
+int counting = 0;
+unsigned long counts[2];
+
+void counter(void *arg) {
+  long i = (long)arg;
+  while (__atomic_load_n(&counting, __ATOMIC_RELAXED)) {
+    counts[i]++;
+    gthread_yield();
+  }
+}
+
+void test_tickets(int workers) {
+  gthread_attr_t attr;
+  gthread_attr_init(&attr);
+  gthread_t *t[2];
+  attr.tickets = 0;
+  CHECK(gthread_create_ex(&t[0], &attr, nothing, NULL) == -1);
+  attr.tickets = -5;
+  CHECK(gthread_create_ex(&t[0], &attr, nothing, NULL) == -1);
+  if (workers != 1) { // Shares only show against each other on one worker
+    printf("tickets: ok (validation only)\n");
+    return;
+  }
+
+  // More tickets than the stride constant: the stride is clamped to 1
+  // rather than 0, so the other thread (and this one) still get turns
+  __atomic_store_n(&counting, 1, __ATOMIC_RELAXED);
+  attr.tickets = 20000;
+  CHECK(gthread_create_ex(&t[0], &attr, counter, (void *)0L) == 0);
+  attr.tickets = 100;
+  CHECK(gthread_create_ex(&t[1], &attr, counter, (void *)1L) == 0);
+  gthread_sleep(50);
+  __atomic_store_n(&counting, 0, __ATOMIC_RELAXED);
+  gthread_join(t[0], NULL);
+  gthread_join(t[1], NULL);
+  CHECK(counts[1] > 0 && counts[0] > 20 * counts[1]);
+  printf("tickets: ok (%lu vs %lu turns)\n", counts[0], counts[1]);
+}
+
+void run_tests(void *arg) {
+  int workers = (int)(long)arg;
+  test_stack();
+  test_name();
+  test_detached();
+  test_tickets(workers);
+}
+
+int main(int argc, char **argv) {
+  int workers = argc > 1 ? atoi(argv[1]) : 1;
+  pthread_t wd;
+  pthread_create(&wd, NULL, watchdog, NULL);
+
+  gthread_set_workers(workers);
+  gthread_init();
+
+  gthread_t *t;
+  gthread_create(&t, run_tests, (void *)(long)workers);
+  gthread_join(t, NULL);
+
+  printf(failures ? "FAILED (%d)\n" : "All attribute tests passed\n",
+         failures);
+  return failures ? 1 : 0;
+}
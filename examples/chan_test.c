@@ -0,0 +1,273 @@
+#include "chan.h"
+#include "gthread.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Phase 43: Channels. Usage: chan_test [workers], 4 by default */
+
+#define PING_ROUNDS 10000
+#define RING_SIZE 4
+#define BLOCKED_SENDERS 3
+#define PARKED 3
+#define RACE_SENDERS 4
+#define RACE_RECEIVERS 4
+#define RACE_ROUNDS 3000
+
+static int failures = 0;
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);                   \
+      failures++;                                                              \
+    }                                                                          \
+  } while (0)
+
+/* Sleep until n threads are parked on q */
+static void wait_parked(gchan_t *ch, chan_waitq_t *q, int n) {
+  for (;;) {
+    int parked = 0;
+    gspin_lock(&ch->lock);
+    for (chan_waiter_t *w = q->first; w; w = w->next)
+      parked++;
+    gspin_unlock(&ch->lock);
+    if (parked >= n)
+      return;
+    gthread_sleep(1);
+  }
+}
+
+gchan_t *ping, *pong;
+
+void ponger(void *arg) {
+  (void)arg;
+  long v;
+  while (gchan_recv(ping, &v) == GCHAN_OK)
+    gchan_send(pong, &(long){v + 1});
+}
+
+void test_ping_pong(void) {
+  ping = gchan_create(sizeof(long), 0);
+  pong = gchan_create(sizeof(long), 0);
+  gthread_t *t;
+  gthread_create(&t, ponger, NULL);
+
+  long v = 0;
+  int bad = 0;
+  for (int i = 0; i < PING_ROUNDS; i++) {
+    long sent = v;
+    CHECK(gchan_send(ping, &v) == GCHAN_OK);
+    CHECK(gchan_recv(pong, &v) == GCHAN_OK);
+    bad += v != sent + 1;
+    bad += gchan_len(ping) != 0 || gchan_len(pong) != 0;
+  }
+  CHECK(bad == 0 && v == PING_ROUNDS);
+
+  gchan_close(ping);
+  gthread_join(t, NULL);
+  gchan_destroy(ping);
+  gchan_destroy(pong);
+  printf("unbuffered ping-pong: ok (%d rounds)\n", PING_ROUNDS);
+}
+
+gchan_t *ring;
+int sender_results[BLOCKED_SENDERS];
+
+void ring_sender(void *arg) {
+  long i = (long)arg;
+  int v = 100 + (int)i;
+  sender_results[i] = gchan_send(ring, &v);
+}
+
+void test_full_ring(void) {
+  ring = gchan_create(sizeof(int), RING_SIZE);
+  for (int i = 0; i < RING_SIZE; i++)
+    CHECK(gchan_try_send(ring, &i) == GCHAN_OK);
+  CHECK(gchan_try_send(ring, &(int){-1}) == GCHAN_WOULDBLOCK);
+  CHECK(gchan_len(ring) == RING_SIZE);
+
+  // Senders park on the full ring, in order
+  gthread_t *t[BLOCKED_SENDERS];
+  for (long i = 0; i < BLOCKED_SENDERS; i++) {
+    gthread_create(&t[i], ring_sender, (void *)i);
+    wait_parked(ring, &ring->sendq, i + 1);
+  }
+
+  // Each receive moves the first blocked sender's value into the freed
+  // slot: the ring stays full and FIFO holds across the handoff
+  int v;
+  for (int i = 0; i < RING_SIZE + BLOCKED_SENDERS; i++) {
+    CHECK(gchan_recv(ring, &v) == GCHAN_OK);
+    CHECK(v == (i < RING_SIZE ? i : 100 + i - RING_SIZE));
+    if (i < BLOCKED_SENDERS)
+      CHECK(gchan_len(ring) == RING_SIZE);
+  }
+  CHECK(gchan_try_recv(ring, &v) == GCHAN_WOULDBLOCK);
+  for (int i = 0; i < BLOCKED_SENDERS; i++) {
+    gthread_join(t[i], NULL);
+    CHECK(sender_results[i] == GCHAN_OK);
+  }
+  gchan_destroy(ring);
+  printf("full bounded ring: ok\n");
+}
+
+gchan_t *closing;
+int close_results[PARKED];
+int close_values[PARKED];
+
+void parked_receiver(void *arg) {
+  long i = (long)arg;
+  close_values[i] = -1;
+  close_results[i] = gchan_recv(closing, &close_values[i]);
+}
+
+void parked_sender(void *arg) {
+  long i = (long)arg;
+  close_results[i] = gchan_send(closing, &(int){(int)i});
+}
+
+void test_close(void) {
+  gthread_t *t[PARKED];
+
+  // Receivers parked on an empty channel: all get GCHAN_CLOSED and a
+  // zeroed value
+  closing = gchan_create(sizeof(int), 0);
+  for (long i = 0; i < PARKED; i++)
+    gthread_create(&t[i], parked_receiver, (void *)i);
+  wait_parked(closing, &closing->recvq, PARKED);
+  CHECK(gchan_close(closing) == 0);
+  CHECK(gchan_close(closing) == -1);
+  for (int i = 0; i < PARKED; i++) {
+    gthread_join(t[i], NULL);
+    CHECK(close_results[i] == GCHAN_CLOSED && close_values[i] == 0);
+  }
+  CHECK(gchan_send(closing, &(int){1}) == GCHAN_CLOSED);
+  gchan_destroy(closing);
+
+  // Senders parked on a full ring: all get GCHAN_CLOSED, and what was
+  // already buffered can still be received
+  closing = gchan_create(sizeof(int), 2);
+  CHECK(gchan_send(closing, &(int){7}) == GCHAN_OK);
+  CHECK(gchan_send(closing, &(int){8}) == GCHAN_OK);
+  for (long i = 0; i < PARKED; i++)
+    gthread_create(&t[i], parked_sender, (void *)i);
+  wait_parked(closing, &closing->sendq, PARKED);
+  CHECK(gchan_close(closing) == 0);
+  for (int i = 0; i < PARKED; i++) {
+    gthread_join(t[i], NULL);
+    CHECK(close_results[i] == GCHAN_CLOSED);
+  }
+  int v;
+  CHECK(gchan_recv(closing, &v) == GCHAN_OK && v == 7);
+  CHECK(gchan_recv(closing, &v) == GCHAN_OK && v == 8);
+  CHECK(gchan_recv(closing, &v) == GCHAN_CLOSED && v == 0);
+  CHECK(gchan_try_recv(closing, &v) == GCHAN_CLOSED);
+  gchan_destroy(closing);
+  printf("close with parked receivers and senders: ok\n");
+}
+
+/* Selects with short timeouts on both sides, so timers keep firing while
+   peers complete cases: every value must be delivered exactly once, and no
+   waiter may be left behind on a channel */
+gchan_t *unbuf, *buf, *never;
+long race_sent = 0, race_sent_sum = 0;
+long race_recv = 0, race_recv_sum = 0;
+long race_timeouts = 0;
+
+void race_sender(void *arg) {
+  long id = (long)arg;
+  long sent = 0, sum = 0, timeouts = 0;
+  for (long i = 0; i < RACE_ROUNDS; i++) {
+    long v = id * RACE_ROUNDS + i + 1;
+    gchan_case_t cases[3] = {
+        {unbuf, GCHAN_SEND, &v, 0},
+        {buf, GCHAN_SEND, &v, 0},
+        {never, GCHAN_RECV, NULL, 0},
+    };
+    int fired = gchan_select(cases, 3, (i % 8) * 2000);
+    if (fired < 0) {
+      timeouts++;
+      continue;
+    }
+    CHECK(fired < 2 && cases[fired].ok);
+    sent++;
+    sum += v;
+  }
+  __atomic_add_fetch(&race_sent, sent, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&race_sent_sum, sum, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&race_timeouts, timeouts, __ATOMIC_RELAXED);
+}
+
+void race_receiver(void *arg) {
+  (void)arg;
+  long got = 0, sum = 0, timeouts = 0;
+  for (long i = 0; i < RACE_ROUNDS; i++) {
+    long v = 0;
+    gchan_case_t cases[3] = {
+        {never, GCHAN_RECV, NULL, 0},
+        {unbuf, GCHAN_RECV, &v, 0},
+        {buf, GCHAN_RECV, &v, 0},
+    };
+    int fired = gchan_select(cases, 3, (i % 5) * 3000);
+    if (fired < 0) {
+      timeouts++;
+      continue;
+    }
+    CHECK(fired > 0 && cases[fired].ok && v > 0);
+    got++;
+    sum += v;
+  }
+  __atomic_add_fetch(&race_recv, got, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&race_recv_sum, sum, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&race_timeouts, timeouts, __ATOMIC_RELAXED);
+}
+
+void test_select_race(void) {
+  unbuf = gchan_create(sizeof(long), 0);
+  buf = gchan_create(sizeof(long), 2);
+  never = gchan_create(sizeof(long), 0);
+  gthread_t *s[RACE_SENDERS], *r[RACE_RECEIVERS];
+  for (long i = 0; i < RACE_SENDERS; i++)
+    gthread_create(&s[i], race_sender, (void *)i);
+  for (long i = 0; i < RACE_RECEIVERS; i++)
+    gthread_create(&r[i], race_receiver, (void *)i);
+  for (int i = 0; i < RACE_SENDERS; i++)
+    gthread_join(s[i], NULL);
+  for (int i = 0; i < RACE_RECEIVERS; i++)
+    gthread_join(r[i], NULL);
+
+  // Whatever is still buffered was sent but not yet received
+  long v;
+  while (gchan_try_recv(buf, &v) == GCHAN_OK) {
+    race_recv++;
+    race_recv_sum += v;
+  }
+  CHECK(race_sent == race_recv && race_sent_sum == race_recv_sum);
+  gchan_t *chans[3] = {unbuf, buf, never};
+  for (int i = 0; i < 3; i++) {
+    CHECK(!chans[i]->sendq.first && !chans[i]->recvq.first);
+    gchan_destroy(chans[i]);
+  }
+  printf("select timeout vs send: ok (%ld delivered, %ld timed out)\n",
+         race_sent, race_timeouts);
+}
+
+void run_tests(void *arg) {
+  (void)arg;
+  test_ping_pong();
+  test_full_ring();
+  test_close();
+  test_select_race();
+}
+
+int main(int argc, char **argv) {
+  gthread_set_workers(argc > 1 ? atoi(argv[1]) : 4);
+  gthread_init();
+
+  gthread_t *t;
+  gthread_create(&t, run_tests, NULL);
+  gthread_join(t, NULL);
+
+  printf(failures ? "FAILED (%d)\n" : "All channel tests passed\n", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,203 @@
+#include "chan.h"
+#include "gthread.h"
+#include "io.h"
+#include "sync.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Phase 29: Copy-stack mode. Every thread here runs on its worker's shared
+   stack. Usage: copystack_test [workers] */
+
+#define SHARED_STACK (256 * 1024)
+#define IDLERS 10000
+#define DEPTH_THREADS 16
+#define PINGS 2000
+
+static int failures = 0;
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);                   \
+      failures++;                                                              \
+    }                                                                          \
+  } while (0)
+
+/* A lost wakeup shows up as a hang: fail instead */
+static void *watchdog(void *arg) {
+  (void)arg;
+  sleep(20);
+  printf("FAIL: hung\n");
+  fflush(stdout);
+  _exit(1);
+}
+
+static long rss_kb(void) {
+  long pages = 0, resident = 0;
+  FILE *f = fopen("/proc/self/statm", "r");
+  if (f) {
+    if (fscanf(f, "%ld %ld", &pages, &resident) != 2)
+      resident = 0;
+    fclose(f);
+  }
+  return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/* Thousands of parked threads, each with locals that must survive others
+   running over the same stack */
+gsem_t idle_release;
+int idlers_intact = 0;
+
+void idler(void *arg) {
+  long id = (long)arg;
+  volatile long locals[16];
+  for (int i = 0; i < 16; i++)
+    locals[i] = id * 16 + i;
+  gsem_wait(&idle_release);
+  int ok = 1;
+  for (int i = 0; i < 16; i++)
+    ok &= locals[i] == id * 16 + i;
+  if (ok)
+    __atomic_add_fetch(&idlers_intact, 1, __ATOMIC_RELAXED);
+}
+
+void test_idle(void) {
+  static gthread_t *t[IDLERS];
+  gsem_init(&idle_release, 0);
+  long before = rss_kb();
+  for (long i = 0; i < IDLERS; i++)
+    gthread_create(&t[i], idler, (void *)i);
+  gthread_sleep(20); // All parked
+  long per_thread = (rss_kb() - before) * 1024 / IDLERS;
+
+  for (int i = 0; i < IDLERS; i++)
+    gsem_post(&idle_release);
+  for (int i = 0; i < IDLERS; i++)
+    gthread_join(t[i], NULL);
+  CHECK(idlers_intact == IDLERS);
+  // TCB plus the live frames: nowhere near a page of stack each
+  CHECK(per_thread < 2048);
+  printf("%d parked threads: ok (~%ld bytes each)\n", IDLERS, per_thread);
+}
+
+/* Deep, different-sized images swapped in and out mid-recursion */
+int depth_ok = 0;
+
+__attribute__((noinline)) static long descend(long id, int depth) {
+  volatile char frame[512];
+  memset((char *)frame, (int)(id + depth), sizeof(frame));
+  long below = 0;
+  if (depth > 0)
+    below = descend(id, depth - 1);
+  else
+    gthread_yield(); // Others overwrite the stack meanwhile
+  for (size_t i = 0; i < sizeof(frame); i++)
+    if (frame[i] != (char)(id + depth))
+      return -1;
+  return below < 0 ? -1 : below + 1;
+}
+
+void diver(void *arg) {
+  long id = (long)arg;
+  for (int round = 0; round < 20; round++) {
+    int depth = (int)(id * 7 + round * 13) % 200;
+    if (descend(id, depth) != depth + 1)
+      return;
+    gthread_yield();
+  }
+  __atomic_add_fetch(&depth_ok, 1, __ATOMIC_RELAXED);
+}
+
+void test_depth(void) {
+  gthread_t *t[DEPTH_THREADS];
+  for (long i = 0; i < DEPTH_THREADS; i++)
+    gthread_create(&t[i], diver, (void *)i);
+  for (int i = 0; i < DEPTH_THREADS; i++)
+    gthread_join(t[i], NULL);
+  CHECK(depth_ok == DEPTH_THREADS);
+  printf("frames up to 100 KB deep: ok\n");
+}
+
+/* Handoffs write into the parked peer's waiter record and value: those live
+   on the heap while it is parked, not in its saved image */
+gchan_t *ping, *pong;
+
+void ponger(void *arg) {
+  (void)arg;
+  long v;
+  while (gchan_recv(ping, &v) == GCHAN_OK)
+    gchan_send(pong, &(long){v + 1});
+}
+
+void test_handoff(void) {
+  ping = gchan_create(sizeof(long), 0);
+  pong = gchan_create(sizeof(long), 0);
+  gthread_t *t;
+  gthread_create(&t, ponger, NULL);
+  long v = 0;
+  for (int i = 0; i < PINGS; i++) {
+    gchan_send(ping, &v);
+    gchan_recv(pong, &v);
+  }
+  CHECK(v == PINGS);
+  gchan_close(ping);
+  gthread_join(t, NULL);
+  gchan_destroy(ping);
+  gchan_destroy(pong);
+  printf("channel handoff between shared threads: ok\n");
+}
+
+int pipe_fds[2];
+
+void late_writer(void *arg) {
+  (void)arg;
+  gthread_sleep(5);
+  if (gthread_write(pipe_fds[1], "shared", 6) != 6)
+    perror("write");
+}
+
+/* Reads into a stack buffer go through the readiness path */
+void test_io(void) {
+  if (pipe(pipe_fds) < 0) {
+    perror("pipe");
+    exit(1);
+  }
+  gthread_t *t;
+  gthread_create(&t, late_writer, NULL);
+  char buf[16] = {0};
+  CHECK(gthread_read(pipe_fds[0], buf, sizeof(buf)) == 6);
+  CHECK(memcmp(buf, "shared", 6) == 0);
+  gthread_join(t, NULL);
+  gthread_close(pipe_fds[0]);
+  gthread_close(pipe_fds[1]);
+  printf("read into a stack buffer: ok\n");
+}
+
+void run_tests(void *arg) {
+  (void)arg;
+  test_idle();
+  test_depth();
+  test_handoff();
+  test_io();
+}
+
+int main(int argc, char **argv) {
+  pthread_t wd;
+  pthread_create(&wd, NULL, watchdog, NULL);
+
+  if (argc > 1)
+    gthread_set_workers(atoi(argv[1]));
+  gthread_set_shared_stack(SHARED_STACK);
+  gthread_init();
+
+  gthread_t *t;
+  gthread_create(&t, run_tests, NULL);
+  gthread_join(t, NULL);
+
+  printf(failures ? "FAILED (%d)\n" : "All copy-stack tests passed\n",
+         failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,273 @@
+#include "group.h"
+#include "gthread.h"
+#include "runtime_stats.h"
+#include "sync.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Phase 38: Scheduling groups. Shares are per worker, so they are only
+   checked on one. Usage: group_test [workers] */
+
+#define MAX_GROUPS 16
+#define MAX_HOGS 16
+
+static int failures = 0;
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);                   \
+      failures++;                                                              \
+    }                                                                          \
+  } while (0)
+
+/* A group whose share never comes shows up as a hang: fail instead */
+static void *watchdog(void *arg) {
+  (void)arg;
+  sleep(20);
+  printf("FAIL: hung\n");
+  fflush(stdout);
+  _exit(1);
+}
+
+static void burn(int n) {
+  for (volatile int i = 0; i < n; i++)
+    ;
+}
+
+/* The stats of group g, if it still exists */
+static int group_stats(ggroup_t *g, group_stats_t *out) {
+  group_stats_t gs[MAX_GROUPS];
+  int n = runtime_get_group_stats(gs, MAX_GROUPS);
+  for (int i = 0; i < n; i++) {
+    if (gs[i].id == g->id) {
+      *out = gs[i];
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int hogging = 0;
+int nr_hogs = 0;
+unsigned long counts[MAX_HOGS];
+gthread_t *hogs[MAX_HOGS];
+gsem_t gate;
+
+void hog(void *arg) {
+  long i = (long)arg;
+  while (__atomic_load_n(&hogging, __ATOMIC_RELAXED)) {
+    burn(2000);
+    counts[i]++;
+    gthread_yield();
+  }
+}
+
+/* Blocks until the gate opens, then hogs */
+void late_hog(void *arg) {
+  gsem_wait(&gate);
+  hog(arg);
+}
+
+/* n hogs in g; returns the first one's slot */
+static int spawn(ggroup_t *g, int n, void (*fn)(void *)) {
+  gthread_attr_t attr;
+  gthread_attr_init(&attr);
+  attr.group = g;
+  int first = nr_hogs;
+  __atomic_store_n(&hogging, 1, __ATOMIC_RELAXED);
+  for (int i = 0; i < n; i++, nr_hogs++) {
+    counts[nr_hogs] = 0;
+    gthread_create_ex(&hogs[nr_hogs], &attr, fn, (void *)(long)nr_hogs);
+  }
+  return first;
+}
+
+static void stop_hogs(void) {
+  __atomic_store_n(&hogging, 0, __ATOMIC_RELAXED);
+  for (int i = 0; i < nr_hogs; i++)
+    gthread_join(hogs[i], NULL);
+  nr_hogs = 0;
+}
+
+/* Work done by slots [first, first + n) over the next ms */
+static unsigned long snap[MAX_HOGS];
+
+static void measure(int ms) {
+  memcpy(snap, counts, sizeof(snap));
+  gthread_sleep(ms);
+  for (int i = 0; i < MAX_HOGS; i++)
+    snap[i] = counts[i] - snap[i];
+}
+
+static double work(int first, int n) {
+  unsigned long sum = 0;
+  for (int i = first; i < first + n; i++)
+    sum += snap[i];
+  return sum ? (double)sum : 1.0;
+}
+
+/* One thread against eight: equal group tickets, equal shares */
+void test_member_count(void) {
+  ggroup_t *a = ggroup_create(NULL, "one", 100);
+  ggroup_t *b = ggroup_create(NULL, "eight", 100);
+  int sa = spawn(a, 1, hog);
+  int sb = spawn(b, 8, hog);
+  measure(200);
+  stop_hogs();
+  ggroup_destroy(a);
+  ggroup_destroy(b);
+
+  double ratio = work(sb, 8) / work(sa, 1);
+  CHECK(ratio > 0.6 && ratio < 1.6);
+  printf("1 thread vs 8 in equal groups: ok (%.2f)\n", ratio);
+}
+
+/* Subgroups split their parent's share by their own tickets */
+void test_nested(void) {
+  ggroup_t *p = ggroup_create(NULL, "parent", 100);
+  ggroup_t *big = ggroup_create(p, "big", 300);
+  ggroup_t *small = ggroup_create(p, "small", 100);
+  ggroup_t *peer = ggroup_create(NULL, "peer", 100);
+  int sb = spawn(big, 2, hog);
+  int ss = spawn(small, 2, hog);
+  int sp = spawn(peer, 1, hog);
+  measure(200);
+
+  group_stats_t s;
+  CHECK(group_stats(big, &s) && s.parent == p->id && s.threads == 2);
+  CHECK(group_stats(p, &s) && s.parent == -1 && s.threads == 0);
+  stop_hogs();
+  ggroup_destroy(big);
+  ggroup_destroy(small);
+  ggroup_destroy(p);
+  ggroup_destroy(peer);
+
+  double split = work(sb, 2) / work(ss, 2);
+  double outer = (work(sb, 2) + work(ss, 2)) / work(sp, 1);
+  CHECK(split > 2.0 && split < 4.5);
+  CHECK(outer > 0.6 && outer < 1.6);
+  printf("300:100 subgroups, parent vs peer: ok (%.2f, %.2f)\n", split, outer);
+}
+
+/* An idle group takes nothing, and gets its share once it wakes */
+void test_idle(void) {
+  ggroup_t *a = ggroup_create(NULL, "a", 100);
+  ggroup_t *b = ggroup_create(NULL, "b", 100);
+  ggroup_t *c = ggroup_create(NULL, "sleepy", 100);
+  gsem_init(&gate, 0);
+  int sa = spawn(a, 1, hog);
+  int sb = spawn(b, 1, hog);
+  int sc = spawn(c, 4, late_hog);
+  gthread_sleep(10); // All four blocked
+
+  group_stats_t s;
+  CHECK(group_stats(c, &s) && s.active == 0 && s.threads == 4);
+  uint64_t cpu0 = s.cpu_ns;
+  measure(100);
+  CHECK(group_stats(c, &s) && s.cpu_ns == cpu0);
+  double idle = work(sb, 1) / work(sa, 1);
+
+  for (int i = 0; i < 4; i++)
+    gsem_post(&gate);
+  measure(200);
+  CHECK(group_stats(c, &s) && s.active > 0);
+  stop_hogs();
+  ggroup_destroy(a);
+  ggroup_destroy(b);
+  ggroup_destroy(c);
+
+  double woken = work(sc, 4) / work(sa, 1);
+  CHECK(idle > 0.6 && idle < 1.6);
+  CHECK(woken > 0.6 && woken < 1.6);
+  printf("idle group, then woken: ok (%.2f, %.2f)\n", idle, woken);
+}
+
+/* Ticket changes show within a turn, by handle or by id */
+void test_set_tickets(void) {
+  ggroup_t *a = ggroup_create(NULL, "a", 100);
+  ggroup_t *b = ggroup_create(NULL, "b", 100);
+  int sa = spawn(a, 1, hog);
+  int sb = spawn(b, 1, hog);
+
+  CHECK(ggroup_set_tickets(a, 300) == 0);
+  measure(200);
+  double raised = work(sa, 1) / work(sb, 1);
+  CHECK(runtime_set_group_tickets(b->id, 300) == 0);
+  measure(200);
+  double level = work(sa, 1) / work(sb, 1);
+
+  group_stats_t s;
+  CHECK(group_stats(b, &s) && s.tickets == 300);
+  stop_hogs();
+  ggroup_destroy(a);
+  ggroup_destroy(b);
+
+  CHECK(raised > 2.0 && raised < 4.5);
+  CHECK(level > 0.6 && level < 1.6);
+  CHECK(runtime_set_group_tickets(-1, 100) == -1);
+  CHECK(ggroup_set_tickets(NULL, 100) == -1);
+  printf("ggroup_set_tickets, then by id: ok (%.2f, %.2f)\n", raised, level);
+}
+
+/* The caller joins and leaves; a group goes once nothing is left in it */
+void test_set_group(void) {
+  ggroup_t *p = ggroup_create(NULL, "outer", 100);
+  ggroup_t *g = ggroup_create(p, "inner", 100);
+  group_stats_t s;
+
+  gthread_set_group(g);
+  CHECK(group_stats(g, &s) && s.threads == 1);
+  uint64_t start = gthread_now_ns();
+  while (gthread_now_ns() - start < 5000000ULL) {
+    burn(2000);
+    gthread_yield();
+  }
+  CHECK(group_stats(p, &s) && s.cpu_ns > 0); // Charged up the tree
+  gthread_set_group(NULL);
+  CHECK(group_stats(g, &s) && s.threads == 0);
+
+  int outer_id = p->id;
+  ggroup_destroy(p); // Held up by its subgroup
+  CHECK(group_stats(p, &s));
+  ggroup_destroy(g);
+  group_stats_t gs[MAX_GROUPS];
+  int n = runtime_get_group_stats(gs, MAX_GROUPS);
+  int left = 0;
+  for (int i = 0; i < n; i++)
+    left += gs[i].id == outer_id;
+  CHECK(left == 0);
+  printf("gthread_set_group and teardown: ok\n");
+}
+
+void run_tests(void *arg) {
+  int workers = (int)(long)arg;
+  test_set_group();
+  if (workers != 1) {
+    printf("shares are skipped on %d workers\n", workers);
+    return;
+  }
+  test_member_count();
+  test_nested();
+  test_idle();
+  test_set_tickets();
+}
+
+int main(int argc, char **argv) {
+  pthread_t wd;
+  pthread_create(&wd, NULL, watchdog, NULL);
+
+  int workers = argc > 1 ? atoi(argv[1]) : 1;
+  gthread_set_workers(workers);
+  gthread_init();
+
+  gthread_t *t;
+  gthread_create(&t, run_tests, (void *)(long)workers);
+  gthread_join(t, NULL);
+
+  printf(failures ? "FAILED (%d)\n" : "All group tests passed\n", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,139 @@
+#include "gthread.h"
+#include "sync.h"
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* Phase 28: Guarded stacks. Usage: guard_test [workers] */
+
+#define FRAME 1024
+#define MANY 35000 /* Past the ~32k two-VMA stacks vm.max_map_count allows */
+
+static int failures = 0;
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);                   \
+      failures++;                                                              \
+    }                                                                          \
+  } while (0)
+
+/* 1 KB per frame; the add after the call keeps it from becoming a loop */
+__attribute__((noinline)) static int recurse(int depth) {
+  volatile char buf[FRAME];
+  buf[0] = (char)depth;
+  if (depth == 0)
+    return buf[0];
+  return recurse(depth - 1) + buf[0];
+}
+
+void recurser(void *arg) { recurse((int)(long)arg); }
+
+/* Runs one thread recursing `depth` frames in a child with its own runtime,
+   before ours exists so the fork is safe. Returns the wait status and what
+   the child wrote to stderr. */
+static int run_child(size_t stack_size, long depth, char *msg, size_t len) {
+  int fds[2];
+  if (pipe(fds) < 0) {
+    perror("pipe");
+    exit(1);
+  }
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    exit(1);
+  }
+  if (pid == 0) {
+    dup2(fds[1], STDERR_FILENO);
+    gthread_init();
+    gthread_attr_t attr;
+    gthread_attr_init(&attr);
+    attr.stack_size = stack_size;
+    gthread_t *t;
+    gthread_create_ex(&t, &attr, recurser, (void *)depth);
+    gthread_join(t, NULL);
+    _exit(0);
+  }
+
+  close(fds[1]);
+  memset(msg, 0, len);
+  ssize_t n = 0, r;
+  while (n < (ssize_t)len - 1 && (r = read(fds[0], msg + n, len - 1 - n)) > 0)
+    n += r;
+  close(fds[0]);
+  int status;
+  waitpid(pid, &status, 0);
+  return status;
+}
+
+void test_overflow(void) {
+  char msg[256];
+  int status = run_child(GTHREAD_STACK_DEFAULT, 100000, msg, sizeof(msg));
+  CHECK(WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT);
+  CHECK(strstr(msg, "overflowed its 1008 KB stack") != NULL);
+
+  // A smaller stack from the attributes reports its own size
+  status = run_child(64 * 1024, 100000, msg, sizeof(msg));
+  CHECK(WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT);
+  CHECK(strstr(msg, "overflowed its 48 KB stack") != NULL);
+  printf("overflow into the guard: ok (reported, aborted)\n");
+}
+
+void test_deep(void) {
+  // 900 frames of 1 KB fit in the 1008 KB above the guard
+  char msg[256];
+  int status = run_child(GTHREAD_STACK_DEFAULT, 900, msg, sizeof(msg));
+  CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  CHECK(msg[0] == 0);
+  printf("deep recursion within the stack: ok\n");
+}
+
+gsem_t release;
+int many_ran = 0;
+
+void parked(void *arg) {
+  (void)arg;
+  gsem_wait(&release);
+  __atomic_add_fetch(&many_ran, 1, __ATOMIC_RELAXED);
+}
+
+/* Stacks past the guard budget come without a guard rather than failing */
+void test_many(void) {
+  static gthread_t *t[MANY];
+  gsem_init(&release, 0);
+  int created = 0;
+  while (created < MANY && gthread_create(&t[created], parked, NULL) == 0)
+    created++;
+  CHECK(created == MANY);
+  for (int i = 0; i < created; i++)
+    gsem_post(&release);
+  for (int i = 0; i < created; i++)
+    gthread_join(t[i], NULL);
+  CHECK(many_ran == created);
+  printf("%d live threads: ok\n", created);
+}
+
+void run_tests(void *arg) {
+  (void)arg;
+  test_many();
+}
+
+int main(int argc, char **argv) {
+  test_overflow();
+  test_deep();
+
+  if (argc > 1)
+    gthread_set_workers(atoi(argv[1]));
+  gthread_init();
+
+  gthread_t *t;
+  gthread_create(&t, run_tests, NULL);
+  gthread_join(t, NULL);
+
+  printf(failures ? "FAILED (%d)\n" : "All guard tests passed\n", failures);
+  return failures ? 1 : 0;
+}
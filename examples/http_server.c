@@ -10,6 +10,7 @@
 
 #define PORT 8080
 #define BUFFER_SIZE 4096
+#define CLIENT_STACK_SIZE (64 * 1024) // Three buffers plus printf
 
 const char *response_template = "HTTP/1.1 200 OK\r\n"
                                 "Content-Type: text/plain\r\n"
@@ -70,12 +71,19 @@ void server_loop(void *arg) {
 
   printf("HTTP Server listening on port %d\n", PORT);
 
+  // Handlers are short-lived and never joined: small stacks, detached
+  gthread_attr_t attr;
+  gthread_attr_init(&attr);
+  attr.stack_size = CLIENT_STACK_SIZE;
+  attr.name = "HTTP-CLIENT";
+  attr.detached = 1;
+
   while (1) {
     int new_socket = gthread_accept(server_fd, NULL, NULL);
     if (new_socket >= 0) {
       // Spawn a new green thread for each connection
       gthread_t *t;
-      gthread_create(&t, handle_client, (void *)(long)new_socket);
+      gthread_create_ex(&t, &attr, handle_client, (void *)(long)new_socket);
     }
   }
 }
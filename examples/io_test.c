@@ -104,12 +104,17 @@ void server_task(void *arg) {
 
   printf("Chat Server listening on %d\n", PORT);
 
+  gthread_attr_t attr;
+  gthread_attr_init(&attr);
+  attr.detached = 1;
+
   while (1) {
     int new_socket = gthread_accept(server_fd, NULL, NULL);
     if (new_socket >= 0) {
-      // Spawn a handler for this client
+      // Spawn a handler for this client; reaped when it disconnects
       gthread_t *handler;
-      gthread_create(&handler, connection_handler, (void *)(long)new_socket);
+      gthread_create_ex(&handler, &attr, connection_handler,
+                        (void *)(long)new_socket);
     }
     gthread_yield();
   }
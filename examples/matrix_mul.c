@@ -83,14 +83,25 @@ int verify(void) {
   return 1;
 }
 
-int main(void) {
+static double now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+int main(int argc, char **argv) {
+  // Optional worker count for M:N mode (default: $GTHREAD_WORKERS or 1)
+  if (argc > 1)
+    gthread_set_workers(atoi(argv[1]));
   gthread_init();
   srand(time(NULL));
 
   printf("Initializing %dx%d matrices...\n", SIZE, SIZE);
   init_matrices();
 
-  printf("Spawning %d threads...\n", NUM_THREADS);
+  printf("Spawning %d threads on %d worker(s)...\n", NUM_THREADS,
+         gthread_get_workers());
+  double start = now_ms();
   gthread_t *threads[NUM_THREADS];
   int rows_per_thread = SIZE / NUM_THREADS;
 
@@ -107,7 +118,8 @@ int main(void) {
     gthread_join(threads[i], NULL);
   }
 
-  printf("Parallel computation done. Verifying...\n");
+  printf("Parallel computation done in %.1f ms. Verifying...\n",
+         now_ms() - start);
   serial_multiply();
 
   if (verify()) {
@@ -0,0 +1,147 @@
+#include "gthread.h"
+#include "scheduler.h"
+#include "sync.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Phase 19: M:N work-stealing scheduler. Usage: mn_test [workers], 4 by
+   default */
+
+#define MS 1000000ULL
+#define COUNTERS 8
+#define INCREMENTS 2000
+#define ITEMS 10000
+#define SLEEPERS 50
+
+static int failures = 0;
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);                   \
+      failures++;                                                              \
+    }                                                                          \
+  } while (0)
+
+int nworkers;
+int spinners_in = 0;
+int seen_worker[MAX_WORKERS];
+
+/* Never yields: checks in, then spins until every other spinner has too,
+   which only happens if each sits on a worker of its own */
+void spinner(void *arg) {
+  int *met = arg;
+  __atomic_store_n(&seen_worker[scheduler_worker()->id], 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&spinners_in, 1, __ATOMIC_ACQ_REL);
+  uint64_t give_up = gthread_now_ns() + 5000 * MS;
+  while (__atomic_load_n(&spinners_in, __ATOMIC_ACQUIRE) < nworkers)
+    if (gthread_now_ns() > give_up)
+      return;
+  *met = 1;
+}
+
+void test_parallel(void) {
+  // All created on this worker: the others have to steal them
+  gthread_t *t[MAX_WORKERS];
+  int met[MAX_WORKERS] = {0};
+  for (int i = 0; i < nworkers; i++)
+    gthread_create(&t[i], spinner, &met[i]);
+  int all_met = 1, workers_used = 0;
+  for (int i = 0; i < nworkers; i++) {
+    gthread_join(t[i], NULL);
+    all_met &= met[i];
+    workers_used += seen_worker[i];
+  }
+  CHECK(all_met);
+  CHECK(workers_used == nworkers);
+  printf("%d non-yielding threads running at once: ok\n", nworkers);
+}
+
+gmutex_t count_mutex;
+long count = 0;
+
+void incrementer(void *arg) {
+  (void)arg;
+  for (int i = 0; i < INCREMENTS; i++) {
+    gmutex_lock(&count_mutex);
+    count++;
+    gmutex_unlock(&count_mutex);
+    if (i % 100 == 0)
+      gthread_yield();
+  }
+}
+
+void test_mutex(void) {
+  gthread_t *t[COUNTERS];
+  gmutex_init(&count_mutex);
+  for (int i = 0; i < COUNTERS; i++)
+    gthread_create(&t[i], incrementer, NULL);
+  for (int i = 0; i < COUNTERS; i++)
+    gthread_join(t[i], NULL);
+  CHECK(count == (long)COUNTERS * INCREMENTS);
+  printf("gmutex across workers: ok (%ld)\n", count);
+}
+
+/* Wakeups land on whichever worker the waiter is queued to */
+gsem_t items, slots;
+long consumed_sum = 0;
+
+void consumer(void *arg) {
+  (void)arg;
+  for (long i = 1; i <= ITEMS; i++) {
+    gsem_wait(&items);
+    consumed_sum += i;
+    gsem_post(&slots);
+  }
+}
+
+int sleepers_woken = 0;
+
+void sleeper(void *arg) {
+  gthread_sleep((long)arg);
+  __atomic_add_fetch(&sleepers_woken, 1, __ATOMIC_RELAXED);
+}
+
+void test_wakeups(void) {
+  gthread_t *c, *s[SLEEPERS];
+  for (long i = 0; i < SLEEPERS; i++)
+    gthread_create(&s[i], sleeper, (void *)(1 + i % 5));
+
+  gsem_init(&items, 0);
+  gsem_init(&slots, 4);
+  gthread_create(&c, consumer, NULL);
+  for (int i = 0; i < ITEMS; i++) {
+    gsem_wait(&slots);
+    gsem_post(&items);
+  }
+  gthread_join(c, NULL);
+  CHECK(consumed_sum == (long)ITEMS * (ITEMS + 1) / 2);
+
+  for (int i = 0; i < SLEEPERS; i++)
+    gthread_join(s[i], NULL);
+  CHECK(sleepers_woken == SLEEPERS);
+  printf("cross-worker wakeups: ok\n");
+}
+
+void run_tests(void *arg) {
+  (void)arg;
+  test_parallel();
+  test_mutex();
+  test_wakeups();
+}
+
+int main(int argc, char **argv) {
+  nworkers = argc > 1 ? atoi(argv[1]) : 4;
+  if (nworkers < 1 || nworkers > MAX_WORKERS)
+    nworkers = 4;
+  gthread_set_workers(nworkers);
+  gthread_init();
+  CHECK(gthread_get_workers() == nworkers);
+
+  gthread_t *t;
+  gthread_create(&t, run_tests, NULL);
+  gthread_join(t, NULL);
+
+  printf(failures ? "FAILED (%d)\n" : "All M:N tests passed\n", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,218 @@
+#include "gthread.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* Phase 36: Scheduling policies. Each test runs once under the stride
+   heap and once under CFS, each in a child of its own since the policy is
+   fixed at gthread_init. Usage: policy_test [workers] */
+
+#define MS 1000000ULL
+#define HOGS 10
+#define EDF_YIELDS 100
+
+static int failures = 0;
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);                   \
+      failures++;                                                              \
+    }                                                                          \
+  } while (0)
+
+/* A starved thread shows up as a hang: fail instead */
+static void *watchdog(void *arg) {
+  (void)arg;
+  sleep(20);
+  printf("FAIL: hung\n");
+  fflush(stdout);
+  _exit(1);
+}
+
+static const char *policy_name = "stride";
+
+static void burn(int n) {
+  for (volatile int i = 0; i < n; i++)
+    ;
+}
+
+int order[8];
+int order_len = 0;
+
+void record(void *arg) {
+  order[__atomic_fetch_add(&order_len, 1, __ATOMIC_ACQ_REL)] = (int)(long)arg;
+}
+
+/* Deadline threads go before fair ones, earliest deadline first (on one
+   worker: others may steal them) */
+void test_edf_order(int workers) {
+  gthread_attr_t attr;
+  gthread_attr_init(&attr);
+  gthread_t *t[6];
+  gthread_create(&t[5], record, (void *)0L); // Fair, queued first
+  for (long i = 0; i < 5; i++) {
+    attr.deadline_ns = (5 - i) * MS;
+    gthread_create_ex(&t[i], &attr, record, (void *)(5 - i));
+  }
+  for (int i = 0; i < 6; i++)
+    gthread_join(t[i], NULL);
+  CHECK(order_len == 6);
+  if (workers == 1)
+    CHECK(!memcmp(order, (int[]){1, 2, 3, 4, 5, 0}, sizeof(int) * 6));
+  printf("%s: EDF order: ok\n", policy_name);
+}
+
+int hogging = 0;
+unsigned long hog_runs = 0;
+
+void hog(void *arg) {
+  (void)arg;
+  while (__atomic_load_n(&hogging, __ATOMIC_RELAXED)) {
+    burn(2000);
+    __atomic_add_fetch(&hog_runs, 1, __ATOMIC_RELAXED);
+    gthread_yield();
+  }
+}
+
+static void start_hogs(gthread_t **t) {
+  __atomic_store_n(&hogging, 1, __ATOMIC_RELAXED);
+  for (int i = 0; i < HOGS; i++)
+    gthread_create(&t[i], hog, NULL);
+  gthread_yield();
+}
+
+static void stop_hogs(gthread_t **t) {
+  __atomic_store_n(&hogging, 0, __ATOMIC_RELAXED);
+  for (int i = 0; i < HOGS; i++)
+    gthread_join(t[i], NULL);
+}
+
+/* With a deadline the caller keeps the CPU across yields; without one it
+   shares it again */
+void test_set_deadline(void) {
+  gthread_t *t[HOGS];
+  start_hogs(t);
+
+  gthread_set_deadline(gthread_now_ns() + MS);
+  gthread_yield(); // Applies from the next switch
+  unsigned long before = hog_runs;
+  for (int i = 0; i < EDF_YIELDS; i++)
+    gthread_yield();
+  unsigned long during = hog_runs - before;
+  gthread_set_deadline(0);
+  gthread_yield();
+  before = hog_runs;
+  for (int i = 0; i < EDF_YIELDS; i++)
+    gthread_yield();
+  unsigned long after = hog_runs - before;
+
+  stop_hogs(t);
+  CHECK(during == 0);
+  // How many: stride charges per pick, CFS by time, and these yields cost
+  // next to nothing
+  CHECK(after > 0);
+  printf("%s: gthread_set_deadline: ok\n", policy_name);
+}
+
+int counting = 0;
+unsigned long counts[2];
+
+void counter(void *arg) {
+  long i = (long)arg;
+  while (__atomic_load_n(&counting, __ATOMIC_RELAXED)) {
+    burn(2000);
+    counts[i]++;
+    gthread_yield();
+  }
+}
+
+/* Fair share follows tickets under both policies */
+void test_shares(void) {
+  gthread_attr_t attr;
+  gthread_attr_init(&attr);
+  gthread_t *t[2];
+  __atomic_store_n(&counting, 1, __ATOMIC_RELAXED);
+  attr.tickets = 10;
+  gthread_create_ex(&t[0], &attr, counter, (void *)0L);
+  attr.tickets = 30;
+  gthread_create_ex(&t[1], &attr, counter, (void *)1L);
+  gthread_sleep(100);
+  __atomic_store_n(&counting, 0, __ATOMIC_RELAXED);
+  gthread_join(t[0], NULL);
+  gthread_join(t[1], NULL);
+
+  double ratio = (double)counts[1] / (counts[0] ? counts[0] : 1);
+  CHECK(ratio > 2.0 && ratio < 4.5);
+  printf("%s: 30 vs 10 tickets: ok (%.2f)\n", policy_name, ratio);
+}
+
+/* A thread back from a sleep gets in ahead of the hogs */
+void test_wake_latency(void) {
+  gthread_t *t[HOGS];
+  start_hogs(t);
+  uint64_t worst = 0;
+  for (int i = 0; i < 20; i++) {
+    uint64_t deadline = gthread_now_ns() + MS;
+    gthread_sleep_until(deadline);
+    uint64_t late = gthread_now_ns() - deadline;
+    if (late > worst)
+      worst = late;
+  }
+  stop_hogs(t);
+  CHECK(worst < 5 * MS);
+  printf("%s: wakeup among %d hogs: ok (worst %lu us late)\n", policy_name,
+         HOGS, (unsigned long)worst / 1000);
+}
+
+void run_tests(void *arg) {
+  int workers = (int)(long)arg;
+  test_edf_order(workers);
+  if (workers != 1) { // Shares only show against each other on one worker
+    printf("%s: the rest is skipped on %d workers\n", policy_name, workers);
+    return;
+  }
+  test_set_deadline();
+  test_shares();
+  test_wake_latency();
+}
+
+static int run_policy(gthread_policy_t policy, int workers) {
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    exit(1);
+  }
+  if (pid == 0) {
+    pthread_t wd;
+    pthread_create(&wd, NULL, watchdog, NULL);
+    if (policy == GTHREAD_POLICY_CFS)
+      policy_name = "cfs";
+    gthread_set_policy(policy);
+    gthread_set_workers(workers);
+    gthread_init();
+
+    gthread_t *t;
+    gthread_create(&t, run_tests, (void *)(long)workers);
+    gthread_join(t, NULL);
+    fflush(stdout);
+    _exit(failures ? 1 : 0);
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+int main(int argc, char **argv) {
+  int workers = argc > 1 ? atoi(argv[1]) : 1;
+  unsetenv("GTHREAD_POLICY");
+  fflush(stdout);
+  int bad = !run_policy(GTHREAD_POLICY_STRIDE, workers);
+  bad += !run_policy(GTHREAD_POLICY_CFS, workers);
+
+  printf(bad ? "FAILED (%d)\n" : "All policy tests passed\n", bad);
+  return bad ? 1 : 0;
+}
@@ -0,0 +1,153 @@
+#include "gthread.h"
+#include "io.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* Phase 26: Preemptive time slicing. Sleepers and IO waiters must still be
+   woken while CPU-bound threads only ever get switched out by the timer.
+   Usage: preempt_test [workers] */
+
+#define MS 1000000ULL
+#define SPINNERS 3
+
+static int failures = 0;
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);                   \
+      failures++;                                                              \
+    }                                                                          \
+  } while (0)
+
+static uint64_t elapsed_ms(uint64_t start) {
+  return (gthread_now_ns() - start) / MS;
+}
+
+/* A lost wakeup shows up as a hang: fail instead */
+static void *watchdog(void *arg) {
+  (void)arg;
+  sleep(20);
+  printf("FAIL: hung\n");
+  fflush(stdout);
+  _exit(1);
+}
+
+int spinning = 0;
+volatile unsigned long spins[SPINNERS];
+
+/* Never yields or blocks: only preemption takes the CPU away */
+void spinner(void *arg) {
+  long i = (long)arg;
+  while (__atomic_load_n(&spinning, __ATOMIC_RELAXED))
+    spins[i]++;
+}
+
+static void start_spinners(gthread_t **t) {
+  __atomic_store_n(&spinning, 1, __ATOMIC_RELAXED);
+  for (long i = 0; i < SPINNERS; i++) {
+    spins[i] = 0;
+    gthread_create(&t[i], spinner, (void *)i);
+  }
+}
+
+static void stop_spinners(gthread_t **t) {
+  __atomic_store_n(&spinning, 0, __ATOMIC_RELAXED);
+  for (int i = 0; i < SPINNERS; i++)
+    gthread_join(t[i], NULL);
+}
+
+void test_sleep(void) {
+  gthread_t *t[SPINNERS];
+  start_spinners(t);
+
+  uint64_t start = gthread_now_ns();
+  gthread_sleep(50);
+  uint64_t ms = elapsed_ms(start);
+  CHECK(ms >= 50 && ms < 250);
+  // Every spinner got slices while we slept
+  for (int i = 0; i < SPINNERS; i++)
+    CHECK(spins[i] > 0);
+
+  stop_spinners(t);
+  printf("sleep under CPU-bound threads: ok (%lu ms for 50)\n",
+         (unsigned long)ms);
+}
+
+int pipe_fds[2];
+
+void late_writer(void *arg) {
+  gthread_sleep((long)arg);
+  if (gthread_write(pipe_fds[1], "x", 1) != 1)
+    perror("write");
+}
+
+void test_io(void) {
+  if (pipe(pipe_fds) < 0) {
+    perror("pipe");
+    exit(1);
+  }
+  gthread_t *t[SPINNERS], *w;
+  start_spinners(t);
+
+  gthread_create(&w, late_writer, (void *)20L);
+  uint64_t start = gthread_now_ns();
+  char c;
+  CHECK(gthread_read(pipe_fds[0], &c, 1) == 1 && c == 'x');
+  uint64_t ms = elapsed_ms(start);
+  CHECK(ms >= 20 && ms < 250);
+  gthread_join(w, NULL);
+
+  stop_spinners(t);
+  gthread_close(pipe_fds[0]);
+  gthread_close(pipe_fds[1]);
+  printf("IO wait under CPU-bound threads: ok (%lu ms for 20)\n",
+         (unsigned long)ms);
+}
+
+/* With preemption disabled nothing else gets this worker's CPU */
+void test_disable(void) {
+  gthread_t *t[SPINNERS];
+  start_spinners(t);
+  gthread_yield(); // Let them start
+
+  gthread_preempt_disable();
+  unsigned long before = spins[0] + spins[1] + spins[2];
+  uint64_t start = gthread_now_ns();
+  while (elapsed_ms(start) < 20)
+    ;
+  unsigned long after = spins[0] + spins[1] + spins[2];
+  gthread_preempt_enable();
+
+  CHECK(after == before);
+  stop_spinners(t);
+  printf("gthread_preempt_disable: ok\n");
+}
+
+void run_tests(void *arg) {
+  int workers = (int)(long)arg;
+  test_sleep();
+  test_io();
+  if (workers == 1) // Other workers keep spinning meanwhile
+    test_disable();
+}
+
+int main(int argc, char **argv) {
+  int workers = argc > 1 ? atoi(argv[1]) : 1;
+  pthread_t wd;
+  pthread_create(&wd, NULL, watchdog, NULL);
+
+  gthread_set_workers(workers);
+  gthread_set_preemption(1 * MS);
+  gthread_init();
+
+  gthread_t *t;
+  gthread_create(&t, run_tests, (void *)(long)workers);
+  gthread_join(t, NULL);
+
+  printf(failures ? "FAILED (%d)\n" : "All preemption tests passed\n",
+         failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,169 @@
+#include "gthread.h"
+#include "runtime_stats.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* Phase 37: CPU bandwidth quotas. Usage: quota_test [workers] */
+
+#define MS 1000000ULL
+#define MAX_POOLS 8
+
+static int failures = 0;
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);                   \
+      failures++;                                                              \
+    }                                                                          \
+  } while (0)
+
+/* A pool that never refills shows up as a hang: fail instead */
+static void *watchdog(void *arg) {
+  (void)arg;
+  sleep(20);
+  printf("FAIL: hung\n");
+  fflush(stdout);
+  _exit(1);
+}
+
+static void burn(int n) {
+  for (volatile int i = 0; i < n; i++)
+    ;
+}
+
+/* The stats of the pool called name, if it still exists */
+static int pool_stats(const char *name, quota_stats_t *out) {
+  quota_stats_t qs[MAX_POOLS];
+  int n = runtime_get_quota_stats(qs, MAX_POOLS);
+  for (int i = 0; i < n; i++) {
+    const char *a = qs[i].name, *b = name;
+    while (*a && *a == *b)
+      a++, b++;
+    if (*a == *b) {
+      *out = qs[i];
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int oversubscribed = 0;
+int running = 0;
+unsigned long work[4];
+
+void yielder(void *arg) {
+  long i = (long)arg;
+  while (__atomic_load_n(&running, __ATOMIC_RELAXED)) {
+    burn(2000);
+    work[i]++;
+    gthread_yield();
+  }
+}
+
+void napper(void *arg) {
+  long i = (long)arg;
+  while (__atomic_load_n(&running, __ATOMIC_RELAXED)) {
+    burn(200000);
+    work[i]++;
+    gthread_sleep_ns(100000);
+  }
+}
+
+/* Two 200-ticket threads in a 5% pool next to two free 10-ticket ones:
+   the pool holds them to 5% of wall time, whatever their tickets */
+static void run_capped(void (*fn)(void *), const char *name) {
+  gquota_t *q = gquota_create(name, 5 * MS, 100 * MS);
+  gthread_attr_t attr;
+  gthread_attr_init(&attr);
+  attr.quota = q;
+  attr.tickets = 200;
+  gthread_t *t[4];
+  work[0] = work[1] = work[2] = work[3] = 0;
+  __atomic_store_n(&running, 1, __ATOMIC_RELAXED);
+  uint64_t start = gthread_now_ns();
+  gthread_create_ex(&t[0], &attr, fn, (void *)0L);
+  gthread_create_ex(&t[1], &attr, fn, (void *)1L);
+  gthread_create(&t[2], yielder, (void *)2L);
+  gthread_create(&t[3], yielder, (void *)3L);
+  gquota_destroy(q); // Lives on while its threads are attached
+
+  gthread_sleep(500);
+  quota_stats_t s = {0};
+  CHECK(pool_stats(name, &s) && s.threads == 2);
+  double pct = 100.0 * s.total_ns / (gthread_now_ns() - start);
+  __atomic_store_n(&running, 0, __ATOMIC_RELAXED);
+  for (int i = 0; i < 4; i++)
+    gthread_join(t[i], NULL);
+
+  // One period of slack either way: 500 ms is only five of them. Runs are
+  // charged in wall time, so with more workers than CPUs the time the OS
+  // gives other workers mid-run is charged too.
+  CHECK(pct > 3.0 && pct < (oversubscribed ? 15.0 : 8.0));
+  CHECK(s.throttles > 0);
+  CHECK(work[0] && work[1] && work[2] && work[3]);
+
+  // Gone with its last thread, once that has been reaped
+  for (int i = 0; i < 100 && pool_stats(name, &s); i++)
+    gthread_sleep(1);
+  CHECK(!pool_stats(name, &s));
+  printf("5%% pool, %s: ok (%.1f%%)\n", name, pct);
+}
+
+void test_cap(void) {
+  run_capped(yielder, "yielding");
+  run_capped(napper, "sleeping");
+}
+
+/* gthread_set_quota caps the caller, and NULL releases it */
+void test_set_quota(void) {
+  gquota_t *q = gquota_create("self", 10 * MS, 50 * MS);
+  gthread_t *free_hog;
+  __atomic_store_n(&running, 1, __ATOMIC_RELAXED);
+  gthread_create(&free_hog, yielder, (void *)2L);
+
+  gthread_set_quota(q);
+  uint64_t start = gthread_now_ns();
+  while (gthread_now_ns() - start < 300 * MS) {
+    burn(2000);
+    gthread_yield();
+  }
+  quota_stats_t s = {0};
+  CHECK(pool_stats("self", &s) && s.threads == 1);
+  double pct = 100.0 * s.total_ns / (gthread_now_ns() - start);
+  gthread_set_quota(NULL);
+  CHECK(pool_stats("self", &s) && s.threads == 0);
+  gquota_destroy(q);
+  CHECK(!pool_stats("self", &s));
+
+  __atomic_store_n(&running, 0, __ATOMIC_RELAXED);
+  gthread_join(free_hog, NULL);
+  CHECK(pct > 12.0 && pct < (oversubscribed ? 45.0 : 32.0));
+  CHECK(gquota_create("bad", MS, 0) == NULL);
+  printf("gthread_set_quota on the caller: ok (%.1f%% for 20%%)\n", pct);
+}
+
+void run_tests(void *arg) {
+  (void)arg;
+  test_cap();
+  test_set_quota();
+}
+
+int main(int argc, char **argv) {
+  pthread_t wd;
+  pthread_create(&wd, NULL, watchdog, NULL);
+
+  int workers = argc > 1 ? atoi(argv[1]) : 1;
+  oversubscribed = workers > sysconf(_SC_NPROCESSORS_ONLN);
+  gthread_set_workers(workers);
+  gthread_init();
+
+  gthread_t *t;
+  gthread_create(&t, run_tests, NULL);
+  gthread_join(t, NULL);
+
+  printf(failures ? "FAILED (%d)\n" : "All quota tests passed\n", failures);
+  return failures ? 1 : 0;
+}
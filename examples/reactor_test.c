@@ -0,0 +1,166 @@
+#include "gthread.h"
+#include "io.h"
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Phase 21: epoll reactor. Runs with GTHREAD_IO=poll so reads and writes
+   wait on the reactor rather than io_uring. Usage: reactor_test [workers] */
+
+#define WAITERS 300 /* Past the old 128-entry poll array */
+#define BULK (4 << 20)
+
+static int failures = 0;
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);                   \
+      failures++;                                                              \
+    }                                                                          \
+  } while (0)
+
+/* A lost wakeup shows up as a hang: fail instead */
+static void *watchdog(void *arg) {
+  (void)arg;
+  sleep(20);
+  printf("FAIL: hung\n");
+  fflush(stdout);
+  _exit(1);
+}
+
+static void make_pipe(int *fds) {
+  if (pipe(fds) < 0) {
+    perror("pipe");
+    exit(1);
+  }
+}
+
+void late_writer(void *arg) {
+  gthread_sleep(5);
+  if (write((int)(long)arg, "x", 1) != 1)
+    perror("write");
+}
+
+/* Waits on fds[0] until a byte arrives 5 ms later */
+static int wait_and_read(int *fds, int use_wait_io) {
+  gthread_t *t;
+  gthread_create(&t, late_writer, (void *)(long)fds[1]);
+  char c = 0;
+  if (use_wait_io)
+    gthread_wait_io(fds[0], POLLIN);
+  int n = gthread_read(fds[0], &c, 1);
+  gthread_join(t, NULL);
+  return n == 1 && c == 'x';
+}
+
+/* An fd closed with plain close() leaves the epoll set; the next file to
+   get its number must still be waited on properly */
+void test_fd_reuse(void) {
+  int a[2], b[2];
+  make_pipe(a);
+  CHECK(wait_and_read(a, 0));
+  close(a[0]);
+  close(a[1]);
+
+  make_pipe(b);
+  CHECK(b[0] == a[0] || b[1] == a[0]); // Same numbers, new files
+  CHECK(wait_and_read(b, 0));
+  close(b[0]);
+  close(b[1]);
+
+  make_pipe(b);
+  CHECK(wait_and_read(b, 1));
+  close(b[0]);
+  close(b[1]);
+  printf("fd reuse after close(): ok\n");
+}
+
+int waiter_pipes[WAITERS][2];
+int waiters_done = 0;
+
+void pipe_waiter(void *arg) {
+  long i = (long)arg;
+  char c;
+  if (gthread_read(waiter_pipes[i][0], &c, 1) == 1)
+    __atomic_add_fetch(&waiters_done, 1, __ATOMIC_RELAXED);
+}
+
+void test_many_waiters(void) {
+  gthread_t *t[WAITERS];
+  for (long i = 0; i < WAITERS; i++) {
+    make_pipe(waiter_pipes[i]);
+    gthread_create(&t[i], pipe_waiter, (void *)i);
+  }
+  gthread_sleep(10); // All parked
+  CHECK(waiters_done == 0);
+  for (int i = 0; i < WAITERS; i++)
+    CHECK(write(waiter_pipes[i][1], "x", 1) == 1);
+  for (int i = 0; i < WAITERS; i++) {
+    gthread_join(t[i], NULL);
+    gthread_close(waiter_pipes[i][0]);
+    gthread_close(waiter_pipes[i][1]);
+  }
+  CHECK(waiters_done == WAITERS);
+  printf("%d threads parked on fds: ok\n", WAITERS);
+}
+
+/* The writer outruns the reader: gthread_write waits for room */
+int bulk[2];
+long bulk_read = 0;
+
+void bulk_reader(void *arg) {
+  (void)arg;
+  static char buf[4096];
+  ssize_t n;
+  while ((n = gthread_read(bulk[0], buf, sizeof(buf))) > 0)
+    bulk_read += n;
+}
+
+void test_write_backpressure(void) {
+  make_pipe(bulk);
+  gthread_t *t;
+  gthread_create(&t, bulk_reader, NULL);
+
+  static char buf[65536];
+  memset(buf, 'x', sizeof(buf));
+  long sent = 0;
+  while (sent < BULK) {
+    ssize_t n = gthread_write(bulk[1], buf, sizeof(buf));
+    if (n <= 0)
+      break;
+    sent += n;
+  }
+  close(bulk[1]);
+  gthread_join(t, NULL);
+  close(bulk[0]);
+  CHECK(sent == BULK && bulk_read == BULK);
+  printf("gthread_write with a full pipe: ok\n");
+}
+
+void run_tests(void *arg) {
+  (void)arg;
+  test_fd_reuse();
+  test_many_waiters();
+  test_write_backpressure();
+}
+
+int main(int argc, char **argv) {
+  pthread_t wd;
+  pthread_create(&wd, NULL, watchdog, NULL);
+
+  setenv("GTHREAD_IO", "poll", 1);
+  if (argc > 1)
+    gthread_set_workers(atoi(argv[1]));
+  gthread_init();
+
+  gthread_t *t;
+  gthread_create(&t, run_tests, NULL);
+  gthread_join(t, NULL);
+
+  printf(failures ? "FAILED (%d)\n" : "All reactor tests passed\n", failures);
+  return failures ? 1 : 0;
+}
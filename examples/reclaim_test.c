@@ -0,0 +1,149 @@
+#include "gthread.h"
+#include "runtime_stats.h"
+#include "sync.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Phase 31: Idle stack reclaim, with a 20 ms threshold. Usage:
+   reclaim_test [workers] */
+
+#define MS 1000000ULL
+#define FRAME 1024
+#define DEEPERS 50
+#define DEEP_FRAMES 200 /* ~200 KB */
+#define KEEPER_FRAMES 100
+
+static int failures = 0;
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);                   \
+      failures++;                                                              \
+    }                                                                          \
+  } while (0)
+
+static long rss_kb(void) {
+  long pages = 0, resident = 0;
+  FILE *f = fopen("/proc/self/statm", "r");
+  if (f) {
+    if (fscanf(f, "%ld %ld", &pages, &resident) != 2)
+      resident = 0;
+    fclose(f);
+  }
+  return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+gsem_t release;
+gsem_t parked;
+
+/* Touches `frames` KB of stack, checking each frame on the way back up. At
+   the bottom, blocks if asked to. */
+__attribute__((noinline)) static int descend(int frames, int block) {
+  volatile char frame[FRAME];
+  memset((char *)frame, frames, sizeof(frame));
+  int ok = 1;
+  if (frames > 0) {
+    ok = descend(frames - 1, block);
+  } else if (block) {
+    gsem_post(&parked);
+    gsem_wait(&release);
+  }
+  for (int i = 0; i < FRAME; i++)
+    ok &= frame[i] == (char)frames;
+  return ok;
+}
+
+int deepers_ok = 0;
+
+/* Goes deep, comes back, then blocks shallow: the pages below are idle */
+void deeper(void *arg) {
+  (void)arg;
+  int ok = descend(DEEP_FRAMES, 0);
+  gsem_post(&parked);
+  gsem_wait(&release);
+  ok &= descend(DEEP_FRAMES, 0); // Fresh zero pages where it reclaimed
+  if (ok)
+    __atomic_add_fetch(&deepers_ok, 1, __ATOMIC_RELAXED);
+}
+
+int keeper_ok = 0;
+
+/* Blocks at the bottom: everything above its sp is live */
+void keeper(void *arg) {
+  (void)arg;
+  keeper_ok = descend(KEEPER_FRAMES, 1);
+}
+
+/* Never blocked long enough to lose anything */
+int ticking = 1;
+
+void ticker(void *arg) {
+  (void)arg;
+  descend(DEEP_FRAMES, 0);
+  while (__atomic_load_n(&ticking, __ATOMIC_RELAXED))
+    gthread_sleep(2);
+}
+
+void test_reclaim(void) {
+  gthread_t *d[DEEPERS], *k, *tk;
+  gsem_init(&release, 0);
+  gsem_init(&parked, 0);
+  long before = rss_kb();
+  runtime_metrics_t m0 = runtime_get_metrics();
+  for (int i = 0; i < DEEPERS; i++)
+    gthread_create(&d[i], deeper, NULL);
+  gthread_create(&k, keeper, NULL);
+  gthread_create(&tk, ticker, NULL);
+  for (int i = 0; i < DEEPERS + 1; i++)
+    gsem_wait(&parked);
+  long deep = rss_kb(); // Some may be reclaimed already
+
+  gthread_sleep(100); // Several thresholds
+  long after = rss_kb();
+  runtime_metrics_t m1 = runtime_get_metrics();
+  unsigned long reclaimed =
+      m1.stack_bytes_reclaimed - m0.stack_bytes_reclaimed;
+  CHECK(reclaimed >= DEEPERS * (DEEP_FRAMES - 20) * (unsigned long)FRAME);
+  // What stays is a few pages per thread, not their 200 KB
+  CHECK(after - before < DEEPERS * 40);
+
+  stack_stats_t s = runtime_get_stack_stats(d[0]->id);
+  CHECK(s.stack_high_water >= DEEP_FRAMES * FRAME && s.stack_reclaimed > 0);
+  s = runtime_get_stack_stats(tk->id);
+  CHECK(s.stack_reclaimed == 0);
+
+  for (int i = 0; i < DEEPERS + 1; i++)
+    gsem_post(&release);
+  for (int i = 0; i < DEEPERS; i++)
+    gthread_join(d[i], NULL);
+  gthread_join(k, NULL);
+  __atomic_store_n(&ticking, 0, __ATOMIC_RELAXED);
+  gthread_join(tk, NULL);
+  CHECK(deepers_ok == DEEPERS && keeper_ok);
+  printf("idle stacks reclaimed: ok (%ld -> %ld -> %ld KB, %lu KB given "
+         "back)\n",
+         before, deep, after, reclaimed / 1024);
+}
+
+void run_tests(void *arg) {
+  (void)arg;
+  test_reclaim();
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1)
+    gthread_set_workers(atoi(argv[1]));
+  gthread_set_stack_reclaim(20 * MS);
+  gthread_init();
+
+  gthread_t *t;
+  gthread_create(&t, run_tests, NULL);
+  gthread_join(t, NULL);
+
+  printf(failures ? "FAILED (%d)\n" : "All stack reclaim tests passed\n",
+         failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,167 @@
+#include "gthread.h"
+#include "registry.h"
+#include "runtime_stats.h"
+#include "sync.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Phase 33: Thread registry and reaping. Usage: registry_test [workers] */
+
+#define LIVE 50
+#define CHURN_ROUNDS 200
+#define CHURN_BATCH 100
+#define SLOT_MASK ((1ULL << REGISTRY_SLOT_BITS) - 1)
+
+static int failures = 0;
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);                   \
+      failures++;                                                              \
+    }                                                                          \
+  } while (0)
+
+static void count_thread(gthread_t *t, void *arg) {
+  (void)t;
+  (*(int *)arg)++;
+}
+
+static int live_threads(void) {
+  int n = 0;
+  gthread_for_each(count_thread, &n);
+  return n;
+}
+
+static int registered(uint64_t id) {
+  registry_lock();
+  int found = registry_find(id) != NULL;
+  registry_unlock();
+  return found;
+}
+
+gsem_t release;
+uint64_t self_ids[LIVE];
+
+void blocker(void *arg) {
+  self_ids[(long)arg] = gthread_self_id();
+  gsem_wait(&release);
+}
+
+/* Every live thread can be found by id and is visited once */
+void test_lookup(void) {
+  gthread_t *t[LIVE];
+  int base = live_threads();
+  gsem_init(&release, 0);
+  for (long i = 0; i < LIVE; i++)
+    gthread_create(&t[i], blocker, (void *)i);
+  gthread_sleep(5);
+
+  CHECK(live_threads() == base + LIVE);
+  int found = 0, ids_match = 0;
+  registry_lock();
+  for (int i = 0; i < LIVE; i++) {
+    found += registry_find(t[i]->id) == t[i];
+    ids_match += self_ids[i] == t[i]->id;
+  }
+  registry_unlock();
+  CHECK(found == LIVE && ids_match == LIVE);
+  CHECK(runtime_get_tickets(t[0]->id) == GTHREAD_TICKETS_DEFAULT);
+
+  uint64_t ids[LIVE];
+  for (int i = 0; i < LIVE; i++) {
+    ids[i] = t[i]->id;
+    gsem_post(&release);
+  }
+  for (int i = 0; i < LIVE; i++)
+    gthread_join(t[i], NULL);
+
+  // Joined: reaped, and their ids miss
+  int stale = 0;
+  for (int i = 0; i < LIVE; i++)
+    stale += registered(ids[i]);
+  CHECK(stale == 0);
+  CHECK(runtime_get_tickets(ids[0]) == 0);
+  CHECK(live_threads() == base);
+  printf("lookup by id: ok\n");
+}
+
+void nothing(void *arg) { (void)arg; }
+
+/* A reused slot gets a new generation: the old id does not find the new
+   occupant */
+void test_reuse(void) {
+  gthread_t *t;
+  gthread_create(&t, nothing, NULL);
+  uint64_t old = t->id;
+  gthread_join(t, NULL);
+
+  gthread_create(&t, nothing, NULL);
+  CHECK((t->id & SLOT_MASK) == (old & SLOT_MASK));
+  CHECK(t->id != old);
+  CHECK(!registered(old) && registered(t->id));
+  gthread_join(t, NULL);
+  printf("slot reuse with a new generation: ok\n");
+}
+
+int detached_done = 0;
+uint64_t max_slot = 0;
+
+/* Its handle may be reaped by the time gthread_create_ex returns: the
+   thread reads its own id */
+void detached(void *arg) {
+  (void)arg;
+  uint64_t slot = gthread_self_id() & SLOT_MASK;
+  uint64_t max = __atomic_load_n(&max_slot, __ATOMIC_RELAXED);
+  while (slot > max && !__atomic_compare_exchange_n(&max_slot, &max, slot, 0,
+                                                    __ATOMIC_RELAXED,
+                                                    __ATOMIC_RELAXED))
+    ;
+  __atomic_add_fetch(&detached_done, 1, __ATOMIC_RELAXED);
+}
+
+/* Detached threads reap themselves; the table stays as big as the most
+   threads alive at once */
+void test_churn(void) {
+  int base = live_threads();
+  gthread_attr_t attr;
+  gthread_attr_init(&attr);
+  attr.detached = 1;
+  for (int r = 0; r < CHURN_ROUNDS; r++) {
+    for (int i = 0; i < CHURN_BATCH; i++) {
+      gthread_t *t;
+      gthread_create_ex(&t, &attr, detached, NULL);
+    }
+    while (__atomic_load_n(&detached_done, __ATOMIC_RELAXED) <
+           (r + 1) * CHURN_BATCH)
+      gthread_yield();
+  }
+  // The last ones may still be switching off their stacks
+  for (int i = 0; i < 100 && live_threads() != base; i++)
+    gthread_sleep(1);
+  CHECK(live_threads() == base);
+  CHECK(max_slot < 4 * CHURN_BATCH);
+  printf("%d detached threads reaped: ok (highest slot %lu)\n",
+         CHURN_ROUNDS * CHURN_BATCH, (unsigned long)max_slot);
+}
+
+void run_tests(void *arg) {
+  (void)arg;
+  test_lookup();
+  test_reuse();
+  test_churn();
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1)
+    gthread_set_workers(atoi(argv[1]));
+  gthread_init();
+
+  gthread_t *t;
+  gthread_create(&t, run_tests, NULL);
+  gthread_join(t, NULL);
+
+  printf(failures ? "FAILED (%d)\n" : "All registry tests passed\n",
+         failures);
+  return failures ? 1 : 0;
+}
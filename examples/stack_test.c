@@ -30,13 +30,14 @@ int main(void) {
   gthread_init();
 
   int depth;
-  printf("Enter recursion depth (1-60): ");
+  printf("Enter recursion depth (1-1000): ");
   if (scanf("%d", &depth) != 1)
     depth = 20;
   if (depth < 1)
     depth = 1;
-  if (depth > 60) {
-    printf("Warning: Depth > 60 might overflow 64KB stack.\n");
+  if (depth > 1000) {
+    // Stacks reserve 1MB; running into the guard page aborts with a report
+    printf("Warning: Depth > 1000 will overflow the 1MB stack.\n");
   }
 
   gthread_t *t;
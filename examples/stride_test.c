@@ -54,12 +54,16 @@ int main(void) {
     args->id = i + 1;
     args->iterations = iterations;
 
-    gthread_t *t;
-    gthread_create(&t, thread_func, (void *)args);
+    // Tickets must be set at creation: the thread is queued right away
+    char name[16];
+    snprintf(name, sizeof(name), "T%d", i + 1);
+    gthread_attr_t attr;
+    gthread_attr_init(&attr);
+    attr.tickets = tickets;
+    attr.name = name;
 
-    if (t) {
-      t->tickets = tickets;
-      t->stride = 10000 / tickets;
+    gthread_t *t;
+    if (gthread_create_ex(&t, &attr, thread_func, (void *)args) == 0) {
       printf("Created T%d with %d tickets (Stride: %lu)\n", i + 1, tickets,
              t->stride);
     }
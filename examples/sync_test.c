@@ -0,0 +1,278 @@
+#include "gthread.h"
+#include "sync.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* Phase 42: Handoff primitives. Usage: sync_test [workers] */
+
+#define READERS 3
+#define SEM_WAITERS 5
+#define PARTIES 5
+#define ROUNDS 200
+#define WG_WORKERS 8
+
+static int failures = 0;
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);                   \
+      failures++;                                                              \
+    }                                                                          \
+  } while (0)
+
+/* Sleep until n threads are parked on q */
+static void wait_queued(gwaitq_t *q, gspinlock_t *guard, int n) {
+  for (;;) {
+    int queued = 0;
+    gspin_lock(guard);
+    for (gthread_t *t = q->head; t; t = t->next)
+      queued++;
+    gspin_unlock(guard);
+    if (queued >= n)
+      return;
+    gthread_sleep(1);
+  }
+}
+
+/* Who got in, in order: 'W' first writer, 'R' reader, 'w' second writer */
+char order[16];
+int order_len = 0;
+
+static void log_entry(char c) {
+  order[__atomic_fetch_add(&order_len, 1, __ATOMIC_ACQ_REL)] = c;
+}
+
+grwlock_t rw;
+int readers_in = 0;
+int readers_max = 0;
+
+void first_writer(void *arg) {
+  (void)arg;
+  grwlock_wrlock(&rw);
+  log_entry('W');
+  gthread_sleep(2);
+  grwlock_unlock(&rw);
+
+  // The unlock admitted the queued readers as one batch, ahead of the
+  // writer that queued after them: they hold the lock before they even run
+  gspin_lock(&rw.guard);
+  CHECK(rw.readers == READERS && !rw.writer && !rw.read_queue.head);
+  CHECK(rw.write_queue.head != NULL);
+  gspin_unlock(&rw.guard);
+}
+
+void second_writer(void *arg) {
+  (void)arg;
+  grwlock_wrlock(&rw);
+  log_entry('w');
+  CHECK(__atomic_load_n(&readers_in, __ATOMIC_ACQUIRE) == 0);
+  grwlock_unlock(&rw);
+}
+
+void reader(void *arg) {
+  (void)arg;
+  grwlock_rdlock(&rw);
+  log_entry('R');
+  int in = __atomic_add_fetch(&readers_in, 1, __ATOMIC_ACQ_REL);
+  int max = __atomic_load_n(&readers_max, __ATOMIC_RELAXED);
+  while (in > max && !__atomic_compare_exchange_n(&readers_max, &max, in, 0,
+                                                  __ATOMIC_RELAXED,
+                                                  __ATOMIC_RELAXED))
+    ;
+  gthread_sleep(5); // Long enough for the whole batch to be in at once
+  __atomic_sub_fetch(&readers_in, 1, __ATOMIC_ACQ_REL);
+  grwlock_unlock(&rw);
+}
+
+void test_rwlock(void) {
+  gthread_t *w1, *w2, *r[READERS];
+  grwlock_init(&rw);
+
+  // A read holder keeps the first writer waiting
+  grwlock_rdlock(&rw);
+  gthread_create(&w1, first_writer, NULL);
+  wait_queued(&rw.write_queue, &rw.guard, 1);
+
+  // Writer preference: with a writer waiting, new readers queue too
+  CHECK(grwlock_tryrdlock(&rw) == -1);
+  for (int i = 0; i < READERS; i++)
+    gthread_create(&r[i], reader, NULL);
+  wait_queued(&rw.read_queue, &rw.guard, READERS);
+  gthread_create(&w2, second_writer, NULL);
+  wait_queued(&rw.write_queue, &rw.guard, 2);
+  CHECK(order_len == 0);
+
+  // Last reader out hands over to the first writer
+  grwlock_unlock(&rw);
+  gthread_join(w1, NULL);
+  for (int i = 0; i < READERS; i++)
+    gthread_join(r[i], NULL);
+  gthread_join(w2, NULL);
+
+  CHECK(order_len == READERS + 2 && !memcmp(order, "WRRRw", order_len));
+  CHECK(readers_max == READERS);
+  CHECK(!rw.readers && !rw.writer);
+  printf("grwlock: ok (%.*s)\n", order_len, order);
+}
+
+gsem_t sem;
+int sem_woken[SEM_WAITERS];
+
+void sem_waiter(void *arg) {
+  gsem_wait(&sem);
+  __atomic_store_n(&sem_woken[(long)arg], 1, __ATOMIC_RELEASE);
+}
+
+void test_sem(void) {
+  gthread_t *t[SEM_WAITERS];
+  gsem_init(&sem, 0);
+  for (long i = 0; i < SEM_WAITERS; i++) {
+    gthread_create(&t[i], sem_waiter, (void *)i);
+    wait_queued(&sem.wait_queue, &sem.guard, i + 1);
+  }
+
+  for (int i = 0; i < SEM_WAITERS; i++) {
+    gsem_post(&sem);
+    // The permit went to the first waiter, not to the count
+    CHECK(gsem_trywait(&sem) == -1);
+    gthread_join(t[i], NULL);
+    for (int j = 0; j < SEM_WAITERS; j++)
+      CHECK(sem_woken[j] == (j <= i));
+  }
+
+  gsem_post(&sem);
+  CHECK(sem.count == 1 && gsem_trywait(&sem) == 0);
+  printf("gsem: ok\n");
+}
+
+gbarrier_t barrier;
+int arrivals[ROUNDS];
+int completed[ROUNDS];
+
+void barrier_party(void *arg) {
+  (void)arg;
+  // No pause between rounds: the barrier is reused the moment it opens
+  for (int i = 0; i < ROUNDS; i++) {
+    __atomic_add_fetch(&arrivals[i], 1, __ATOMIC_ACQ_REL);
+    if (gbarrier_wait(&barrier))
+      __atomic_add_fetch(&completed[i], 1, __ATOMIC_ACQ_REL);
+    // Nobody gets through before everyone has arrived
+    CHECK(__atomic_load_n(&arrivals[i], __ATOMIC_ACQUIRE) == PARTIES);
+  }
+}
+
+void test_barrier(void) {
+  gthread_t *t[PARTIES];
+  gbarrier_init(&barrier, PARTIES);
+  for (int i = 0; i < PARTIES; i++)
+    gthread_create(&t[i], barrier_party, NULL);
+  for (int i = 0; i < PARTIES; i++)
+    gthread_join(t[i], NULL);
+
+  // Exactly one thread completed each round
+  int bad = 0;
+  for (int i = 0; i < ROUNDS; i++)
+    bad += completed[i] != 1;
+  CHECK(bad == 0);
+  CHECK(barrier.arrived == 0 && !barrier.wait_queue.head);
+  printf("gbarrier: ok (%d rounds)\n", ROUNDS);
+}
+
+gwaitgroup_t wg;
+int wg_finished = 0;
+
+void wg_worker(void *arg) {
+  gthread_sleep((long)arg);
+  __atomic_add_fetch(&wg_finished, 1, __ATOMIC_ACQ_REL);
+  gwaitgroup_done(&wg);
+}
+
+void wg_waiter(void *arg) {
+  (void)arg;
+  gwaitgroup_wait(&wg);
+  CHECK(__atomic_load_n(&wg_finished, __ATOMIC_ACQUIRE) == WG_WORKERS);
+}
+
+void test_waitgroup(void) {
+  gthread_t *workers[WG_WORKERS], *waiters[2];
+  gwaitgroup_init(&wg);
+  gwaitgroup_add(&wg, WG_WORKERS);
+  for (int i = 0; i < 2; i++)
+    gthread_create(&waiters[i], wg_waiter, NULL);
+  for (long i = 0; i < WG_WORKERS; i++)
+    gthread_create(&workers[i], wg_worker, (void *)(i % 3));
+  gwaitgroup_wait(&wg);
+  CHECK(wg_finished == WG_WORKERS);
+  for (int i = 0; i < 2; i++)
+    gthread_join(waiters[i], NULL);
+  for (int i = 0; i < WG_WORKERS; i++)
+    gthread_join(workers[i], NULL);
+
+  // Already at 0: returns at once
+  gwaitgroup_wait(&wg);
+  printf("gwaitgroup: ok\n");
+}
+
+/* A negative count is fatal. Checked in a child, before the runtime (and
+   its worker threads) exists, so the fork is safe. */
+void test_waitgroup_negative(void) {
+  int fds[2];
+  if (pipe(fds) < 0) {
+    perror("pipe");
+    exit(1);
+  }
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    exit(1);
+  }
+  if (pid == 0) {
+    dup2(fds[1], STDERR_FILENO);
+    gwaitgroup_t bad;
+    gwaitgroup_init(&bad);
+    gwaitgroup_add(&bad, 1);
+    gwaitgroup_done(&bad);
+    gwaitgroup_done(&bad);
+    _exit(0); // Not reached
+  }
+
+  close(fds[1]);
+  char msg[128] = {0};
+  ssize_t n = 0, r;
+  while (n < (ssize_t)sizeof(msg) - 1 &&
+         (r = read(fds[0], msg + n, sizeof(msg) - 1 - n)) > 0)
+    n += r;
+  close(fds[0]);
+  int status;
+  waitpid(pid, &status, 0);
+  CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 1);
+  CHECK(strstr(msg, "WaitGroup: Negative counter") != NULL);
+  printf("gwaitgroup negative count: ok (fatal)\n");
+}
+
+void run_tests(void *arg) {
+  (void)arg;
+  test_rwlock();
+  test_sem();
+  test_barrier();
+  test_waitgroup();
+}
+
+int main(int argc, char **argv) {
+  test_waitgroup_negative();
+
+  if (argc > 1)
+    gthread_set_workers(atoi(argv[1]));
+  gthread_init();
+
+  gthread_t *t;
+  gthread_create(&t, run_tests, NULL);
+  gthread_join(t, NULL);
+
+  printf(failures ? "FAILED (%d)\n" : "All sync tests passed\n", failures);
+  return failures ? 1 : 0;
+}
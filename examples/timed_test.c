@@ -0,0 +1,246 @@
+#include "gthread.h"
+#include "io.h"
+#include "scheduler.h"
+#include "sync.h"
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/* Phase 41: Timed waits. Usage: timed_test [workers] */
+
+#define MS 1000000ULL
+#define RACERS 8
+#define RACE_ROUNDS 2000
+
+static int failures = 0;
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);                   \
+      failures++;                                                              \
+    }                                                                          \
+  } while (0)
+
+/* errno belongs to the worker: read it out of line, after a call that may
+   have moved this thread to another one */
+__attribute__((noinline)) static int last_errno(void) { return errno; }
+
+static uint64_t elapsed_ms(uint64_t start) {
+  return (gthread_now_ns() - start) / MS;
+}
+
+gmutex_t mutex;
+gcond_t cond;
+int flag = 0;
+
+void holder(void *arg) {
+  gmutex_lock(&mutex);
+  gthread_sleep((long)arg);
+  gmutex_unlock(&mutex);
+}
+
+void signaller(void *arg) {
+  gthread_sleep((long)arg);
+  gmutex_lock(&mutex);
+  flag = 1;
+  gcond_signal(&cond);
+  gmutex_unlock(&mutex);
+}
+
+void test_mutex(void) {
+  // Free, with a deadline already past: just a trylock
+  CHECK(gmutex_timedlock(&mutex, 0) == 0);
+  gmutex_unlock(&mutex);
+
+  gthread_t *t;
+  gthread_create(&t, holder, (void *)50L);
+  gthread_yield(); // Let it take the lock
+
+  // Held, with a deadline already past: fails at once
+  uint64_t start = gthread_now_ns();
+  CHECK(gmutex_timedlock(&mutex, start - MS) == -1);
+  CHECK(elapsed_ms(start) < 5);
+
+  // Held past the deadline: times out on time
+  start = gthread_now_ns();
+  CHECK(gmutex_timedlock(&mutex, start + 10 * MS) == -1);
+  uint64_t ms = elapsed_ms(start);
+  CHECK(ms >= 10 && ms < 40);
+
+  // Released before the deadline: taken
+  CHECK(gmutex_timedlock(&mutex, gthread_now_ns() + 500 * MS) == 0);
+  gmutex_unlock(&mutex);
+  gthread_join(t, NULL);
+  printf("gmutex_timedlock: ok\n");
+}
+
+void test_cond(void) {
+  gmutex_lock(&mutex);
+
+  // Deadline already past: back at once, holding the mutex
+  uint64_t start = gthread_now_ns();
+  CHECK(gcond_timedwait(&cond, &mutex, start - MS) == -1);
+  CHECK(mutex.owner == g_current_thread);
+
+  // Nobody signals: times out on time, holding the mutex
+  start = gthread_now_ns();
+  CHECK(gcond_timedwait(&cond, &mutex, start + 10 * MS) == -1);
+  uint64_t ms = elapsed_ms(start);
+  CHECK(ms >= 10 && ms < 40);
+  CHECK(mutex.owner == g_current_thread);
+
+  // Signalled well before the deadline: woken, not timed out
+  gthread_t *t;
+  flag = 0;
+  gthread_create(&t, signaller, (void *)2L);
+  start = gthread_now_ns();
+  int ret = 0;
+  while (!flag && ret == 0)
+    ret = gcond_timedwait(&cond, &mutex, start + 100 * MS);
+  CHECK(ret == 0 && flag);
+  CHECK(mutex.owner == g_current_thread);
+  gmutex_unlock(&mutex);
+  gthread_join(t, NULL);
+  printf("gcond_timedwait: ok\n");
+}
+
+/* Timed waiters whose deadlines fall right on a stream of broadcasts and
+   signals: each wait must end exactly once, by one or the other, and the
+   queues must survive it */
+gmutex_t race_mutex;
+gcond_t race_cond;
+int racing = 1;
+long race_wakeups = 0;
+long race_timeouts = 0;
+
+void race_waiter(void *arg) {
+  (void)arg;
+  for (int i = 0; i < RACE_ROUNDS; i++) {
+    gmutex_lock(&race_mutex);
+    uint64_t deadline = gthread_now_ns() + (i % 4) * 10000;
+    if (gcond_timedwait(&race_cond, &race_mutex, deadline) == 0)
+      race_wakeups++;
+    else
+      race_timeouts++;
+    CHECK(race_mutex.owner == g_current_thread);
+    gmutex_unlock(&race_mutex);
+
+    // Untimed waiters queued behind timed ones must not be lost either
+    if (i % 50 == 0) {
+      gmutex_lock(&race_mutex);
+      gcond_wait(&race_cond, &race_mutex);
+      gmutex_unlock(&race_mutex);
+    }
+  }
+}
+
+void race_waker(void *arg) {
+  (void)arg;
+  for (int i = 0; __atomic_load_n(&racing, __ATOMIC_ACQUIRE); i++) {
+    gmutex_lock(&race_mutex);
+    if (i % 3)
+      gcond_broadcast(&race_cond);
+    else
+      gcond_signal(&race_cond);
+    gmutex_unlock(&race_mutex);
+    gthread_yield();
+  }
+}
+
+void test_race(void) {
+  gthread_t *waiters[RACERS], *waker;
+  gthread_create(&waker, race_waker, NULL);
+  for (int i = 0; i < RACERS; i++)
+    gthread_create(&waiters[i], race_waiter, NULL);
+  for (int i = 0; i < RACERS; i++)
+    gthread_join(waiters[i], NULL);
+  __atomic_store_n(&racing, 0, __ATOMIC_RELEASE);
+  gthread_join(waker, NULL);
+
+  CHECK(race_wakeups + race_timeouts == (long)RACERS * RACE_ROUNDS);
+  CHECK(race_cond.nr_timed == 0);
+  CHECK(!race_cond.wait_queue.head && !race_mutex.wait_queue.head);
+  printf("timedwait vs broadcast: ok (%ld woken, %ld timed out)\n",
+         race_wakeups, race_timeouts);
+}
+
+int pipe_fds[2];
+
+void pipe_writer(void *arg) {
+  gthread_sleep((long)arg);
+  if (write(pipe_fds[1], "x", 1) != 1)
+    perror("write");
+}
+
+void test_io(void) {
+  char c;
+  if (pipe(pipe_fds) < 0) {
+    perror("pipe");
+    exit(1);
+  }
+
+  // Nothing to read: times out on time
+  uint64_t start = gthread_now_ns();
+  ssize_t n = gthread_read_timeout(pipe_fds[0], &c, 1, 10 * MS);
+  int err = last_errno();
+  uint64_t ms = elapsed_ms(start);
+  CHECK(n == -1 && err == ETIMEDOUT);
+  CHECK(ms >= 10 && ms < 40);
+
+  // Written well before the deadline: read
+  gthread_t *t;
+  gthread_create(&t, pipe_writer, (void *)2L);
+  CHECK(gthread_read_timeout(pipe_fds[0], &c, 1, 100 * MS) == 1);
+  gthread_join(t, NULL);
+
+  // Nobody connects: times out on time
+  int ls = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr = {.sin_family = AF_INET};
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (ls < 0 || bind(ls, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+      listen(ls, 4) < 0) {
+    perror("listen");
+    exit(1);
+  }
+  start = gthread_now_ns();
+  int fd = gthread_accept_timeout(ls, NULL, NULL, 10 * MS);
+  err = last_errno();
+  ms = elapsed_ms(start);
+  CHECK(fd == -1 && err == ETIMEDOUT);
+  CHECK(ms >= 10 && ms < 40);
+
+  gthread_close(ls);
+  gthread_close(pipe_fds[0]);
+  gthread_close(pipe_fds[1]);
+  printf("gthread_read_timeout / gthread_accept_timeout: ok\n");
+}
+
+void run_tests(void *arg) {
+  (void)arg;
+  test_mutex();
+  test_cond();
+  test_race();
+  test_io();
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1)
+    gthread_set_workers(atoi(argv[1]));
+  gthread_init();
+  gmutex_init(&mutex);
+  gcond_init(&cond);
+  gmutex_init(&race_mutex);
+  gcond_init(&race_cond);
+
+  gthread_t *t;
+  gthread_create(&t, run_tests, NULL);
+  gthread_join(t, NULL);
+
+  printf(failures ? "FAILED (%d)\n" : "All timed wait tests passed\n",
+         failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,187 @@
+#include "gthread.h"
+#include "timer.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Phase 23: Timer wheel. Phase 24: Nanosecond sleeps.
+   Usage: timer_test [workers] */
+
+#define MS 1000000ULL
+#define WHEEL_TIMERS 2000
+#define FAR_NS (5ULL * 3600 * 1000 * MS) /* Past the ~3 h the wheel spans */
+#define SLEEPERS 200
+#define SHORT_SLEEPS 51
+
+static int failures = 0;
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);                   \
+      failures++;                                                              \
+    }                                                                          \
+  } while (0)
+
+static uint64_t rng = 88172645463325252ULL;
+
+static uint64_t next_rand(void) {
+  rng ^= rng << 13;
+  rng ^= rng >> 7;
+  rng ^= rng << 17;
+  return rng;
+}
+
+/* Deadlines spread over every level: 10 us to beyond the wheel's span */
+static uint64_t random_delay(void) {
+  int bits = 14 + next_rand() % 30; // 16 us .. 2^43 ns (2.4 h)
+  uint64_t d = next_rand() & ((1ULL << bits) - 1);
+  return next_rand() % 50 ? d : FAR_NS + d;
+}
+
+gtimer_t timers[WHEEL_TIMERS];
+int fired[WHEEL_TIMERS];
+
+/* The wheel on its own, with a simulated clock: every timer fires on the
+   first expire at or after its tick, never before, and cancelled ones never */
+void test_wheel(void) {
+  static timer_wheel_t w;
+  uint64_t now = 123456789;
+  timer_wheel_init(&w, now);
+  for (int i = 0; i < WHEEL_TIMERS; i++) {
+    timers[i].deadline_ns = now + random_delay();
+    timer_add(&w, &timers[i]);
+  }
+  int cancelled = 0;
+  for (int i = 0; i < WHEEL_TIMERS; i += 7) {
+    timer_cancel(&w, &timers[i]);
+    timer_cancel(&w, &timers[i]); // Twice is a no-op
+    cancelled++;
+  }
+  CHECK(w.count == WHEEL_TIMERS - cancelled);
+
+  int early = 0, late = 0, next_late = 0, steps = 0;
+  while (w.count > 0) {
+    uint64_t earliest = TIMER_NEVER;
+    for (int i = 0; i < WHEEL_TIMERS; i++)
+      if (timer_armed(&timers[i]) && timers[i].deadline_ns < earliest)
+        earliest = timers[i].deadline_ns;
+    uint64_t next = timer_next_ns(&w);
+    next_late += next > earliest + TIMER_TICK_NS;
+
+    // Sometimes straight to the next event, sometimes partway
+    uint64_t prev = now;
+    if (next_rand() % 2 && next > now)
+      now += (next - now) * (next_rand() % 100) / 100;
+    else if (next > now)
+      now = next;
+    else
+      now += TIMER_TICK_NS;
+
+    for (gtimer_t *t = timer_expire(&w, now); t; t = t->next) {
+      int i = t - timers;
+      fired[i]++;
+      early += now / TIMER_TICK_NS < t->expires || now < t->deadline_ns;
+      late += prev / TIMER_TICK_NS >= t->expires;
+    }
+    steps++;
+  }
+
+  int bad_fires = 0;
+  for (int i = 0; i < WHEEL_TIMERS; i++)
+    bad_fires += fired[i] != (i % 7 ? 1 : 0);
+  CHECK(bad_fires == 0 && early == 0 && late == 0 && next_late == 0);
+  CHECK(timer_next_ns(&w) == TIMER_NEVER);
+  printf("wheel with a simulated clock: ok (%d timers, %d steps)\n",
+         WHEEL_TIMERS - cancelled, steps);
+}
+
+/* Sleepers woken by the runtime: on time, and on one worker in deadline
+   order. Deadlines that pass during one stall (the OS ran something else)
+   are woken as a batch in any order, so only wakeups more than a ms apart
+   are compared. */
+uint64_t sleep_start;
+uint64_t woke_at[SLEEPERS];
+int wake_order[SLEEPERS];
+int woken = 0;
+
+static uint64_t sleeper_delay(long i) { return (i * 37 % 50 + 1) * MS; }
+
+void sleeper(void *arg) {
+  long i = (long)arg;
+  gthread_sleep_until(sleep_start + sleeper_delay(i));
+  woke_at[i] = gthread_now_ns();
+  wake_order[__atomic_fetch_add(&woken, 1, __ATOMIC_ACQ_REL)] = (int)i;
+}
+
+void test_sleepers(int workers) {
+  gthread_t *t[SLEEPERS];
+  // Far enough ahead that every sleeper is parked before the first is due
+  sleep_start = gthread_now_ns() + 20 * MS;
+  for (long i = 0; i < SLEEPERS; i++)
+    gthread_create(&t[i], sleeper, (void *)i);
+  for (int i = 0; i < SLEEPERS; i++)
+    gthread_join(t[i], NULL);
+
+  int early = 0, slow = 0, out_of_order = 0;
+  for (int i = 0; i < SLEEPERS; i++) {
+    uint64_t deadline = sleep_start + sleeper_delay(i);
+    early += woke_at[i] < deadline;
+    slow += woke_at[i] > deadline + 50 * MS;
+    if (i > 0) {
+      int a = wake_order[i - 1], b = wake_order[i];
+      out_of_order += sleeper_delay(b) < sleeper_delay(a) &&
+                      woke_at[b] > woke_at[a] + MS;
+    }
+  }
+  CHECK(early == 0 && slow == 0);
+  if (workers == 1)
+    CHECK(out_of_order == 0);
+  printf("%d sleepers: ok\n", SLEEPERS);
+}
+
+static int cmp_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+/* 100 us sleeps take about 100 us, not a millisecond tick */
+void test_sub_ms(void) {
+  uint64_t took[SHORT_SLEEPS];
+  int early = 0;
+  for (int i = 0; i < SHORT_SLEEPS; i++) {
+    uint64_t start = gthread_now_ns();
+    gthread_sleep_ns(100000);
+    took[i] = gthread_now_ns() - start;
+    early += took[i] < 100000;
+  }
+  qsort(took, SHORT_SLEEPS, sizeof(took[0]), cmp_u64);
+  uint64_t median = took[SHORT_SLEEPS / 2];
+  CHECK(early == 0);
+  CHECK(median < 500000);
+
+  // Deadlines already behind us return at once
+  uint64_t start = gthread_now_ns();
+  gthread_sleep_until(start - MS);
+  gthread_sleep_ns(0);
+  CHECK(gthread_now_ns() - start < MS);
+  printf("100 us sleeps: ok (median %lu us)\n", (unsigned long)median / 1000);
+}
+
+void run_tests(void *arg) {
+  test_wheel();
+  test_sleepers((int)(long)arg);
+  test_sub_ms();
+}
+
+int main(int argc, char **argv) {
+  int workers = argc > 1 ? atoi(argv[1]) : 1;
+  gthread_set_workers(workers);
+  gthread_init();
+
+  gthread_t *t;
+  gthread_create(&t, run_tests, (void *)(long)workers);
+  gthread_join(t, NULL);
+
+  printf(failures ? "FAILED (%d)\n" : "All timer tests passed\n", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,249 @@
+#include "gthread.h"
+#include "io.h"
+#include "uring.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Phase 22: io_uring backend. Skipped (and passing) on kernels without it.
+   Usage: uring_test [workers] */
+
+#define READERS 100
+#define CLIENTS 20
+#define MESSAGES 50
+#define CHUNK 4096
+#define CHUNKS 64
+
+static int failures = 0;
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);                   \
+      failures++;                                                              \
+    }                                                                          \
+  } while (0)
+
+/* A lost completion shows up as a hang: fail instead */
+static void *watchdog(void *arg) {
+  (void)arg;
+  sleep(20);
+  printf("FAIL: hung\n");
+  fflush(stdout);
+  _exit(1);
+}
+
+/* errno after a switch: read through a call the compiler cannot cache */
+__attribute__((noinline)) static int last_errno(void) { return errno; }
+
+static void make_pipe(int *fds) {
+  if (pipe(fds) < 0) {
+    perror("pipe");
+    exit(1);
+  }
+}
+
+int reader_pipes[READERS][2];
+int readers_ok = 0;
+
+void pipe_reader(void *arg) {
+  long i = (long)arg;
+  long v = -1;
+  if (gthread_read(reader_pipes[i][0], &v, sizeof(v)) == sizeof(v) && v == i)
+    __atomic_add_fetch(&readers_ok, 1, __ATOMIC_RELAXED);
+}
+
+/* Reads in flight on blocking pipes: the ring waits, not the worker */
+void test_pipes(void) {
+  gthread_t *t[READERS];
+  for (long i = 0; i < READERS; i++) {
+    make_pipe(reader_pipes[i]);
+    gthread_create(&t[i], pipe_reader, (void *)i);
+  }
+  gthread_sleep(10);
+  CHECK(readers_ok == 0 && uring_inflight() > 0);
+  for (long i = READERS - 1; i >= 0; i--)
+    CHECK(gthread_write(reader_pipes[i][1], &i, sizeof(i)) == sizeof(i));
+  for (int i = 0; i < READERS; i++) {
+    gthread_join(t[i], NULL);
+    close(reader_pipes[i][0]);
+    close(reader_pipes[i][1]);
+  }
+  CHECK(readers_ok == READERS);
+  printf("%d reads in flight on blocking pipes: ok\n", READERS);
+}
+
+/* Reads and writes at -1 follow the file position */
+void test_file_position(void) {
+  char path[] = "/tmp/uring_testXXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    perror("mkstemp");
+    exit(1);
+  }
+  unlink(path);
+
+  static char buf[CHUNK];
+  for (int i = 0; i < CHUNKS; i++) {
+    memset(buf, 'a' + i % 26, CHUNK);
+    CHECK(gthread_write(fd, buf, CHUNK) == CHUNK);
+  }
+  CHECK(lseek(fd, 0, SEEK_CUR) == (off_t)CHUNK * CHUNKS);
+
+  lseek(fd, 0, SEEK_SET);
+  int bad = 0;
+  for (int i = 0; i < CHUNKS; i++) {
+    memset(buf, 0, CHUNK);
+    bad += gthread_read(fd, buf, CHUNK) != CHUNK;
+    bad += buf[0] != 'a' + i % 26 || buf[CHUNK - 1] != 'a' + i % 26;
+  }
+  CHECK(bad == 0);
+  CHECK(gthread_read(fd, buf, CHUNK) == 0); // EOF
+  close(fd);
+  printf("file position across reads and writes: ok\n");
+}
+
+int listen_fd;
+struct sockaddr_in listen_addr;
+
+void echo_handler(void *arg) {
+  int fd = (int)(long)arg;
+  char buf[64];
+  ssize_t n;
+  while ((n = gthread_read(fd, buf, sizeof(buf))) > 0)
+    if (gthread_write(fd, buf, n) != n)
+      break;
+  close(fd);
+}
+
+void echo_server(void *arg) {
+  (void)arg;
+  gthread_attr_t attr;
+  gthread_attr_init(&attr);
+  attr.detached = 1;
+  for (int i = 0; i < CLIENTS; i++) {
+    int fd = gthread_accept(listen_fd, NULL, NULL);
+    if (fd < 0)
+      break;
+    gthread_t *t;
+    gthread_create_ex(&t, &attr, echo_handler, (void *)(long)fd);
+  }
+}
+
+int clients_ok = 0;
+
+void echo_client(void *arg) {
+  long id = (long)arg;
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0 ||
+      connect(fd, (struct sockaddr *)&listen_addr, sizeof(listen_addr)) < 0) {
+    perror("connect");
+    return;
+  }
+  int bad = 0;
+  for (int i = 0; i < MESSAGES; i++) {
+    char msg[32], got[32];
+    int len = snprintf(msg, sizeof(msg), "client %ld msg %d", id, i);
+    bad += gthread_write(fd, msg, len) != len;
+    int n = 0;
+    while (n < len) {
+      ssize_t r = gthread_read(fd, got + n, len - n);
+      if (r <= 0)
+        break;
+      n += r;
+    }
+    bad += n != len || memcmp(msg, got, len) != 0;
+  }
+  close(fd);
+  if (!bad)
+    __atomic_add_fetch(&clients_ok, 1, __ATOMIC_RELAXED);
+}
+
+void test_tcp(void) {
+  listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  listen_addr.sin_family = AF_INET;
+  listen_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t len = sizeof(listen_addr);
+  if (listen_fd < 0 ||
+      bind(listen_fd, (struct sockaddr *)&listen_addr, sizeof(listen_addr)) <
+          0 ||
+      listen(listen_fd, CLIENTS) < 0 ||
+      getsockname(listen_fd, (struct sockaddr *)&listen_addr, &len) < 0) {
+    perror("listen");
+    exit(1);
+  }
+
+  gthread_t *server, *clients[CLIENTS];
+  gthread_create(&server, echo_server, NULL);
+  for (long i = 0; i < CLIENTS; i++)
+    gthread_create(&clients[i], echo_client, (void *)i);
+  for (int i = 0; i < CLIENTS; i++)
+    gthread_join(clients[i], NULL);
+  gthread_join(server, NULL);
+  close(listen_fd);
+  CHECK(clients_ok == CLIENTS);
+  printf("accept and echo over TCP: ok (%d clients x %d)\n", CLIENTS,
+         MESSAGES);
+}
+
+int nb_fds[2];
+
+void late_writer(void *arg) {
+  (void)arg;
+  gthread_sleep(5);
+  if (write(nb_fds[1], "x", 1) != 1)
+    perror("write");
+}
+
+/* O_NONBLOCK fds get EAGAIN from the ring and fall back to a reactor wait;
+   failures come back as -1 with errno */
+void test_nonblock_and_errors(void) {
+  make_pipe(nb_fds);
+  fcntl(nb_fds[0], F_SETFL, fcntl(nb_fds[0], F_GETFL) | O_NONBLOCK);
+  gthread_t *t;
+  gthread_create(&t, late_writer, NULL);
+  char c = 0;
+  CHECK(gthread_read(nb_fds[0], &c, 1) == 1 && c == 'x');
+  gthread_join(t, NULL);
+  gthread_close(nb_fds[0]);
+  gthread_close(nb_fds[1]);
+
+  CHECK(gthread_read(nb_fds[0], &c, 1) == -1 && last_errno() == EBADF);
+  CHECK(gthread_write(nb_fds[1], &c, 1) == -1 && last_errno() == EBADF);
+  printf("O_NONBLOCK fallback and errors: ok\n");
+}
+
+void run_tests(void *arg) {
+  (void)arg;
+  test_pipes();
+  test_file_position();
+  test_tcp();
+  test_nonblock_and_errors();
+}
+
+int main(int argc, char **argv) {
+  pthread_t wd;
+  pthread_create(&wd, NULL, watchdog, NULL);
+
+  unsetenv("GTHREAD_IO");
+  if (argc > 1)
+    gthread_set_workers(atoi(argv[1]));
+  gthread_init();
+  if (!uring_enabled()) {
+    printf("io_uring not available: skipped\n");
+    return 0;
+  }
+
+  gthread_t *t;
+  gthread_create(&t, run_tests, NULL);
+  gthread_join(t, NULL);
+
+  printf(failures ? "FAILED (%d)\n" : "All io_uring tests passed\n", failures);
+  return failures ? 1 : 0;
+}
@@ -191,11 +191,16 @@ void server_loop(void *arg) {
 
   printf("GreenThreads Dashboard listening on :%d\n", PORT);
 
+  // Never joined: detached handlers are reaped as soon as they finish
+  gthread_attr_t attr;
+  gthread_attr_init(&attr);
+  attr.detached = 1;
+
   while (1) {
     int new_socket = gthread_accept(server_fd, NULL, NULL);
     if (new_socket >= 0) {
       gthread_t *t;
-      gthread_create(&t, handle_client, (void *)(long)new_socket);
+      gthread_create_ex(&t, &attr, handle_client, (void *)(long)new_socket);
     }
   }
 }
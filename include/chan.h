@@ -0,0 +1,108 @@
+#ifndef CHAN_H
+#define CHAN_H
+
+#include "gthread.h"
+#include "spinlock.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* Phase 43: Channels. Fixed-size values pass between green threads by
+   copy, FIFO. A channel is unbuffered (capacity 0: every send meets a
+   receive), bounded, or unbounded (GCHAN_UNBOUNDED: sends never block).
+   A value meeting a parked thread goes straight into its destination, and
+   the thread is made ready with the operation already done, so it never
+   touches the channel again; the ring buffer is only used when nobody is
+   waiting on the other side. */
+
+#define GCHAN_UNBOUNDED ((size_t)-1)
+
+/* Results of send, recv and the try variants */
+#define GCHAN_OK 0
+#define GCHAN_CLOSED -1     /* Send on a closed channel, or recv on a closed
+                               and drained one */
+#define GCHAN_WOULDBLOCK -2 /* Try variants only */
+
+/* gchan_select cases */
+#define GCHAN_SEND 0
+#define GCHAN_RECV 1
+#define GCHAN_SELECT_MAX 64
+
+/* A parked send or receive, linked on its channel until a peer completes
+   it. One per case of a select, all sharing one chan_sel_t; only the
+   first peer to claim that (and, with a timeout, to win the thread from
+   the timer) completes anything. Internal. */
+typedef struct chan_sel {
+  gthread_t *thread;
+  int done;  /* Claimed by a peer, or by the thread itself on timeout */
+  int timed; /* The thread's timer is armed too */
+  int fired; /* Case completed, set by the peer that claimed it */
+  int ok;    /* 1 if a value moved, 0 if the channel was closed */
+} chan_sel_t;
+
+typedef struct chan_waiter {
+  chan_sel_t *sel;
+  void *elem; /* Value to send, or where to receive */
+  int index;  /* Case in the select */
+  int linked;
+  struct chan_waiter *next;
+  struct chan_waiter *prev;
+} chan_waiter_t;
+
+typedef struct {
+  chan_waiter_t *first;
+  chan_waiter_t *last;
+} chan_waitq_t;
+
+typedef struct gchan {
+  gspinlock_t lock;
+  size_t elem_size;
+  size_t capacity; /* As created */
+  char *buf;       /* Ring of `slots` values */
+  size_t slots;
+  size_t head;
+  size_t count;
+  int closed;
+  chan_waitq_t recvq; /* Receivers waiting for a value */
+  chan_waitq_t sendq; /* Senders waiting for room or a receiver */
+} gchan_t;
+
+typedef struct {
+  gchan_t *ch; /* NULL: never ready */
+  int op;      /* GCHAN_SEND or GCHAN_RECV */
+  void *elem;  /* Value to send, or where to receive (NULL discards) */
+  int ok;      /* Out, for the case that fired: 1 if a value moved, 0 if
+                  the channel was closed */
+} gchan_case_t;
+
+/* NULL if out of memory */
+gchan_t *gchan_create(size_t elem_size, size_t capacity);
+/* Nobody may be waiting on it */
+void gchan_destroy(gchan_t *ch);
+
+/* Block until the value is taken (unbuffered) or queued. GCHAN_OK, or
+   GCHAN_CLOSED if the channel is or gets closed first. */
+int gchan_send(gchan_t *ch, const void *elem);
+/* Block until a value arrives. GCHAN_OK, or GCHAN_CLOSED once the channel
+   is closed and drained (elem is zeroed then). */
+int gchan_recv(gchan_t *ch, void *elem);
+
+/* The same without blocking: GCHAN_WOULDBLOCK if they would have */
+int gchan_try_send(gchan_t *ch, const void *elem);
+int gchan_try_recv(gchan_t *ch, void *elem);
+
+/* No more sends. Wakes every receiver (once the buffer is drained they get
+   GCHAN_CLOSED) and every waiting sender (GCHAN_CLOSED). 0, or -1 if it
+   was already closed. */
+int gchan_close(gchan_t *ch);
+
+/* Values buffered right now */
+size_t gchan_len(gchan_t *ch);
+
+/* Wait for the first of n (at most GCHAN_SELECT_MAX) cases that can go
+   ahead, and complete that one only. When several are ready at once the
+   pick rotates, so none is starved. timeout_ns: -1 waits forever, 0 just
+   checks. Returns the index of the case that fired (its `ok` says
+   whether a value moved), or -1 if none could before the timeout. */
+int gchan_select(gchan_case_t *cases, int n, int64_t timeout_ns);
+
+#endif
@@ -1,6 +1,10 @@
 #ifndef DASHBOARD_H
 #define DASHBOARD_H
 
+/* Phase 37: CPU cap shared by the dashboard's server and handler threads */
+#define DASHBOARD_QUOTA_NS 5000000ULL    // 5 ms
+#define DASHBOARD_PERIOD_NS 100000000ULL // per 100 ms: 5%
+
 /* Starts the dashboard server on the specified port in a new green thread.
    Returns the thread handle or NULL on failure. */
 void dashboard_start(int port);
@@ -0,0 +1,57 @@
+#ifndef GROUP_H
+#define GROUP_H
+
+#include "gthread.h"
+#include "spinlock.h"
+#include <stdint.h>
+
+/* Phase 38: Scheduling groups, as ticket currencies. A group is funded
+   with `tickets` in its parent (or in the root, next to the threads that
+   belong to no group), and those are worth whatever its members who can
+   run hold between them: `active` counts the tickets of its runnable
+   threads and of its busy subgroups. A member's stride is its own
+   (STRIDE_CONSTANT / tickets) scaled by active / tickets at every level,
+   so a group gets the same CPU with 1 runnable thread as with 1000, and an
+   idle group's share goes to the busy ones. */
+
+#define GROUP_MAX_STRIDE (1ULL << 40)
+
+struct ggroup {
+  gspinlock_t lock; /* Busy/idle transitions and ticket changes */
+  struct ggroup *parent;
+  int tickets;
+  int64_t active;  /* Tickets of runnable members, busy subgroups' included */
+  int contrib;     /* What it counts for in parent->active: 0 while idle */
+
+  /* Dashboard counters */
+  uint64_t cpu_ns; /* CPU used by members, subgroups included, ever */
+  int nr_threads;  /* Direct members */
+
+  int refs; /* The creator's, one per member thread and per subgroup */
+  int id;
+  char name[GTHREAD_NAME_MAX];
+  struct ggroup *next; /* All groups */
+};
+
+/* Move t (not running elsewhere) to g, or out of any group with NULL.
+   running: t is the caller, and so counts as runnable. */
+void group_attach(gthread_t *t, ggroup_t *g, int running);
+
+/* t became runnable, or stopped being runnable (blocked or exited) */
+void group_thread_active(gthread_t *t);
+void group_thread_inactive(gthread_t *t);
+
+/* t's ticket count changes to `tickets` */
+void group_thread_retick(gthread_t *t, int tickets);
+
+/* base (t's stride on its own) scaled through t's groups */
+uint64_t group_stride(gthread_t *t, uint64_t base);
+
+/* ns of CPU used by a member, for g and its ancestors */
+void group_charge(ggroup_t *g, uint64_t ns);
+
+/* Every group, parents before children, under the group list lock: fn
+   must not block */
+void group_for_each(void (*fn)(ggroup_t *g, void *arg), void *arg);
+
+#endif
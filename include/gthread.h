@@ -1,6 +1,8 @@
 #ifndef GTHREAD_H
 #define GTHREAD_H
 
+#include "rbtree.h"
+#include "timer.h"
 #include <stddef.h>
 #include <stdint.h>
 
@@ -16,6 +18,31 @@ typedef enum {
 /* Thread Handle */
 typedef struct gthread gthread_t;
 
+/* Phase 37: CPU bandwidth pool (see gquota_create) */
+typedef struct gquota gquota_t;
+
+/* Phase 38: Scheduling group (see ggroup_create) */
+typedef struct ggroup ggroup_t;
+
+/* Phase 32: Creation attributes (see gthread_create_ex) */
+#define GTHREAD_STACK_DEFAULT (1024 * 1024) // Reserved; RSS is what gets touched
+#define GTHREAD_STACK_MIN (16 * 1024)       // Usable, above the guard
+#define GTHREAD_GUARD_DEFAULT (16 * 1024)
+#define GTHREAD_TICKETS_DEFAULT 10
+#define GTHREAD_NAME_MAX 32
+
+typedef struct {
+  size_t stack_size; /* Bytes reserved, guard included */
+  size_t guard_size; /* PROT_NONE bytes at the low end; 0 for none.
+                        Dropped past vm.max_map_count (see stack.h) */
+  int tickets;       /* Stride scheduling share */
+  const char *name;  /* Copied; shown by the monitor and dashboards */
+  int detached;      /* Cannot be joined */
+  uint64_t deadline_ns; /* Phase 36: Relative; runs under EDF if non-zero */
+  gquota_t *quota;      /* Phase 37: CPU pool it draws on; NULL for none */
+  ggroup_t *group;      /* Phase 38: Scheduling group; NULL for the root */
+} gthread_attr_t;
+
 /* Context Structure (Architecture Dependent - x86_64) */
 typedef struct {
   uint64_t rbx;
@@ -28,27 +55,68 @@ typedef struct {
   uint64_t rsp;
 } gthread_ctx_t;
 
-/* Thread Control Block */
+/* Thread Control Block.
+   Phase 30: Laid out by temperature. The first cache line is everything the
+   scheduler touches to queue, pick, preempt and wake a thread; the register
+   context is the second; the rest is cold. TCBs come from a slab (pool.h). */
 struct gthread {
+  // Stride scheduling fields (Phase 3)
+  uint64_t pass;
+  uint64_t stride;
+  struct gthread *next; /* For queueing */
+  gthread_state_t state;
+
+  // Phase 19: M:N workers. Set while a worker is executing on (or still
+  // switching off) this thread's stack; other workers must not resume it.
+  int on_cpu;
+
+  // Phase 20: Ready heap this thread is queued on, NULL when not queued
+  struct gworker *rq;
+
+  // Phase 29: Shared-stack mode. Runs on its home worker's shared stack
+  // (and only on that worker); while another thread owns the stack, the
+  // live frames are parked in saved_stack.
+  struct gworker *home;
+
+  // Phase 26: Preemption. preempt_count nests gthread_preempt_disable();
+  // a preempted thread stays on its worker's run queue until it resumes.
+  int preempt_count;
+  uint8_t preempt_pending;
+  uint8_t preempted;
+
+  // Phase 36: Policy class it is queued under (GSCHED_FAIR or GSCHED_EDF)
+  uint8_t sched_class;
+
+  // Phase 37: Runs are timed: it draws on a CPU pool (`quota`) or, from
+  // Phase 38, belongs to a group
+  uint8_t timed;
+
+  // Phase 31: Times switched in. Tells the stack reclaimer whether a
+  // blocked thread has run since it last looked.
+  uint32_t runs;
+
+  // Phase 20: Slot in rq's heap, stored as each entry comes to rest in a
+  // sift and never read while sifting
+  int heap_index;
+
+  gthread_ctx_t ctx __attribute__((aligned(64)));
+
   uint64_t id;
-  gthread_ctx_t ctx;
   void *stack;
   size_t stack_size;
-  gthread_state_t state;
+  size_t guard_size; // Phase 32
   void (*entry)(void *);
   void *arg;
-  struct gthread *next; /* For queueing */
-
-  // Stride scheduling fields (Phase 3)
   uint64_t tickets;
-  uint64_t stride;
-  uint64_t pass;
 
   // Phase 5: Join support
   struct gthread *join_queue;
   void *retval;
 
-  struct gthread *global_next; /* For global iteration (Dashboard #2) */
+  // Phase 33: Reaping (registry.h). References held by the exit and the
+  // joiners; joiners counts those still reading retval.
+  int reap_refs;
+  int joiners;
 
   // Phase 6: Sleep
   uint64_t wake_time_ms;
@@ -58,20 +126,220 @@ struct gthread {
 
   // Phase 13: Dashboard #2
   int waiting_fd;
-};
+
+  // Phase 21: epoll reactor. POLLIN/POLLOUT this thread is parked on.
+  uint32_t wait_events;
+
+  // Phase 23: Timer wheel entry for sleeps
+  gtimer_t timer;
+
+  // Phase 29: Shared-stack image
+  void *saved_stack;
+  size_t saved_size;
+  size_t saved_cap;
+
+  // Phase 31: Stack reclaim. Deepest stack use seen and bytes given back;
+  // the blocked spell being timed started at reclaim_since_ns, when `runs`
+  // was reclaim_runs.
+  size_t stack_high_water;
+  size_t stack_reclaimed;
+  uint64_t reclaim_since_ns;
+  uint32_t reclaim_runs;
+  int reclaim_done;
+
+  // Phase 32: From gthread_attr_t
+  char name[GTHREAD_NAME_MAX];
+  int detached;
+
+  // Phase 34: Heap whose virtual time `pass` is measured against (the
+  // last one it was queued on); NULL until first queued.
+  struct gworker *last_rq;
+
+  // Phase 35: Time accounting. Charge for a run that ended in a block,
+  // not yet added to `pass`.
+  uint64_t unpaid;
+
+  // Phase 36: Link in a CFS or EDF run queue, and the EDF deadline
+  // (absolute, CLOCK_MONOTONIC)
+  rb_node_t rq_node;
+  uint64_t deadline_ns;
+
+  // Phase 37: CPU bandwidth pool, when its current run started, and
+  // whether it is parked until the pool's next period
+  struct gquota *quota;
+  uint64_t run_since;
+  int throttled;
+
+  // Phase 38: Scheduling group, and the tickets it adds to the group's
+  // active count while runnable (0 otherwise)
+  struct ggroup *group;
+  int group_weight;
+
+  // Phase 40: Waiting on a mutex it was moved to by a condition variable
+  int cond_requeued;
+
+  // Phase 41: Blocked with a timeout (TIMED_WAIT_*, scheduler.h). Its
+  // `timer` is armed alongside the wait.
+  int timed_wait;
+} __attribute__((aligned(64)));
+
+_Static_assert(offsetof(struct gthread, ctx) == 64,
+               "scheduler fields must fit in the first cache line");
 
 /* API */
 int gthread_create(gthread_t **t, void (*fn)(void *), void *arg);
 void gthread_exit(void);
 void gthread_yield(void);
+/* -1 for a detached thread. Phase 33: Once the thread has exited and
+   every pending join has returned, its TCB is reaped: t must not be used
+   (or joined again) afterwards. */
 int gthread_join(gthread_t *t, void **retval);
 void gthread_sleep(uint64_t ms);
+
+/* Phase 24: Sub-millisecond sleeps. Times are CLOCK_MONOTONIC nanoseconds;
+   wakeups land within a timer tick (10 us) plus scheduling latency. */
+void gthread_sleep_ns(uint64_t ns);
+void gthread_sleep_until(uint64_t deadline_ns);
+uint64_t gthread_now_ns(void);
+
+/* Phase 25: IO polling policy. A switch only calls epoll_wait when the run
+   queue is empty, every `every_switches` switches, or once `budget_ns` has
+   passed since the last poll (0 = no time budget). Defaults: 64 switches,
+   1 ms. gthread_set_io_poll(1, 0) polls on every switch. */
+void gthread_set_io_poll(int every_switches, uint64_t budget_ns);
 uint64_t gthread_self_id(void);
 
-/* Dashboard #2 API */
-gthread_t *gthread_get_all_threads(void);
+/* Phase 26: Preemptive time slicing (opt-in). A thread that keeps the CPU
+   for a whole slice is switched out by a per-worker SIGALRM timer, within
+   two slices. Must be called before gthread_init; 0, the default unless
+   $GTHREAD_PREEMPT_US is set, keeps scheduling cooperative. Only program
+   code is interrupted, never libc, so statically linked programs should not
+   enable it. Wrap sections that must not be interleaved (or that hold an
+   OS-level lock) in gthread_preempt_disable()/gthread_preempt_enable(); they
+   nest, and a preemption that was held off happens on the last enable. The
+   application must not use SIGALRM itself. */
+void gthread_set_preemption(uint64_t slice_ns);
+void gthread_preempt_disable(void);
+void gthread_preempt_enable(void);
+
+/* Phase 27: Stack cache. Exited threads' stacks are reused by the next
+   gthread_create of the same size class. A class holding more than `high`
+   free stacks is trimmed back to `low`. Defaults: 1024 / 256. */
+void gthread_set_stack_cache(int high, int low);
+
+/* Phase 29: Shared-stack (copy-stack) mode for huge numbers of mostly idle
+   threads. Each worker gets one stack of `size` bytes; threads created
+   afterwards run on it, and when another thread needs it only the live part
+   of the owner's stack (ctx.rsp to the top) is copied to a right-sized heap
+   buffer. An idle thread then costs its TCB plus its actual stack depth.
+   Threads stay on the worker they were assigned (round-robin) and use the
+   readiness path for IO. Pointers into a thread's stack are only valid
+   while it runs: never hand one to another thread across a block. Must be
+   called before gthread_init; $GTHREAD_SHARED_STACK_KB also enables it. */
+void gthread_set_shared_stack(size_t size);
+
+/* Phase 31: Idle stack reclaim. A thread that has been blocked (asleep, on
+   IO, a lock or a join) for at least `idle_ns` has the stack pages below
+   its stack pointer handed back to the kernel, so one deep excursion does
+   not pin its RSS forever. Checked by a periodic sweep: pages go within
+   about twice the threshold. Default 1 s; 0 turns it off. Not used in
+   shared-stack mode, whose images are already right-sized. */
+void gthread_set_stack_reclaim(uint64_t idle_ns);
+
+/* Phase 32: Per-thread attributes, applied before the thread is queued.
+   gthread_attr_init fills in the defaults gthread_create uses: a 1 MB
+   reservation with a 16 KB guard, 10 tickets, the name "GTHREAD", joinable,
+   no deadline, no CPU quota, the root group.
+   Stacks smaller than the guard plus GTHREAD_STACK_MIN are enlarged; stacks
+   with the default guard are rounded up to the stack cache's power-of-two
+   class and recycled, others are mapped and unmapped individually. A guard
+   of 0 saves a mapping per thread but leaves overflows undetected. In
+   shared-stack mode the stack fields are ignored. attr may be NULL.
+   Returns -1 if tickets is not positive. */
+void gthread_attr_init(gthread_attr_t *attr);
+int gthread_create_ex(gthread_t **t, const gthread_attr_t *attr,
+                      void (*fn)(void *), void *arg);
+
+/* Phase 35: Stride accounting. GTHREAD_ACCOUNT_TICKS, the default, charges
+   a thread one stride each time it is picked, however long it then runs.
+   GTHREAD_ACCOUNT_TIME charges it a stride per microsecond (1024 ns) of CPU
+   actually used, timed with CLOCK_MONOTONIC as it is switched in and out,
+   so tickets are CPU shares even when some threads yield after a moment
+   and others run for a whole slice. The time is wall time on the worker,
+   so a worker's OS thread being descheduled is charged to whoever it was
+   running: give workers their own cores for exact shares. Costs a clock
+   read per switch. Must be called before gthread_init;
+   $GTHREAD_ACCOUNT=time also selects it. */
+typedef enum { GTHREAD_ACCOUNT_TICKS, GTHREAD_ACCOUNT_TIME } gthread_account_t;
+
+void gthread_set_accounting(gthread_account_t mode);
+
+/* Phase 36: Scheduling policies. Threads without a deadline share the CPU
+   by tickets under the fair policy: GTHREAD_POLICY_STRIDE (the default, a
+   heap by pass) or GTHREAD_POLICY_CFS (a red-black tree by vruntime,
+   always time-accounted; a thread waking from a sleep keeps up to 3 ms of
+   its lag, so it gets ahead of the CPU hogs). Must be called before
+   gthread_init; $GTHREAD_POLICY=cfs also selects it. */
+typedef enum { GTHREAD_POLICY_STRIDE, GTHREAD_POLICY_CFS } gthread_policy_t;
+
+void gthread_set_policy(gthread_policy_t policy);
+
+/* Phase 36: Earliest deadline first. A thread with a deadline goes before
+   every fair-share thread, in deadline order; one past its deadline keeps
+   its place at the front. Sets the calling thread's deadline (absolute,
+   gthread_now_ns() time), e.g. per request handled; 0 returns it to fair
+   share. Applies from its next switch. attr.deadline_ns starts a thread
+   with the deadline creation time + deadline_ns. EDF threads are not
+   throttled: ones that never block starve the fair class. */
+void gthread_set_deadline(uint64_t deadline_ns);
+
+/* Phase 37: CPU bandwidth quotas. A pool grants `runtime_ns` of CPU per
+   `period_ns` (5% is 5 ms per 100 ms) to the threads attached to it,
+   together: one thread or a whole background service. A thread is charged
+   from switch-in to switch-out, and once the pool has used up its period,
+   it is parked off the run queue the next time it yields, blocks and wakes
+   or is preempted, until the period ends. Unused runtime does not carry
+   over; an overrun is paid back from the following periods. A thread that
+   never yields is only stopped by preemption (gthread_set_preemption).
+   Tickets still split the CPU inside the cap. Attach with attr.quota, or
+   gthread_set_quota(q) for the calling thread (NULL detaches).
+   gquota_destroy drops the creator's reference: the pool goes with its last
+   attached thread. Returns NULL for a period of 0 or out of memory. */
+gquota_t *gquota_create(const char *name, uint64_t runtime_ns,
+                        uint64_t period_ns);
+void gquota_destroy(gquota_t *q);
+void gthread_set_quota(gquota_t *q);
+
+/* Phase 38: Hierarchical scheduling groups, for isolating tenants. A group
+   holds `tickets` in its parent (the root when NULL, where they compete
+   with the tickets of threads in no group) and contains threads and
+   subgroups, which split its share by their own tickets. Only members that
+   can run count: a group gets its share whether one or 1000 of its threads
+   are runnable, and an idle group's share goes to the others. A member's
+   stride is recomputed from its groups each time it is queued, so changes
+   show within a turn. Threads join with attr.group, or the caller with
+   gthread_set_group(g) (NULL: back to the root). ggroup_destroy drops the
+   creator's reference: a group goes once it has no threads or subgroups.
+   Shares are measured as tickets are: per pick unless time accounting is
+   on, and per worker. Groups combine with quotas, which cap a thread
+   whatever its share. */
+ggroup_t *ggroup_create(ggroup_t *parent, const char *name, int tickets);
+void ggroup_destroy(ggroup_t *g);
+int ggroup_set_tickets(ggroup_t *g, int tickets);
+void gthread_set_group(ggroup_t *g);
+
+/* Dashboard #2 API.
+   Phase 33: Calls fn for every thread that has not been reaped (exited
+   threads linger until joined), under the registry lock: fn must not block,
+   yield or create or join threads. Thread ids come from the registry. */
+void gthread_for_each(void (*fn)(gthread_t *t, void *arg), void *arg);
 
 /* Internal Init (Call once) */
 void gthread_init(void);
 
+/* M:N mode: number of worker OS threads started by gthread_init.
+   Must be called before gthread_init. Defaults to $GTHREAD_WORKERS or 1. */
+void gthread_set_workers(int n);
+int gthread_get_workers(void);
+
 #endif
@@ -2,16 +2,25 @@
 #define IO_H
 
 #include <stddef.h>
+#include <stdint.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 
 
+// Selects io_uring or the epoll reactor; called by gthread_init
 void io_init(void);
 
 // Non-blocking wrappers
 ssize_t gthread_read(int fd, void *buf, size_t count);
 ssize_t gthread_write(int fd, const void *buf, size_t count);
 int gthread_accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen);
+// Phase 41: Giving up after timeout_ns (0: never) with errno ETIMEDOUT
+ssize_t gthread_read_timeout(int fd, void *buf, size_t count,
+                             uint64_t timeout_ns);
+int gthread_accept_timeout(int sockfd, struct sockaddr *addr,
+                           socklen_t *addrlen, uint64_t timeout_ns);
+// Close an fd that threads may have waited on (drops its reactor slot)
+int gthread_close(int fd);
 
 // Register wait
 // Wait for events (POLLIN/POLLOUT) on fd. Blocks current thread.
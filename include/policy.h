@@ -0,0 +1,52 @@
+#ifndef POLICY_H
+#define POLICY_H
+
+#include "gthread.h"
+#include <stdint.h>
+
+struct gworker;
+
+/* Phase 36: Scheduling policies. Each worker keeps one run queue per class
+   behind the hooks below, and the dispatcher asks the classes from the
+   highest down: a thread with a deadline (EDF) always goes before
+   fair-share work. The fair class is stride (a heap by pass, the default)
+   or CFS (a red-black tree by vruntime), chosen once per process. A queued
+   thread's key lives in its TCB: `pass` for the fair classes, `deadline_ns`
+   for EDF. Hooks that take a worker run under its rq_lock. */
+
+enum { GSCHED_FAIR, GSCHED_EDF, GSCHED_CLASSES };
+
+/* Sleepers under CFS keep at most this much of their lag on waking */
+#define CFS_WAKE_CREDIT_NS 3000000ULL
+
+typedef struct gsched_class {
+  const char *name;
+  /* t joins w from outside (new, woken or stolen): place its key */
+  void (*wake)(struct gworker *w, gthread_t *t);
+  void (*enqueue)(struct gworker *w, gthread_t *t);
+  void (*dequeue)(struct gworker *w, gthread_t *t);
+  /* Most urgent queued thread, and the least (what a thief takes) */
+  gthread_t *(*first)(struct gworker *w);
+  gthread_t *(*last)(struct gworker *w);
+  /* t was picked to run on w */
+  void (*pick)(struct gworker *w, gthread_t *t);
+  /* Key charge for ns of CPU under time accounting */
+  uint64_t (*tick)(gthread_t *t, uint64_t ns);
+  /* Install a new stride for t, dequeued from w meanwhile */
+  void (*reweight)(struct gworker *w, gthread_t *t, uint64_t stride);
+} gsched_class_t;
+
+extern const gsched_class_t *sched_classes[GSCHED_CLASSES];
+
+/* Charge by CPU time rather than per pick (always on under CFS) */
+extern int policy_account_time;
+
+static inline const gsched_class_t *sched_class_of(const gthread_t *t) {
+  return sched_classes[t->sched_class];
+}
+
+/* Before the workers start */
+void policy_set_fair(int policy);
+void policy_set_accounting(int mode);
+
+#endif
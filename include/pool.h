@@ -0,0 +1,33 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include "gthread.h"
+#include <stddef.h>
+
+/* Stack cache. Stacks of terminated threads go back on a free list per
+   power-of-two size class (32 KB to 8 MB; larger ones are not cached) and
+   are handed to the next gthread_create of that class, mapping and touched
+   pages included. A list that grows past the high watermark is trimmed to
+   the low one. */
+
+#define POOL_MIN_SHIFT 15
+#define POOL_CLASSES 9
+#define POOL_HIGH_DEFAULT 1024
+#define POOL_LOW_DEFAULT 256
+
+/* A stack (see stack_map) of at least *size bytes with the default guard.
+   *size is rounded up to its class. */
+void *pool_stack_get(size_t *size);
+void pool_stack_put(void *stack, size_t size);
+
+void pool_set_limits(int high, int low);
+
+/* Phase 30: TCB slab. TCBs are carved POOL_TCB_SLAB at a time from
+   cache-line aligned blocks and recycled through a free list; slabs are
+   never returned to malloc. pool_tcb_get() hands out a zeroed TCB. */
+#define POOL_TCB_SLAB 64
+
+gthread_t *pool_tcb_get(void);
+void pool_tcb_put(gthread_t *t);
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef PREEMPT_H
+#define PREEMPT_H
+
+#include <stdint.h>
+
+struct gworker;
+
+/* Opt-in time slicing. Every worker arms a CLOCK_MONOTONIC timer that sends
+   SIGALRM to its own OS thread once per slice. A green thread that has kept
+   the CPU for a whole slice is switched out from the handler, as long as it
+   is executing program code (not libc or the vDSO), holds no runtime lock
+   and has not called gthread_preempt_disable(). Otherwise the next tick
+   tries again. */
+
+/* Install the handler. Call before the workers start; 0 leaves preemption
+   off. */
+void preempt_init(uint64_t slice_ns);
+int preempt_enabled(void);
+
+/* Create and arm w's timer. Runs on w's own OS thread. */
+void preempt_start(struct gworker *w);
+
+/* Stop the ticks while w blocks with nothing to run, and restart them */
+void preempt_pause(struct gworker *w);
+void preempt_resume(struct gworker *w);
+
+#endif
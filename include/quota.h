@@ -0,0 +1,51 @@
+#ifndef QUOTA_H
+#define QUOTA_H
+
+#include "gthread.h"
+#include "spinlock.h"
+#include <stdint.h>
+
+/* Phase 37: CPU bandwidth pools. Threads attached to a pool draw on its
+   runtime, charged from switch-in to switch-out. Once a period's runtime is
+   used up, each thread of the pool is parked on the timer wheel the next
+   time it would be queued, until the period ends. An overrun is carried as
+   debt into the following periods, so a thread that runs long between
+   switches still averages out at the cap. */
+
+struct gquota {
+  gspinlock_t lock;
+  uint64_t runtime_ns;
+  uint64_t period_ns;
+  uint64_t period_end; /* CLOCK_MONOTONIC */
+  uint64_t used;       /* In this period, debt included */
+
+  /* Dashboard counters */
+  uint64_t total_ns;  /* CPU charged, ever */
+  uint64_t throttles; /* Threads parked, ever */
+  int nr_threads;
+  int nr_throttled; /* Parked right now */
+
+  int refs; /* The creator's and one per attached thread */
+  int id;
+  char name[GTHREAD_NAME_MAX];
+  struct gquota *next; /* All pools */
+};
+
+/* Add ns of CPU used by a thread of q */
+void quota_charge(gquota_t *q, uint64_t ns);
+
+/* End of the current period if q has nothing left in it, else 0 */
+uint64_t quota_exhausted(gquota_t *q, uint64_t now);
+
+/* Attach t (which must not be running elsewhere) to q, or detach it with
+   NULL */
+void quota_attach(gthread_t *t, gquota_t *q);
+
+/* Throttle bookkeeping, for the scheduler */
+void quota_throttled(gquota_t *q);
+void quota_unthrottled(gquota_t *q);
+
+/* Every pool, under the pool list lock: fn must not block */
+void quota_for_each(void (*fn)(gquota_t *q, void *arg), void *arg);
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef RBTREE_H
+#define RBTREE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Intrusive red-black tree ordered by a 64-bit key kept in the node, so
+   comparisons never leave the tree. Equal keys keep insertion order. The
+   first and last nodes are cached: peeking at either end is O(1), insert
+   and erase O(log n). Not thread-safe: the owner locks around it. */
+
+typedef struct rb_node {
+  struct rb_node *parent;
+  struct rb_node *left;
+  struct rb_node *right;
+  uint64_t key;
+  int red;
+} rb_node_t;
+
+typedef struct {
+  rb_node_t *root;
+  rb_node_t *first; // Smallest key
+  rb_node_t *last;  // Largest key
+  int count;
+} rb_tree_t;
+
+#define rb_entry(ptr, type, member)                                            \
+  ((type *)((char *)(ptr) - offsetof(type, member)))
+
+/* Link n, whose key is already set */
+void rb_insert(rb_tree_t *t, rb_node_t *n);
+void rb_erase(rb_tree_t *t, rb_node_t *n);
+
+/* In-order neighbours, NULL at either end */
+rb_node_t *rb_next(const rb_node_t *n);
+rb_node_t *rb_prev(const rb_node_t *n);
+
+#endif
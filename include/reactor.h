@@ -0,0 +1,43 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include "gthread.h"
+#include <stdint.h>
+
+/* epoll reactor. Each fd is registered once, edge-triggered, for both
+   directions; waiters hang off a per-fd slot so a wakeup only touches the
+   fds that actually fired. */
+
+void reactor_init(int nworkers);
+
+/* Wake the poller while fd is readable (level-triggered). No thread waits
+   on it; its owner drains it from its own scheduler hook. */
+void reactor_watch(int fd);
+
+/* Park t on fd until one of events (POLLIN/POLLOUT) fires, or (Phase 41)
+   until deadline_ns if non-zero. Returns 1 if t was queued and must now
+   schedule away, 0 if readiness was already latched (or the fd cannot be
+   watched) and the caller should just retry. */
+int reactor_arm(gthread_t *t, int fd, int events, uint64_t deadline_ns);
+
+/* Phase 41: After a wait armed with a deadline: 1 if the deadline woke t,
+   which is then taken off fd */
+int reactor_timed_out(gthread_t *t, int fd);
+
+/* Dispatch ready fds, waiting up to timeout_ns (-1 = forever, 0 = just
+   check). Sub-millisecond timeouts use epoll_pwait2, or a timerfd in the
+   epoll set on older kernels. Woken threads are queued on the calling
+   worker. Returns the number of threads woken. */
+int reactor_poll(int64_t timeout_ns);
+
+/* Interrupt a reactor_poll blocked on another worker */
+void reactor_wake(void);
+
+/* Threads currently parked on fds */
+int reactor_waiters(void);
+
+/* Drop fd's registration and wake its waiters (before close, or when the
+   number is reused). Optional: a wait re-adds an fd the kernel dropped. */
+void reactor_forget_fd(int fd);
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+#include "gthread.h"
+
+/* Thread registry: a slot table from thread ids to live TCBs. An id is
+   (generation << 32) | slot. Slots are reused once their thread is reaped,
+   and the generation, bumped on every reuse, makes a stale id miss instead
+   of finding the slot's next occupant. The table is as big as the most
+   threads ever alive at once, not the most ever created. Generations wrap
+   at 20 bits so ids survive a round trip through a JavaScript number. */
+
+#define REGISTRY_SLOT_BITS 32
+#define REGISTRY_GEN_BITS 20
+#define REGISTRY_INITIAL 64
+
+/* Give t a slot and its id. -1 when out of memory. */
+int registry_add(gthread_t *t);
+
+/* Drop one reference to a terminated thread: its exit (once its stack is
+   released) or its joiners (once they have read retval). The last one
+   unlinks it and returns the TCB to the slab. */
+void registry_release(gthread_t *t);
+
+/* Lookups need the lock; a TCB found under it stays valid until it is
+   dropped. Iteration takes it itself: fn must not block or yield. */
+void registry_lock(void);
+void registry_unlock(void);
+gthread_t *registry_find(uint64_t id);
+void registry_for_each(void (*fn)(gthread_t *t, void *arg), void *arg);
+
+#endif
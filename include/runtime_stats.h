@@ -1,20 +1,24 @@
 #ifndef RUNTIME_STATS_H
 #define RUNTIME_STATS_H
 
+#include "gthread.h"
 #include <stddef.h>
+#include <stdint.h>
 
 // Stack Stats
 typedef struct {
-  int tid;
+  uint64_t tid;
   size_t stack_size;
   size_t stack_used;
   size_t stack_remaining;
   void *current_sp;
+  size_t stack_high_water; // Phase 31: Deepest use seen
+  size_t stack_reclaimed;  // Phase 31: Released while blocked
 } stack_stats_t;
 
 // IO Stats
 typedef struct {
-  int tid;
+  uint64_t tid;
   int waiting_fd;
   long wait_time_ms; // Duration waiting
 } io_stats_t;
@@ -26,13 +30,52 @@ typedef struct {
   int waiting_count;
   long ctx_switches_per_sec;
   long scheduler_ticks;
+  // Phase 31: Idle stack reclaim, all threads
+  unsigned long stack_bytes_reclaimed;
+  unsigned long stack_reclaims;
 } runtime_metrics_t;
 
-// APIs
-stack_stats_t runtime_get_stack_stats(int tid);
-io_stats_t runtime_get_io_stats(int tid);
+// Phase 37: CPU bandwidth pool (gquota_create)
+typedef struct {
+  int id;
+  char name[GTHREAD_NAME_MAX];
+  uint64_t runtime_ns;
+  uint64_t period_ns;
+  uint64_t used_ns;   // In the current period; above runtime_ns while in debt
+  uint64_t total_ns;  // CPU charged, ever: sample twice for a rate
+  uint64_t throttles; // Threads parked, ever
+  int threads;
+  int throttled; // Parked right now
+} quota_stats_t;
+
+// Phase 38: Scheduling group (ggroup_create)
+typedef struct {
+  int id;
+  int parent; // -1 for a top-level group
+  char name[GTHREAD_NAME_MAX];
+  int tickets;
+  long active;     // Tickets of runnable members and busy subgroups
+  int threads;     // Direct members
+  uint64_t cpu_ns; // Used by members and subgroups, ever: sample for a rate
+} group_stats_t;
+
+// APIs. Phase 33: tids are registry ids; O(1), and a reaped thread's id
+// matches nothing.
+stack_stats_t runtime_get_stack_stats(uint64_t tid);
+io_stats_t runtime_get_io_stats(uint64_t tid);
 runtime_metrics_t runtime_get_metrics(void);
-void runtime_set_tickets(int tid, int tickets);
-int runtime_get_tickets(int tid);
+void runtime_set_tickets(uint64_t tid, int tickets);
+int runtime_get_tickets(uint64_t tid);
+
+// Phase 37: Up to max pools into out; returns how many
+int runtime_get_quota_stats(quota_stats_t *out, int max);
+
+// Phase 38: Up to max groups into out, parents first; returns how many.
+// Tickets by group id: -1 if there is no such group.
+int runtime_get_group_stats(group_stats_t *out, int max);
+int runtime_set_group_tickets(int id, int tickets);
+
+// For use inside gthread_for_each, which already holds the registry lock
+stack_stats_t runtime_get_thread_stack_stats(gthread_t *t);
 
 #endif
@@ -2,17 +2,121 @@
 #define SCHEDULER_H
 
 #include "gthread.h"
+#include "rbtree.h"
+#include "spinlock.h"
+#include <pthread.h>
+#include <time.h>
+
+#define HEAP_INITIAL_CAPACITY 64
+#define MAX_WORKERS 64
+
+/* Poll the reactor at least every N switches / after this long */
+#define IO_POLL_EVERY_DEFAULT 64
+#define IO_POLL_BUDGET_DEFAULT 1000000ULL
+
+/* Stack reclaim: blocked this long, and a busy worker looks every N
+   switches */
+#define RECLAIM_IDLE_DEFAULT 1000000000ULL
+#define RECLAIM_POLL_EVERY 1024
+
+/* Time accounting: a stride per 2^ACCOUNT_SHIFT ns (about 1 us) of CPU */
+#define ACCOUNT_SHIFT 10
+
+/* Phase 30: Ready heap slot. The pass is copied in so sifting compares
+   keys without loading the TCB. */
+typedef struct {
+  uint64_t pass;
+  gthread_t *thread;
+} heap_entry_t;
+
+/* Per-worker scheduler state (M:N mode). Each worker is one OS thread with
+   its own stride heap; idle workers steal from the others. */
+typedef struct gworker {
+  int id;
+  pthread_t os_thread;
+  gthread_t *current;
+  gthread_t *prev;   /* Thread we switched away from, released post-switch */
+  gthread_t idle;    /* Idle context: waits for IO/timers and steals */
+
+  gspinlock_t rq_lock;
+  heap_entry_t *ready_heap; /* Stride class, grows on demand */
+  int heap_size;
+  int heap_capacity;
+
+  /* Phase 36: Queues of the other policy classes (policy.h), and the
+     number of threads queued in all of them */
+  rb_tree_t cfs_rq;
+  rb_tree_t edf_rq;
+  int nr_ready;
+
+  int io_switches;     /* Switches since the last reactor poll */
+  uint64_t io_poll_ns; /* When it happened (with a time budget set) */
+
+  /* Phase 26: Preemption */
+  int switching;         /* Mid-switch: the handler must keep out */
+  uint64_t switches;     /* Context switches so far */
+  uint64_t preempt_mark; /* `switches` at the previous tick */
+  timer_t preempt_timer;
+  int preempt_armed;
+
+  /* Phase 29: Shared stack (copy-stack mode) */
+  void *shared_stack;
+  size_t shared_size;
+  gthread_t *stack_owner; /* Whose frames are live on it */
+  gthread_t copier;       /* Swaps images between two shared threads */
+  gthread_t *copy_next;
+
+  /* Phase 31: `switches` when this worker last offered a stack sweep */
+  uint64_t reclaim_mark;
+
+  /* Phase 34: Virtual time of this heap: the lowest pass dispatched so far.
+     Threads joining the heap are placed relative to it. */
+  uint64_t vtime;
+
+  /* Phase 35: When the current thread was switched in (time accounting) */
+  uint64_t run_start_ns;
+} gworker_t;
 
 /* Global scheduler state */
-extern gthread_t *g_current_thread;
-extern gthread_t *g_ready_queue_head;
-extern gthread_t *g_ready_queue_tail;
 extern gthread_t g_main_thread;
+extern int g_nworkers;
+
+/* Worker the calling OS thread is running. Re-read after every switch: a
+   green thread may resume on a different worker. */
+gworker_t *scheduler_worker(void);
+#define g_current_thread (scheduler_worker()->current)
 
 /* Internal functions */
+void scheduler_init(int nworkers, size_t shared_stack);
 void scheduler_schedule(void);
+void scheduler_finish_switch(void);
 void scheduler_enqueue(gthread_t *t);
-void scheduler_enqueue_sleep(gthread_t *t);
+void scheduler_enqueue_locked(gthread_t *t);
+void scheduler_kick(int woken);
+void scheduler_enqueue_list(gthread_t *t);
+int scheduler_remove(gthread_t *t);
+void scheduler_set_pass(gthread_t *t, uint64_t pass);
+void scheduler_set_tickets(gthread_t *t, int tickets);
+void scheduler_set_accounting(int mode);
+void scheduler_set_deadline(uint64_t deadline_ns);
+void scheduler_enqueue_sleep(gthread_t *t, uint64_t deadline_ns);
 void scheduler_register_io_wait(int fd, int events);
 
+/* Phase 41: Timed waits (see gthread_t.timed_wait). A thread parks on a
+   wait object and, under the object's lock, arms a timeout with
+   scheduler_block_timeout. Wakers must then win scheduler_claim_wakeup
+   before queueing it; the timer claims it too, and sets
+   TIMED_WAIT_EXPIRED for the thread to find when it runs. */
+#define TIMED_WAIT_NONE 0
+#define TIMED_WAIT_ARMED 1
+#define TIMED_WAIT_EXPIRED 2
+void scheduler_block_timeout(gthread_t *t, uint64_t deadline_ns);
+int scheduler_claim_wakeup(gthread_t *t);
+/* Wait for fd until deadline_ns (0: forever). -1 on timeout. */
+int scheduler_wait_io_until(int fd, int events, uint64_t deadline_ns);
+void scheduler_set_io_poll(int every_switches, uint64_t budget_ns);
+void scheduler_preempt(gworker_t *w);
+uint64_t scheduler_shared_stack_top(gthread_t *t);
+void scheduler_set_stack_reclaim(uint64_t idle_ns);
+
 #endif
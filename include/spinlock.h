@@ -0,0 +1,53 @@
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+
+/* Test-and-test-and-set spinlock for scheduler state shared between workers.
+   Critical sections are a few pointer updates, so spinning is cheaper than
+   parking the OS thread. Never hold one across scheduler_schedule(). */
+
+/* Phase 26: Locks held by this OS thread. The preemption handler leaves the
+   thread alone while it is non-zero: the next green thread on this OS thread
+   could spin forever on a lock its owner cannot release. */
+extern __thread int g_nopreempt;
+
+static inline void gpreempt_off(void) {
+  g_nopreempt++;
+  __atomic_signal_fence(__ATOMIC_SEQ_CST);
+}
+
+static inline void gpreempt_on(void) {
+  __atomic_signal_fence(__ATOMIC_SEQ_CST);
+  g_nopreempt--;
+}
+
+typedef struct {
+  int locked;
+} gspinlock_t;
+
+#define GSPINLOCK_INIT {0}
+
+static inline void gspin_init(gspinlock_t *l) { l->locked = 0; }
+
+static inline void gspin_lock(gspinlock_t *l) {
+  gpreempt_off();
+  while (__atomic_exchange_n(&l->locked, 1, __ATOMIC_ACQUIRE)) {
+    while (__atomic_load_n(&l->locked, __ATOMIC_RELAXED))
+      __builtin_ia32_pause();
+  }
+}
+
+static inline int gspin_trylock(gspinlock_t *l) {
+  gpreempt_off();
+  if (!__atomic_load_n(&l->locked, __ATOMIC_RELAXED) &&
+      !__atomic_exchange_n(&l->locked, 1, __ATOMIC_ACQUIRE))
+    return 1;
+  gpreempt_on();
+  return 0;
+}
+
+static inline void gspin_unlock(gspinlock_t *l) {
+  __atomic_store_n(&l->locked, 0, __ATOMIC_RELEASE);
+  gpreempt_on();
+}
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef STACK_H
+#define STACK_H
+
+#include "gthread.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* Thread stacks are private mmap reservations with a PROT_NONE guard at the
+   low end. The kernel commits pages on first touch, so a thread pays RSS
+   only for the depth it has reached, and running into the guard is reported
+   instead of corrupting whatever lies below. */
+
+#define STACK_GUARD_SIZE GTHREAD_GUARD_DEFAULT
+
+/* Reserve size bytes, a guard of `guard` bytes included (page multiples).
+   Returns the base or NULL.
+
+   A guarded stack is two VMAs, and at vm.max_map_count (65530 by default)
+   every mmap, malloc included, fails. So guards are only given while fewer
+   than 3/4 of that limit's worth of stacks are live (~24k by default);
+   later stacks, and any whose mprotect gets ENOMEM, come back without one
+   (warned once on stderr). Those merge with their unguarded neighbours, so
+   creation keeps working well past 100k threads, but their overflows are
+   not caught. Raise vm.max_map_count to keep more stacks guarded. */
+void *stack_map(size_t size, size_t guard);
+void stack_unmap(void *base, size_t size);
+
+/* Phase 31: Release the resident pages of a stack between its guard and
+   sp, the saved stack pointer of a thread that is not running. Raises *high_water (bytes
+   from the top) to the deepest resident page found, and returns the bytes
+   given back. MADV_DONTNEED rather than MADV_FREE: RSS drops immediately,
+   and a later touch gets a zero page either way. */
+size_t stack_reclaim(void *base, size_t size, size_t guard, uint64_t sp,
+                     size_t *high_water);
+void stack_reclaim_totals(uint64_t *bytes, uint64_t *count);
+
+/* Per OS thread: install the alternate signal stack the overflow handler
+   runs on (and the handler itself, once). */
+void stack_thread_init(void);
+
+#endif
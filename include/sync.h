@@ -2,25 +2,126 @@
 #define SYNC_H
 
 #include "gthread.h"
+#include "spinlock.h"
 
-/* Mutex */
+/* Phase 39: FIFO of blocked threads, linked through t->next. The tail
+   makes appending O(1). */
+typedef struct {
+  gthread_t *head;
+  gthread_t *tail;
+} gwaitq_t;
+
+/* Mutex. Phase 39: Unlock hands the lock straight to the first waiter,
+   which wakes up owning it: nobody can barge in while it is on its way,
+   and waiters get the lock in the order they asked for it. */
 typedef struct {
   int locked;
-  gthread_t *wait_queue; // Queue of blocked threads
+  gthread_t *owner;      // Holder, or the waiter it was handed to
+  gwaitq_t wait_queue;   // Queue of blocked threads
+  int barge_limit;       // 0: strict handoff (see gmutex_set_barging)
+  gthread_t *waking;     // Waiter woken to compete, until it runs
+  int barges;            // Times the lock went to someone else since the
+                         // first waiter started competing
+  gspinlock_t guard;     // Protects the above across workers
 } gmutex_t;
 
 void gmutex_init(gmutex_t *m);
 void gmutex_lock(gmutex_t *m);
 void gmutex_unlock(gmutex_t *m);
 
-/* Condition Variable */
+/* Phase 41: gmutex_lock, giving up at deadline_ns (CLOCK_MONOTONIC, see
+   gthread_now_ns). 0 once locked, -1 if the deadline passed first; a
+   deadline already past just tries. */
+int gmutex_timedlock(gmutex_t *m, uint64_t deadline_ns);
+
+/* Phase 39: Bounded barging, for throughput. Unlock frees the lock and
+   wakes the first waiter to compete for it, so a running thread can take
+   it meanwhile instead of queueing behind a thread that is not running
+   yet. Once other threads have taken it `limit` times since that waiter
+   was first woken, it is handed the lock, so no waiter is passed over
+   more than `limit` times. 0 (the default) hands off every time. */
+void gmutex_set_barging(gmutex_t *m, int limit);
+
+/* Condition Variable. Phase 40: Signal and broadcast move waiters onto
+   the mutex they wait with, and each returns from gcond_wait the one time
+   it is switched in, owning it. Threads waiting at the same time must use
+   the same mutex. */
 typedef struct {
-  gthread_t *wait_queue;
+  gwaitq_t wait_queue;
+  gmutex_t *mutex; // Of the latest wait
+  int nr_timed;    // Phase 41: Timed waits in progress
+  gspinlock_t guard;
 } gcond_t;
 
 void gcond_init(gcond_t *c);
 void gcond_wait(gcond_t *c, gmutex_t *m);
+
+/* Phase 41: gcond_wait until deadline_ns at the latest. 0 if signalled, -1
+   on timeout; m is held again either way. */
+int gcond_timedwait(gcond_t *c, gmutex_t *m, uint64_t deadline_ns);
 void gcond_signal(gcond_t *c);
 void gcond_broadcast(gcond_t *c);
 
+/* Phase 42: Reader-writer lock. Writer-preferring: once a writer waits,
+   new readers queue behind it. Its unlock then admits every queued reader
+   as one batch, ahead of the next writer, so readers cannot starve either.
+   Waiters wake up holding the lock. */
+typedef struct {
+  int readers;          // Read holders, admitted batches included
+  gthread_t *writer;    // Write holder, or the writer it was handed to
+  gwaitq_t read_queue;  // Readers waiting for the current write to end
+  gwaitq_t write_queue;
+  gspinlock_t guard;
+} grwlock_t;
+
+void grwlock_init(grwlock_t *rw);
+void grwlock_rdlock(grwlock_t *rw);
+void grwlock_wrlock(grwlock_t *rw);
+// 0 if taken, -1 if it would block
+int grwlock_tryrdlock(grwlock_t *rw);
+int grwlock_trywrlock(grwlock_t *rw);
+// Releases the write lock if the caller holds it, else a read share
+void grwlock_unlock(grwlock_t *rw);
+
+/* Phase 42: Counting semaphore. gsem_post hands its permit to the first
+   waiter, FIFO, instead of raising the count. */
+typedef struct {
+  int count;
+  gwaitq_t wait_queue;
+  gspinlock_t guard;
+} gsem_t;
+
+void gsem_init(gsem_t *s, int count);
+void gsem_wait(gsem_t *s);
+int gsem_trywait(gsem_t *s); // 0 if it took a permit, -1 if none was left
+void gsem_post(gsem_t *s);
+
+/* Phase 42: Cyclic barrier for `parties` threads. The last to arrive wakes
+   the rest in one batch and carries on without blocking; the barrier can
+   be reused at once. */
+typedef struct {
+  int parties;
+  int arrived; // This round
+  gwaitq_t wait_queue;
+  gspinlock_t guard;
+} gbarrier_t;
+
+void gbarrier_init(gbarrier_t *b, int parties);
+// 1 in the thread that completed the round, 0 in the others
+int gbarrier_wait(gbarrier_t *b);
+
+/* Phase 42: Wait group, for fan-in: add before starting work, done when
+   it finishes, and wait returns once the count is back to 0. A negative
+   count is a fatal error. */
+typedef struct {
+  int count;
+  gwaitq_t wait_queue;
+  gspinlock_t guard;
+} gwaitgroup_t;
+
+void gwaitgroup_init(gwaitgroup_t *wg);
+void gwaitgroup_add(gwaitgroup_t *wg, int delta);
+void gwaitgroup_done(gwaitgroup_t *wg);
+void gwaitgroup_wait(gwaitgroup_t *wg);
+
 #endif
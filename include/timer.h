@@ -0,0 +1,54 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+
+/* Hierarchical timer wheel: 5 levels of 64 slots over 10 us ticks, so
+   level 0 spans 640 us and level 4 about 3 hours (farther deadlines are
+   parked in the last slot and re-filed). Insert and cancel are O(1); expiry
+   is O(expired + cascaded). Not thread-safe: the owner locks around it. */
+
+#define TIMER_TICK_NS 10000ULL
+#define TIMER_LEVELS 5
+#define TIMER_SLOT_BITS 6
+#define TIMER_SLOTS (1 << TIMER_SLOT_BITS)
+
+#define TIMER_NEVER UINT64_MAX
+
+/* Embedded in whatever is waiting (see gthread_t.timer) */
+typedef struct gtimer {
+  uint64_t deadline_ns; // CLOCK_MONOTONIC
+  uint64_t expires;     // Tick it fires on, never before deadline_ns
+  struct gtimer *next;
+  struct gtimer **pprev; // NULL when not armed
+  uint8_t level;         // TIMER_LEVELS = due list
+  uint8_t slot;
+} gtimer_t;
+
+typedef struct {
+  uint64_t now; // Last tick processed
+  uint64_t occupied[TIMER_LEVELS];
+  gtimer_t *slots[TIMER_LEVELS][TIMER_SLOTS];
+  gtimer_t *due; // Added with a deadline already behind `now`
+  int count;
+} timer_wheel_t;
+
+void timer_wheel_init(timer_wheel_t *w, uint64_t now_ns);
+
+/* Arm t for t->deadline_ns */
+void timer_add(timer_wheel_t *w, gtimer_t *t);
+
+/* Disarm t. No-op if it is not armed. */
+void timer_cancel(timer_wheel_t *w, gtimer_t *t);
+
+static inline int timer_armed(const gtimer_t *t) { return t->pprev != 0; }
+
+/* Advance to now_ns and unlink every timer that is due. Returns them as a
+   list through ->next. */
+gtimer_t *timer_expire(timer_wheel_t *w, uint64_t now_ns);
+
+/* Earliest time timer_expire may have work to do, or TIMER_NEVER. For far
+   timers this is the cascade point, which is never later than the deadline. */
+uint64_t timer_next_ns(const timer_wheel_t *w);
+
+#endif
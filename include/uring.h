@@ -0,0 +1,39 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+/* Completion-based IO through a single io_uring shared by all workers.
+   Operations queue an SQE and park the calling green thread; the scheduler
+   submits everything queued in one io_uring_enter per pass and resumes each
+   thread with its CQE result. */
+
+/* Set up the ring. Returns 0, or -1 if the kernel lacks what we need (the
+   caller then stays on the epoll reactor). */
+int uring_init(void);
+int uring_enabled(void);
+
+/* Same contract as read(2)/write(2)/accept(2): -1 with errno on failure */
+ssize_t uring_read(int fd, void *buf, size_t count);
+ssize_t uring_write(int fd, const void *buf, size_t count);
+int uring_accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen);
+
+/* Phase 41: The same, cancelled at deadline_ns (CLOCK_MONOTONIC) with
+   errno ETIMEDOUT; 0 waits forever */
+ssize_t uring_read_until(int fd, void *buf, size_t count,
+                         uint64_t deadline_ns);
+int uring_accept_until(int sockfd, struct sockaddr *addr, socklen_t *addrlen,
+                       uint64_t deadline_ns);
+
+/* Scheduler hook, run on every scheduling decision. Reaps completions and
+   submits queued SQEs once the caller is idle or the batch is due. Returns
+   the number of threads woken. */
+int uring_poll(int idle);
+
+/* Operations queued or in flight */
+int uring_inflight(void);
+
+#endif
@@ -0,0 +1,385 @@
+#include "chan.h"
+#include "scheduler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHAN_MIN_SLOTS 16 // Unbounded rings start here and double
+#define SELECT_LOCAL 4    // Cases whose waiters fit on the caller's stack
+
+static __thread unsigned select_seed = 1;
+
+gchan_t *gchan_create(size_t elem_size, size_t capacity) {
+  gchan_t *ch = calloc(1, sizeof(gchan_t));
+  if (!ch)
+    return NULL;
+  gspin_init(&ch->lock);
+  ch->elem_size = elem_size;
+  ch->capacity = capacity;
+  ch->slots = capacity == GCHAN_UNBOUNDED ? CHAN_MIN_SLOTS : capacity;
+  if (ch->slots && elem_size) {
+    ch->buf = malloc(ch->slots * elem_size);
+    if (!ch->buf) {
+      free(ch);
+      return NULL;
+    }
+  }
+  return ch;
+}
+
+void gchan_destroy(gchan_t *ch) {
+  if (!ch)
+    return;
+  free(ch->buf);
+  free(ch);
+}
+
+/* src NULL zeroes dst; dst NULL discards */
+static void chan_copy(void *dst, const void *src, size_t size) {
+  if (!dst || !size)
+    return;
+  if (src)
+    memcpy(dst, src, size);
+  else
+    memset(dst, 0, size);
+}
+
+/* Ring buffer. Caller holds ch->lock. */
+static void *ring_slot(gchan_t *ch, size_t i) {
+  return ch->buf + ((ch->head + i) % ch->slots) * ch->elem_size;
+}
+
+static int ring_has_room(gchan_t *ch) {
+  return ch->capacity == GCHAN_UNBOUNDED || ch->count < ch->capacity;
+}
+
+static void ring_grow(gchan_t *ch) {
+  char *buf = ch->elem_size ? malloc(ch->slots * 2 * ch->elem_size) : NULL;
+  if (ch->elem_size && !buf) {
+    fprintf(stderr, "Channel: Out of memory growing buffer\n");
+    exit(1);
+  }
+  for (size_t i = 0; i < ch->count; i++)
+    chan_copy(buf + i * ch->elem_size, ring_slot(ch, i), ch->elem_size);
+  free(ch->buf);
+  ch->buf = buf;
+  ch->slots *= 2;
+  ch->head = 0;
+}
+
+static void ring_push(gchan_t *ch, const void *elem) {
+  if (ch->count == ch->slots)
+    ring_grow(ch); // Unbounded only: a bounded ring was checked for room
+  chan_copy(ring_slot(ch, ch->count), elem, ch->elem_size);
+  ch->count++;
+}
+
+static void ring_pop(gchan_t *ch, void *elem) {
+  chan_copy(elem, ring_slot(ch, 0), ch->elem_size);
+  ch->head = (ch->head + 1) % ch->slots;
+  ch->count--;
+}
+
+/* Waiter queues. Caller holds the channel's lock. */
+static void waitq_push(chan_waitq_t *q, chan_waiter_t *w) {
+  w->next = NULL;
+  w->prev = q->last;
+  if (q->last)
+    q->last->next = w;
+  else
+    q->first = w;
+  q->last = w;
+  w->linked = 1;
+}
+
+static void waitq_remove(chan_waitq_t *q, chan_waiter_t *w) {
+  if (w->prev)
+    w->prev->next = w->next;
+  else
+    q->first = w->next;
+  if (w->next)
+    w->next->prev = w->prev;
+  else
+    q->last = w->prev;
+  w->next = w->prev = NULL;
+  w->linked = 0;
+}
+
+/* First waiter on q that we can complete. The others are dropped: their
+   select fired on another channel, or their timeout did (Phase 41). */
+static chan_waiter_t *chan_claim(chan_waitq_t *q) {
+  chan_waiter_t *w;
+  while ((w = q->first)) {
+    waitq_remove(q, w);
+    chan_sel_t *sel = w->sel;
+    int idle = 0;
+    if (__atomic_compare_exchange_n(&sel->done, &idle, 1, 0, __ATOMIC_ACQ_REL,
+                                    __ATOMIC_RELAXED) &&
+        (!sel->timed || scheduler_claim_wakeup(sel->thread)))
+      return w;
+  }
+  return NULL;
+}
+
+// w's operation is complete: its thread, for the caller to wake
+static gthread_t *chan_fire(chan_waiter_t *w, int ok) {
+  chan_sel_t *sel = w->sel;
+  sel->fired = w->index;
+  sel->ok = ok;
+  return sel->thread;
+}
+
+/* Complete op on ch now if it can be, under ch->lock. A parked peer is
+   served directly: a value goes straight from sender to receiver, and
+   the peer comes back in *wake to be made ready. 0 if op would block. */
+static int chan_try(gchan_t *ch, int op, void *elem, int *ok,
+                    gthread_t **wake) {
+  chan_waiter_t *w;
+  if (op == GCHAN_SEND) {
+    if (ch->closed) {
+      *ok = 0;
+      return 1;
+    }
+    if ((w = chan_claim(&ch->recvq))) {
+      chan_copy(w->elem, elem, ch->elem_size);
+      *wake = chan_fire(w, 1);
+    } else if (ring_has_room(ch)) {
+      ring_push(ch, elem);
+    } else {
+      return 0;
+    }
+    *ok = 1;
+    return 1;
+  }
+
+  if (ch->count) {
+    ring_pop(ch, elem);
+    // A sender blocked on the full ring takes the freed slot, in order
+    if ((w = chan_claim(&ch->sendq))) {
+      ring_push(ch, w->elem);
+      *wake = chan_fire(w, 1);
+    }
+  } else if ((w = chan_claim(&ch->sendq))) {
+    chan_copy(elem, w->elem, ch->elem_size);
+    *wake = chan_fire(w, 1);
+  } else if (ch->closed) {
+    chan_copy(elem, NULL, ch->elem_size);
+    *ok = 0;
+    return 1;
+  } else {
+    return 0;
+  }
+  *ok = 1;
+  return 1;
+}
+
+/* Lock every channel of a select once, in address order, so two selects
+   over the same channels cannot deadlock. Returns how many. */
+static int select_lock(gchan_case_t *cases, int n, gchan_t **locks) {
+  int nlocks = 0;
+  for (int i = 0; i < n; i++) {
+    gchan_t *ch = cases[i].ch;
+    if (!ch)
+      continue;
+    int j = nlocks;
+    while (j > 0 && locks[j - 1] > ch)
+      j--;
+    if (j > 0 && locks[j - 1] == ch)
+      continue;
+    memmove(&locks[j + 1], &locks[j], (nlocks - j) * sizeof(gchan_t *));
+    locks[j] = ch;
+    nlocks++;
+  }
+  for (int i = 0; i < nlocks; i++)
+    gspin_lock(&locks[i]->lock);
+  return nlocks;
+}
+
+static void select_unlock(gchan_t **locks, int nlocks) {
+  for (int i = nlocks - 1; i >= 0; i--)
+    gspin_unlock(&locks[i]->lock);
+}
+
+static chan_waitq_t *case_queue(gchan_case_t *c) {
+  return c->op == GCHAN_SEND ? &c->ch->sendq : &c->ch->recvq;
+}
+
+int gchan_select(gchan_case_t *cases, int n, int64_t timeout_ns) {
+  if (n > GCHAN_SELECT_MAX) {
+    fprintf(stderr, "Channel: More than %d select cases\n", GCHAN_SELECT_MAX);
+    exit(1);
+  }
+  gthread_t *cur = g_current_thread;
+  uint64_t deadline = timeout_ns > 0 ? gthread_now_ns() + timeout_ns : 0;
+
+  /* Peers write into our waiters (and, through them, into our values)
+     while we are parked. A thread on a shared stack (Phase 29) has its
+     frames copied out then, so its waiters and values go on the heap. */
+  chan_sel_t local_sel;
+  chan_waiter_t local_waiters[SELECT_LOCAL];
+  chan_sel_t *sel = &local_sel;
+  chan_waiter_t *waiters = local_waiters;
+  char *bounce = NULL;
+  void *heap = NULL;
+  if (timeout_ns != 0 && (cur->home || n > SELECT_LOCAL)) {
+    size_t values = 0;
+    for (int i = 0; cur->home && i < n; i++)
+      if (cases[i].ch)
+        values += cases[i].ch->elem_size;
+    heap = malloc(sizeof(chan_sel_t) + n * sizeof(chan_waiter_t) + values);
+    if (!heap) {
+      fprintf(stderr, "Channel: Out of memory in select\n");
+      exit(1);
+    }
+    sel = heap;
+    waiters = (chan_waiter_t *)(sel + 1);
+    if (cur->home)
+      bounce = (char *)(waiters + n);
+  }
+
+  gchan_t *locks[GCHAN_SELECT_MAX];
+  int nlocks = select_lock(cases, n, locks);
+
+  // Anything ready? Starting from a different case each time, so a busy
+  // channel cannot starve the others.
+  int start = 0;
+  if (n > 1) {
+    select_seed = select_seed * 1103515245 + 12345;
+    start = (int)((select_seed >> 16) % (unsigned)n);
+  }
+  for (int k = 0; k < n; k++) {
+    int i = (start + k) % n;
+    gchan_case_t *c = &cases[i];
+    gthread_t *wake = NULL;
+    if (c->ch && chan_try(c->ch, c->op, c->elem, &c->ok, &wake)) {
+      select_unlock(locks, nlocks);
+      if (wake)
+        scheduler_enqueue(wake); // Runs with its value already in place
+      free(heap);
+      return i;
+    }
+  }
+  if (timeout_ns == 0) {
+    select_unlock(locks, nlocks);
+    return -1;
+  }
+
+  // Park on every channel at once; the first peer to claim sel completes
+  // its case and wakes us
+  sel->thread = cur;
+  sel->done = 0;
+  sel->timed = deadline != 0;
+  sel->fired = -1;
+  sel->ok = 0;
+  char *value = bounce;
+  int parked = 0;
+  for (int i = 0; i < n; i++) {
+    gchan_case_t *c = &cases[i];
+    chan_waiter_t *w = &waiters[i];
+    w->linked = 0;
+    if (!c->ch)
+      continue;
+    w->sel = sel;
+    w->index = i;
+    w->elem = c->elem;
+    if (bounce) {
+      if (c->op == GCHAN_SEND)
+        chan_copy(value, c->elem, c->ch->elem_size);
+      w->elem = c->elem ? value : NULL;
+      value += c->ch->elem_size;
+    }
+    waitq_push(case_queue(c), w);
+    parked++;
+  }
+  cur->state = GTHREAD_BLOCKED;
+  if (deadline)
+    scheduler_block_timeout(cur, deadline);
+  select_unlock(locks, nlocks);
+  scheduler_schedule();
+
+  // Whoever completed a case unlinked its waiter; take the others off
+  int fired = sel->fired;
+  int expired = sel->timed && cur->timed_wait == TIMED_WAIT_EXPIRED;
+  if (parked > 1 || expired) {
+    select_lock(cases, n, locks);
+    for (int i = 0; i < n; i++)
+      if (waiters[i].linked)
+        waitq_remove(case_queue(&cases[i]), &waiters[i]);
+    select_unlock(locks, nlocks);
+  }
+  if (expired) {
+    cur->timed_wait = TIMED_WAIT_NONE;
+    fired = -1;
+  }
+
+  if (fired >= 0) {
+    cases[fired].ok = sel->ok;
+    if (bounce && cases[fired].op == GCHAN_RECV)
+      chan_copy(cases[fired].elem, waiters[fired].elem,
+                cases[fired].ch->elem_size);
+  }
+  free(heap);
+  return fired;
+}
+
+int gchan_send(gchan_t *ch, const void *elem) {
+  gchan_case_t c = {ch, GCHAN_SEND, (void *)elem, 0};
+  gchan_select(&c, 1, -1);
+  return c.ok ? GCHAN_OK : GCHAN_CLOSED;
+}
+
+int gchan_recv(gchan_t *ch, void *elem) {
+  gchan_case_t c = {ch, GCHAN_RECV, elem, 0};
+  gchan_select(&c, 1, -1);
+  return c.ok ? GCHAN_OK : GCHAN_CLOSED;
+}
+
+int gchan_try_send(gchan_t *ch, const void *elem) {
+  gchan_case_t c = {ch, GCHAN_SEND, (void *)elem, 0};
+  if (gchan_select(&c, 1, 0) < 0)
+    return GCHAN_WOULDBLOCK;
+  return c.ok ? GCHAN_OK : GCHAN_CLOSED;
+}
+
+int gchan_try_recv(gchan_t *ch, void *elem) {
+  gchan_case_t c = {ch, GCHAN_RECV, elem, 0};
+  if (gchan_select(&c, 1, 0) < 0)
+    return GCHAN_WOULDBLOCK;
+  return c.ok ? GCHAN_OK : GCHAN_CLOSED;
+}
+
+int gchan_close(gchan_t *ch) {
+  gthread_t *wake = NULL;
+  gthread_t **tail = &wake;
+  gspin_lock(&ch->lock);
+  if (ch->closed) {
+    gspin_unlock(&ch->lock);
+    return -1;
+  }
+  ch->closed = 1;
+
+  // Anyone still parked finds nothing more will come: receivers only wait
+  // on an empty ring, so all of them get GCHAN_CLOSED
+  chan_waiter_t *w;
+  while ((w = chan_claim(&ch->recvq))) {
+    chan_copy(w->elem, NULL, ch->elem_size);
+    *tail = chan_fire(w, 0);
+    tail = &(*tail)->next;
+  }
+  while ((w = chan_claim(&ch->sendq))) {
+    *tail = chan_fire(w, 0);
+    tail = &(*tail)->next;
+  }
+  *tail = NULL;
+  gspin_unlock(&ch->lock);
+
+  scheduler_enqueue_list(wake);
+  return 0;
+}
+
+size_t gchan_len(gchan_t *ch) {
+  gspin_lock(&ch->lock);
+  size_t len = ch->count;
+  gspin_unlock(&ch->lock);
+  return len;
+}
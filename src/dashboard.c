@@ -1,6 +1,8 @@
 #include "dashboard.h"
 #include "gthread.h"
+#include "group.h"
 #include "io.h"
+#include "quota.h"
 #include "runtime_stats.h"
 #include "scheduler.h"
 #include <arpa/inet.h>
@@ -15,6 +17,8 @@
 #include <unistd.h>
 
 #define JSON_BUF_SIZE 131072
+#define MAX_QUOTAS 64
+#define MAX_GROUPS 256
 
 // Removed static json_buf
 
@@ -67,58 +71,150 @@ static void serve_static(int client_fd, const char *path, const char *type) {
 }
 
 // JSON Handler
+typedef struct {
+  char *buf;
+  int offset;
+  int items;
+  int full; // Stop adding once set
+} json_list_t;
+
+// Runs under the registry lock (gthread_for_each)
+static void add_thread(gthread_t *curr, void *arg) {
+  json_list_t *js = arg;
+  if (js->full || js->items >= 500)
+    return;
+
+  if (js->items > 0) {
+    if (js->offset >= JSON_BUF_SIZE - 200) {
+      js->full = 1;
+      return;
+    }
+    js->buf[js->offset++] = ',';
+  }
+
+  // Safe Restoration of Advanced Metrics
+  stack_stats_t ss = runtime_get_thread_stack_stats(curr);
+
+  // Correct snprintf usage to avoid overflow
+  int remaining = JSON_BUF_SIZE - js->offset - 2; // reserve for "]" and null
+  if (remaining <= 0) {
+    js->full = 1;
+    return;
+  }
+
+  int wrote = snprintf(js->buf + js->offset, remaining,
+                       "{\"id\":%lu,\"tickets\":%d,\"pass\":%lu,\"state\":%d,"
+                       "\"stride\":%lu,\"stack_used\":%zu,\"waiting_fd\":%d,"
+                       "\"wake_time\":%lu,\"quota\":%d,\"throttled\":%d,"
+                       "\"group\":%d}",
+                       (unsigned long)curr->id, (int)curr->tickets,
+                       (unsigned long)curr->pass, curr->state,
+                       (unsigned long)curr->stride, ss.stack_used,
+                       curr->waiting_fd, (unsigned long)curr->wake_time_ms,
+                       curr->quota ? curr->quota->id : -1, curr->throttled,
+                       curr->group ? curr->group->id : -1);
+
+  if (wrote < 0 || wrote >= remaining) {
+    // Truncated or error: drop the dangling comma
+    if (js->items > 0)
+      js->offset--;
+    js->full = 1;
+    return;
+  }
+  js->offset += wrote;
+  js->items++;
+
+  // Check global limit
+  if (js->offset >= JSON_BUF_SIZE - 200)
+    js->full = 1;
+}
+
 static void handle_threads(int fd) {
+  char *json_buf = malloc(JSON_BUF_SIZE);
+  if (!json_buf)
+    return;
+
+  json_list_t js = {json_buf, 0, 0, 0};
+  json_buf[js.offset++] = '[';
+  gthread_for_each(add_thread, &js);
+
+  int offset = js.offset;
+  json_buf[offset++] = ']';
+  json_buf[offset] = '\0';
+
+  char hdr[512];
+  snprintf(
+      hdr, sizeof(hdr),
+      "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: "
+      "%d\r\nConnection: close\r\n\r\n",
+      offset);
+  gthread_write(fd, hdr, strlen(hdr));
+  gthread_write(fd, json_buf, offset);
+
+  free(json_buf);
+}
+
+// Phase 37: CPU pools. total_us only ever grows: the page diffs two polls.
+static void handle_quotas(int fd) {
+  quota_stats_t qs[MAX_QUOTAS];
+  int n = runtime_get_quota_stats(qs, MAX_QUOTAS);
+
   char *json_buf = malloc(JSON_BUF_SIZE);
   if (!json_buf)
     return;
 
   int offset = 0;
   json_buf[offset++] = '[';
+  for (int i = 0; i < n; i++) {
+    offset += snprintf(
+        json_buf + offset, JSON_BUF_SIZE - offset,
+        "%s{\"id\":%d,\"name\":\"%s\",\"runtime_us\":%lu,\"period_us\":%lu,"
+        "\"used_us\":%lu,\"total_us\":%lu,\"throttles\":%lu,\"threads\":%d,"
+        "\"throttled\":%d}",
+        i ? "," : "", qs[i].id, qs[i].name,
+        (unsigned long)(qs[i].runtime_ns / 1000),
+        (unsigned long)(qs[i].period_ns / 1000),
+        (unsigned long)(qs[i].used_ns / 1000),
+        (unsigned long)(qs[i].total_ns / 1000), (unsigned long)qs[i].throttles,
+        qs[i].threads, qs[i].throttled);
+  }
+  json_buf[offset++] = ']';
 
-  gthread_t *curr = gthread_get_all_threads();
-  int first = 1;
-  int items = 0;
+  char hdr[512];
+  snprintf(
+      hdr, sizeof(hdr),
+      "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: "
+      "%d\r\nConnection: close\r\n\r\n",
+      offset);
+  gthread_write(fd, hdr, strlen(hdr));
+  gthread_write(fd, json_buf, offset);
 
-  while (curr && items < 500) {
-    if (!first) {
-      if (offset >= JSON_BUF_SIZE - 200)
-        break;
-      json_buf[offset++] = ',';
-    }
-    first = 0;
-
-    // Safe Restoration of Advanced Metrics
-    stack_stats_t ss = runtime_get_stack_stats(curr->id);
-
-    // Correct snprintf usage to avoid overflow
-    int remaining = JSON_BUF_SIZE - offset - 2; // reserve for "]" and null
-    if (remaining <= 0)
-      break;
-
-    int wrote = snprintf(json_buf + offset, remaining,
-                         "{\"id\":%lu,\"tickets\":%d,\"pass\":%lu,\"state\":%d,"
-                         "\"stride\":%lu,\"stack_used\":%zu,\"waiting_fd\":%d,"
-                         "\"wake_time\":%lu}",
-                         (unsigned long)curr->id, (int)curr->tickets,
-                         (unsigned long)curr->pass, curr->state,
-                         (unsigned long)curr->stride, ss.stack_used,
-                         curr->waiting_fd, (unsigned long)curr->wake_time_ms);
-
-    if (wrote < 0 || wrote >= remaining) {
-      // Truncated or error
-      break;
-    }
-    offset += wrote;
+  free(json_buf);
+}
 
-    curr = curr->global_next;
-    items++;
+// Phase 38: Scheduling groups, parents first. cpu_us only ever grows.
+static void handle_groups(int fd) {
+  group_stats_t *gs = malloc(MAX_GROUPS * sizeof(group_stats_t));
+  char *json_buf = malloc(JSON_BUF_SIZE);
+  if (!gs || !json_buf) {
+    free(gs);
+    free(json_buf);
+    return;
+  }
+  int n = runtime_get_group_stats(gs, MAX_GROUPS);
 
-    // Check global limit
-    if (offset >= JSON_BUF_SIZE - 200)
-      break;
+  int offset = 0;
+  json_buf[offset++] = '[';
+  for (int i = 0; i < n; i++) {
+    offset += snprintf(json_buf + offset, JSON_BUF_SIZE - offset,
+                       "%s{\"id\":%d,\"parent\":%d,\"name\":\"%s\","
+                       "\"tickets\":%d,\"active\":%ld,\"threads\":%d,"
+                       "\"cpu_us\":%lu}",
+                       i ? "," : "", gs[i].id, gs[i].parent, gs[i].name,
+                       gs[i].tickets, gs[i].active, gs[i].threads,
+                       (unsigned long)(gs[i].cpu_ns / 1000));
   }
   json_buf[offset++] = ']';
-  json_buf[offset] = '\0';
 
   char hdr[512];
   snprintf(
@@ -130,6 +226,7 @@ static void handle_threads(int fd) {
   gthread_write(fd, json_buf, offset);
 
   free(json_buf);
+  free(gs);
 }
 
 static void handle_client(void *arg) {
@@ -139,7 +236,7 @@ static void handle_client(void *arg) {
   // Read request
   int n = gthread_read(client_fd, buffer, sizeof(buffer) - 1);
   if (n <= 0) {
-    close(client_fd);
+    gthread_close(client_fd);
     return;
   }
 
@@ -153,15 +250,37 @@ static void handle_client(void *arg) {
     serve_static(client_fd, "dashboard.js", "application/javascript");
   } else if (strncmp(buffer, "GET /threads ", 13) == 0) {
     handle_threads(client_fd);
+  } else if (strncmp(buffer, "GET /quotas ", 12) == 0) {
+    handle_quotas(client_fd);
+  } else if (strncmp(buffer, "GET /groups ", 12) == 0) {
+    handle_groups(client_fd);
+  } else if (strncmp(buffer, "POST /group_tickets", 19) == 0) {
+    // Phase 38: Same body as /tickets, with a group id
+    char *body = strstr(buffer, "\r\n\r\n");
+    int id = -1, tix = 10;
+    if (body) {
+      char *id_p = strstr(body + 4, "id=");
+      if (id_p)
+        id = atoi(id_p + 3);
+      char *tix_p = strstr(body + 4, "tickets=");
+      if (tix_p)
+        tix = atoi(tix_p + 8);
+    }
+    const char *msg =
+        runtime_set_group_tickets(id, tix) == 0
+            ? "HTTP/1.1 200 OK\r\nConnection: close\r\n\r\nOK"
+            : "HTTP/1.1 404 Not Found\r\nConnection: close\r\n\r\nNo group";
+    gthread_write(client_fd, msg, strlen(msg));
   } else if (strncmp(buffer, "POST /tickets", 13) == 0) {
     // Parse ID and Tickets
     char *body = strstr(buffer, "\r\n\r\n");
     if (body) {
       body += 4;
-      int id = 0, tix = 10;
+      uint64_t id = 0;
+      int tix = 10;
       char *id_p = strstr(body, "id=");
       if (id_p)
-        id = atoi(id_p + 3);
+        id = strtoull(id_p + 3, NULL, 10);
       char *tix_p = strstr(body, "tickets=");
       if (tix_p)
         tix = atoi(tix_p + 8);
@@ -179,9 +298,13 @@ static void handle_client(void *arg) {
     gthread_write(client_fd, nf, strlen(nf));
   }
 
-  close(client_fd);
+  gthread_close(client_fd);
 }
 
+/* Phase 37: Server and handlers, detached (never joined) and capped
+   together */
+static gthread_attr_t dashboard_attr;
+
 static void dashboard_server_task(void *arg) {
   int port = (int)(long)arg;
   int server_fd;
@@ -220,18 +343,25 @@ static void dashboard_server_task(void *arg) {
   fcntl(server_fd, F_SETFL, flags | O_NONBLOCK);
 
   while (1) {
-    // Wait for connection
-    scheduler_register_io_wait(server_fd, POLLIN);
-
-    int client_sock = accept(server_fd, NULL, NULL);
+    // Wait for connection. Accept until EAGAIN: the reactor is
+    // edge-triggered and will not report a backlog twice.
+    int client_sock = gthread_accept(server_fd, NULL, NULL);
     if (client_sock >= 0) {
       gthread_t *t;
-      gthread_create(&t, handle_client, (void *)(long)client_sock);
+      gthread_create_ex(&t, &dashboard_attr, handle_client,
+                        (void *)(long)client_sock);
     }
   }
 }
 
 void dashboard_start(int port) {
+  gthread_attr_init(&dashboard_attr);
+  dashboard_attr.name = "dashboard";
+  dashboard_attr.detached = 1;
+  dashboard_attr.quota =
+      gquota_create("dashboard", DASHBOARD_QUOTA_NS, DASHBOARD_PERIOD_NS);
+
   gthread_t *t;
-  gthread_create(&t, dashboard_server_task, (void *)(long)port);
+  gthread_create_ex(&t, &dashboard_attr, dashboard_server_task,
+                    (void *)(long)port);
 }
@@ -0,0 +1,165 @@
+#include "group.h"
+#include <stdlib.h>
+#include <string.h>
+
+static ggroup_t *groups = NULL;
+static ggroup_t **groups_tail = &groups;
+static gspinlock_t groups_lock = GSPINLOCK_INIT;
+static int next_id = 0;
+
+ggroup_t *ggroup_create(ggroup_t *parent, const char *name, int tickets) {
+  ggroup_t *g = calloc(1, sizeof(ggroup_t));
+  if (!g)
+    return NULL;
+  gspin_init(&g->lock);
+  g->parent = parent;
+  g->tickets = tickets < 1 ? 1 : tickets;
+  g->refs = 1;
+  strncpy(g->name, name ? name : "GROUP", GTHREAD_NAME_MAX - 1);
+  if (parent)
+    __atomic_add_fetch(&parent->refs, 1, __ATOMIC_RELAXED);
+
+  // Appended, so a parent is always listed before its children
+  gspin_lock(&groups_lock);
+  g->id = next_id++;
+  *groups_tail = g;
+  groups_tail = &g->next;
+  gspin_unlock(&groups_lock);
+  return g;
+}
+
+static void group_put(ggroup_t *g) {
+  while (g && __atomic_sub_fetch(&g->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+    gspin_lock(&groups_lock);
+    ggroup_t **p = &groups;
+    while (*p != g)
+      p = &(*p)->next;
+    *p = g->next;
+    if (groups_tail == &g->next)
+      groups_tail = p;
+    gspin_unlock(&groups_lock);
+
+    // It held a reference to its parent
+    ggroup_t *parent = g->parent;
+    free(g);
+    g = parent;
+  }
+}
+
+void ggroup_destroy(ggroup_t *g) { group_put(g); }
+
+/* g->active changes by delta. A group that turns busy or idle adds its
+   tickets to its parent or takes back what it added, and so on up. The
+   levels are locked one at a time, so a parent can briefly see a child's
+   idle before its busy; both are recorded in `contrib`, so the sums come
+   out right once both have landed. */
+static void group_adjust(ggroup_t *g, int64_t delta) {
+  while (g && delta) {
+    gspin_lock(&g->lock);
+    int was_busy = g->active > 0;
+    g->active += delta;
+    int busy = g->active > 0;
+    delta = 0;
+    if (busy && !was_busy) {
+      g->contrib = g->tickets;
+      delta = g->contrib;
+    } else if (was_busy && !busy) {
+      delta = -(int64_t)g->contrib;
+      g->contrib = 0;
+    }
+    gspin_unlock(&g->lock);
+    g = g->parent;
+  }
+}
+
+int ggroup_set_tickets(ggroup_t *g, int tickets) {
+  if (!g)
+    return -1;
+  if (tickets < 1)
+    tickets = 1;
+
+  gspin_lock(&g->lock);
+  g->tickets = tickets;
+  int64_t delta = 0;
+  if (g->contrib) {
+    delta = tickets - g->contrib;
+    g->contrib = tickets;
+  }
+  gspin_unlock(&g->lock);
+  group_adjust(g->parent, delta);
+  return 0;
+}
+
+/* A thread's weight in its group is what it added to `active` when it
+   became runnable (0 while it is not), so a wake racing with the block
+   before it cannot count it twice. */
+void group_thread_active(gthread_t *t) {
+  int w = (int)t->tickets;
+  int none = 0;
+  if (__atomic_compare_exchange_n(&t->group_weight, &none, w, 0,
+                                  __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+    group_adjust(t->group, w);
+}
+
+void group_thread_inactive(gthread_t *t) {
+  int w = __atomic_exchange_n(&t->group_weight, 0, __ATOMIC_ACQ_REL);
+  if (w)
+    group_adjust(t->group, -w);
+}
+
+void group_thread_retick(gthread_t *t, int tickets) {
+  int w = __atomic_load_n(&t->group_weight, __ATOMIC_ACQUIRE);
+  if (w && __atomic_compare_exchange_n(&t->group_weight, &w, tickets, 0,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+    group_adjust(t->group, tickets - w);
+}
+
+void group_attach(gthread_t *t, ggroup_t *g, int running) {
+  ggroup_t *old = t->group;
+  if (old == g)
+    return;
+
+  if (old) {
+    group_thread_inactive(t);
+    __atomic_sub_fetch(&old->nr_threads, 1, __ATOMIC_RELAXED);
+  }
+  if (g) {
+    __atomic_add_fetch(&g->refs, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&g->nr_threads, 1, __ATOMIC_RELAXED);
+  }
+  t->group = g;
+  t->timed = g || t->quota;
+  if (g && running)
+    group_thread_active(t);
+  if (old)
+    group_put(old);
+}
+
+uint64_t group_stride(gthread_t *t, uint64_t base) {
+  uint64_t stride = base;
+  for (ggroup_t *g = t->group; g; g = g->parent) {
+    // Read without the lock: a stride one transition old is good enough
+    int64_t active = __atomic_load_n(&g->active, __ATOMIC_RELAXED);
+    int tickets = __atomic_load_n(&g->tickets, __ATOMIC_RELAXED);
+    if (active <= 0)
+      continue;
+    unsigned __int128 scaled = (unsigned __int128)stride * (uint64_t)active;
+    scaled /= (uint64_t)tickets;
+    if (scaled > GROUP_MAX_STRIDE)
+      return GROUP_MAX_STRIDE;
+    stride = (uint64_t)scaled;
+  }
+  return stride ? stride : 1;
+}
+
+void group_charge(ggroup_t *g, uint64_t ns) {
+  for (; g; g = g->parent)
+    __atomic_add_fetch(&g->cpu_ns, ns, __ATOMIC_RELAXED);
+}
+
+void group_for_each(void (*fn)(ggroup_t *g, void *arg), void *arg) {
+  gspin_lock(&groups_lock);
+  for (ggroup_t *g = groups; g; g = g->next)
+    fn(g, arg);
+  gspin_unlock(&groups_lock);
+}
@@ -1,22 +1,118 @@
 #include "gthread.h"
+#include "group.h"
+#include "io.h"
 #include "monitor.h"
+#include "policy.h"
+#include "pool.h"
+#include "preempt.h"
+#include "quota.h"
+#include "registry.h"
 #include "scheduler.h"
+#include "stack.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
-
-#define DEFAULT_STACK_SIZE (64 * 1024)
+#include <unistd.h>
 
 extern void gthread_trampoline(void);
 extern void gthread_switch(gthread_ctx_t *new_ctx, gthread_ctx_t *old_ctx);
 
-static uint64_t next_tid = 1;
+static int requested_workers = 0;
+static int64_t requested_slice_ns = -1;
+static size_t requested_shared_stack = 0;
+static int requested_accounting = -1;
+static int requested_policy = -1;
+static int initialized = 0;
+
+/* Guards join queues against a concurrent gthread_exit on another worker */
+static gspinlock_t join_lock = GSPINLOCK_INIT;
+
+void gthread_set_workers(int n) { requested_workers = n; }
+
+int gthread_get_workers(void) { return g_nworkers; }
+
+void gthread_set_preemption(uint64_t slice_ns) {
+  requested_slice_ns = (int64_t)slice_ns;
+}
+
+void gthread_preempt_disable(void) {
+  gthread_t *cur = g_current_thread;
+  if (!cur)
+    return;
+  cur->preempt_count++;
+  __atomic_signal_fence(__ATOMIC_SEQ_CST);
+}
+
+void gthread_preempt_enable(void) {
+  gthread_t *cur = g_current_thread;
+  if (!cur)
+    return;
+  __atomic_signal_fence(__ATOMIC_SEQ_CST);
+  if (--cur->preempt_count == 0 && cur->preempt_pending) {
+    // A tick came and went while we were protected
+    cur->preempt_pending = 0;
+    gthread_yield();
+  }
+}
+
+void gthread_set_stack_cache(int high, int low) { pool_set_limits(high, low); }
+
+void gthread_set_shared_stack(size_t size) { requested_shared_stack = size; }
+
+void gthread_set_stack_reclaim(uint64_t idle_ns) {
+  scheduler_set_stack_reclaim(idle_ns);
+}
+
+void gthread_set_io_poll(int every_switches, uint64_t budget_ns) {
+  scheduler_set_io_poll(every_switches, budget_ns);
+}
+
+void gthread_set_accounting(gthread_account_t mode) {
+  requested_accounting = mode;
+}
+
+void gthread_set_policy(gthread_policy_t policy) { requested_policy = policy; }
+
+void gthread_set_deadline(uint64_t deadline_ns) {
+  if (g_current_thread)
+    scheduler_set_deadline(deadline_ns);
+}
+
+/* Phase 37: Only the caller, so no worker is timing a run of it. The run
+   is timed from here. */
+void gthread_set_quota(gquota_t *q) {
+  gthread_t *cur = g_current_thread;
+  if (!cur)
+    return;
+  cur->run_since = gthread_now_ns();
+  registry_lock();
+  quota_attach(cur, q);
+  registry_unlock();
+}
+
+/* Phase 38: As above. The caller is running, so it counts in g at once. */
+void gthread_set_group(ggroup_t *g) {
+  gthread_t *cur = g_current_thread;
+  if (!cur)
+    return;
+  cur->run_since = gthread_now_ns();
+  registry_lock();
+  group_attach(cur, g, 1);
+  registry_unlock();
+}
 
 void gthread_init(void) {
+  if (initialized)
+    return;
+  initialized = 1;
+
   monitor_init();
-  // Initialize main thread
-  g_main_thread.id = 0;
+  // Phase 28: Overflow reporting for guard-page hits
+  stack_thread_init();
+
+  // Initialize main thread. Phase 33: First registered, so its id is 0.
+  registry_add(&g_main_thread);
   g_main_thread.state = GTHREAD_RUNNING;
   g_main_thread.stack = NULL; // Main uses system stack
   g_main_thread.tickets = 10;
@@ -26,58 +122,169 @@ void gthread_init(void) {
   g_main_thread.monitor_id = monitor_register("MAIN");
   monitor_update_state(g_main_thread.monitor_id, TASK_RUNNABLE);
 
-  // Dashboard #2 Global List
-  g_main_thread.global_next = NULL;
-  // We need to export this or have an accessor. Making it extern for now in
-  // header? Or just a static here and an accessor function? Accessor is
-  // cleaner. I will add a helper to iterate or get head.
-  g_current_thread = &g_main_thread;
+  // Phase 19: M:N workers
+  int nworkers = requested_workers;
+  if (nworkers <= 0) {
+    const char *env = getenv("GTHREAD_WORKERS");
+    nworkers = env ? atoi(env) : 1;
+  }
+
+  // Phase 26: Preemption, before any worker arms its timer
+  int64_t slice_ns = requested_slice_ns;
+  if (slice_ns < 0) {
+    const char *env = getenv("GTHREAD_PREEMPT_US");
+    slice_ns = env ? atoll(env) * 1000 : 0;
+  }
+  preempt_init(slice_ns > 0 ? (uint64_t)slice_ns : 0);
+
+  // Phase 29: Copy-stack mode
+  size_t shared_stack = requested_shared_stack;
+  if (!shared_stack) {
+    const char *env = getenv("GTHREAD_SHARED_STACK_KB");
+    shared_stack = env ? (size_t)atol(env) * 1024 : 0;
+  }
+
+  // Phase 36: Fair-share policy, before the accounting it may force
+  int policy = requested_policy;
+  if (policy < 0) {
+    const char *env = getenv("GTHREAD_POLICY");
+    policy = env && strcmp(env, "cfs") == 0 ? GTHREAD_POLICY_CFS
+                                            : GTHREAD_POLICY_STRIDE;
+  }
+  policy_set_fair(policy);
+
+  // Phase 35: Stride accounting
+  int accounting = requested_accounting;
+  if (accounting < 0) {
+    const char *env = getenv("GTHREAD_ACCOUNT");
+    accounting = env && strcmp(env, "time") == 0 ? GTHREAD_ACCOUNT_TIME
+                                                  : GTHREAD_ACCOUNT_TICKS;
+  }
+  scheduler_set_accounting(accounting);
+
+  scheduler_init(nworkers, shared_stack);
+
+  // Phase 22: io_uring when available
+  io_init();
 }
 
-// Global list head
-gthread_t *g_all_threads = &g_main_thread;
+void gthread_for_each(void (*fn)(gthread_t *t, void *arg), void *arg) {
+  registry_for_each(fn, arg);
+}
+
+void gthread_attr_init(gthread_attr_t *attr) {
+  attr->stack_size = GTHREAD_STACK_DEFAULT;
+  attr->guard_size = GTHREAD_GUARD_DEFAULT;
+  attr->tickets = GTHREAD_TICKETS_DEFAULT;
+  attr->name = NULL;
+  attr->detached = 0;
+  attr->deadline_ns = 0;
+  attr->quota = NULL;
+  attr->group = NULL;
+}
 
-gthread_t *gthread_get_all_threads(void) { return g_all_threads; }
+static size_t page_round(size_t n) {
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  return (n + page - 1) & ~(page - 1);
+}
+
+/* Phase 32: Map a stack as attr asks. Default-guard stacks come from the
+   cache (Phase 27), which rounds their size up to its class. */
+static int alloc_stack(gthread_t *thread, const gthread_attr_t *attr) {
+  size_t guard = page_round(attr->guard_size);
+  size_t size = page_round(attr->stack_size);
+  if (size < guard + GTHREAD_STACK_MIN)
+    size = guard + GTHREAD_STACK_MIN;
+
+  thread->guard_size = guard;
+  thread->stack_size = size;
+  if (guard == STACK_GUARD_SIZE)
+    thread->stack = pool_stack_get(&thread->stack_size);
+  else
+    thread->stack = stack_map(size, guard);
+  return thread->stack ? 0 : -1;
+}
 
 int gthread_create(gthread_t **t, void (*fn)(void *), void *arg) {
+  return gthread_create_ex(t, NULL, fn, arg);
+}
+
+int gthread_create_ex(gthread_t **t, const gthread_attr_t *attr,
+                      void (*fn)(void *), void *arg) {
   if (!g_current_thread)
     gthread_init();
 
-  gthread_t *thread = (gthread_t *)malloc(sizeof(gthread_t));
+  gthread_attr_t defaults;
+  if (!attr) {
+    gthread_attr_init(&defaults);
+    attr = &defaults;
+  }
+  if (attr->tickets <= 0)
+    return -1;
+
+  // Phase 30: From the TCB slab, already zeroed
+  gthread_t *thread = pool_tcb_get();
   if (!thread)
     return -1;
-  memset(thread, 0, sizeof(gthread_t));
 
-  // Allocate stack
-  thread->stack_size = DEFAULT_STACK_SIZE;
-  thread->stack = malloc(thread->stack_size);
-  if (!thread->stack) {
-    free(thread);
+  // Phase 29: In copy-stack mode the thread starts on its home's stack
+  uint64_t shared_top = scheduler_shared_stack_top(thread);
+
+  // Allocate stack (Phase 27: recycled from an exited thread if possible)
+  if (!shared_top && alloc_stack(thread, attr) < 0) {
+    pool_tcb_put(thread);
     return -1;
   }
 
-  thread->id = next_tid++;
+  // Phase 33: Registered for lookups by id; reaped after exit and join
+  if (registry_add(thread) < 0) {
+    if (thread->stack)
+      stack_unmap(thread->stack, thread->stack_size);
+    pool_tcb_put(thread);
+    return -1;
+  }
+  thread->reap_refs = attr->detached ? 1 : 2;
+
+  // Phase 37: Visible to the dashboards from here, so under their lock.
+  // Phase 38: It joins its group's active count when first queued.
+  if (attr->quota || attr->group) {
+    registry_lock();
+    quota_attach(thread, attr->quota);
+    group_attach(thread, attr->group, 0);
+    registry_unlock();
+  }
+
   thread->entry = fn;
   thread->arg = arg;
   thread->state = GTHREAD_NEW;
-  thread->tickets = 10; // Default tickets
-  thread->pass = 0;
-  thread->stride = 10000; // arbitrary constant / tickets
+  // Phase 32: Share fixed before the thread is queued
+  thread->tickets = attr->tickets;
+  thread->pass = 0; // Phase 34: Becomes its heap's virtual time when queued
+  // Past 10000 tickets the division gives 0, and a thread whose pass never
+  // grows would hold the CPU: clamp as scheduler_set_tickets does
+  thread->stride = 10000 / thread->tickets;
+  if (!thread->stride)
+    thread->stride = 1;
   thread->waiting_fd = -1;
+  thread->detached = attr->detached;
+  // Phase 36: EDF from the start
+  if (attr->deadline_ns) {
+    thread->sched_class = GSCHED_EDF;
+    thread->deadline_ns = gthread_now_ns() + attr->deadline_ns;
+  }
+  strncpy(thread->name, attr->name ? attr->name : "GTHREAD",
+          GTHREAD_NAME_MAX - 1);
 
   // Monitor
-  thread->monitor_id = monitor_register("GTHREAD");
+  thread->monitor_id = monitor_register(thread->name);
   monitor_update_state(thread->monitor_id, TASK_RUNNABLE);
 
-  // Add to global list
-  thread->global_next = g_all_threads;
-  g_all_threads = thread;
-
   // Setup Context
   // Stack grows down. Top is stack + size.
   // We need 16-byte alignment for ABI.
   uint64_t *stack_top =
-      (uint64_t *)((char *)thread->stack + thread->stack_size);
+      shared_top ? (uint64_t *)shared_top
+                 : (uint64_t *)((char *)thread->stack + thread->stack_size);
   // Align
   stack_top = (uint64_t *)(((uint64_t)stack_top) & ~0xF);
 
@@ -95,18 +302,21 @@ int gthread_create(gthread_t **t, void (*fn)(void *), void *arg) {
 
 void gthread_exit(void) {
   gthread_t *cur = g_current_thread;
-  cur->state = GTHREAD_TERMINATED;
   monitor_mark_done(cur->monitor_id);
 
-  // Wake up joining threads
+  gspin_lock(&join_lock);
+  cur->state = GTHREAD_TERMINATED;
   gthread_t *waiter = cur->join_queue;
+  cur->join_queue = NULL;
+  gspin_unlock(&join_lock);
+
+  // Wake up joining threads. No monitor calls from here on: blocking on its
+  // mutex would overwrite our TERMINATED state. Joiners update their own.
   while (waiter) {
     gthread_t *next = waiter->next;
     scheduler_enqueue(waiter);
-    monitor_update_state(waiter->monitor_id, TASK_RUNNABLE);
     waiter = next;
   }
-  cur->join_queue = NULL;
 
   // Schedule next
   scheduler_schedule();
@@ -119,47 +329,69 @@ void gthread_yield(void) {
   }
 }
 
+/* Phase 33: The last joiner out hands back the joiners' reference */
+static void join_done(gthread_t *t, void **retval) {
+  if (retval)
+    *retval = t->retval;
+
+  gspin_lock(&join_lock);
+  int last = --t->joiners == 0;
+  gspin_unlock(&join_lock);
+  if (last)
+    registry_release(t);
+}
+
 int gthread_join(gthread_t *t, void **retval) {
-  if (!t)
+  if (!t || t->detached)
     return -1;
+
+  // Monitor calls may block on its mutex, so make them before queueing
+  gthread_t *cur = g_current_thread;
+  monitor_update_state(cur->monitor_id, TASK_WAITING);
+
+  gspin_lock(&join_lock);
+  t->joiners++;
   if (t->state == GTHREAD_TERMINATED) {
-    if (retval)
-      *retval = t->retval;
+    gspin_unlock(&join_lock);
+    monitor_update_state(cur->monitor_id, TASK_RUNNABLE);
+    join_done(t, retval);
     return 0;
   }
 
   // Add self to t's join queue
-  gthread_t *cur = g_current_thread;
   cur->state = GTHREAD_BLOCKED;
-  monitor_update_state(cur->monitor_id, TASK_WAITING);
-
   cur->next = t->join_queue;
   t->join_queue = cur;
+  gspin_unlock(&join_lock);
 
   scheduler_schedule();
 
   monitor_update_state(cur->monitor_id, TASK_RUNNABLE);
-
-  if (retval)
-    *retval = t->retval;
+  join_done(t, retval);
   return 0;
 }
 
 #include <time.h>
-static uint64_t get_time_ms(void) {
+uint64_t gthread_now_ns(void) {
   struct timespec ts;
   clock_gettime(CLOCK_MONOTONIC, &ts);
-  return (uint64_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void gthread_sleep(uint64_t ms) { gthread_sleep_ns(ms * 1000000ULL); }
+
+void gthread_sleep_ns(uint64_t ns) {
+  gthread_sleep_until(gthread_now_ns() + ns);
 }
 
-void gthread_sleep(uint64_t ms) {
+void gthread_sleep_until(uint64_t deadline) {
   gthread_t *cur = g_current_thread;
-  cur->wake_time_ms = get_time_ms() + ms;
+  cur->wake_time_ms = deadline / 1000000;
 
   monitor_update_state(cur->monitor_id, TASK_SLEEPING);
   monitor_set_wake(cur->monitor_id, cur->wake_time_ms);
 
-  scheduler_enqueue_sleep(cur);
+  scheduler_enqueue_sleep(cur, deadline);
   scheduler_schedule();
 
   monitor_update_state(cur->monitor_id, TASK_RUNNABLE);
@@ -1,9 +1,13 @@
 #include "io.h"
 #include "gthread.h"
+#include "reactor.h"
 #include "scheduler.h" // For wait_io integration?
+#include "uring.h"
 #include <errno.h>
 #include <fcntl.h>
 #include <poll.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
@@ -13,8 +17,19 @@
 
 extern void scheduler_register_io_wait(int fd, int events);
 
+/* Pick the IO backend: io_uring where the kernel supports it, otherwise
+   (or with GTHREAD_IO=poll) readiness waits on the epoll reactor */
 void io_init(void) {
-  // Nothing?
+  const char *env = getenv("GTHREAD_IO");
+  if (env && strcmp(env, "poll") == 0)
+    return;
+  uring_init();
+}
+
+/* Threads on a shared stack take the readiness path: io_uring would write
+   into their buffers while another thread's frames occupy the stack */
+static int use_uring(void) {
+  return uring_enabled() && !g_current_thread->home;
 }
 
 static void set_nonblocking(int fd) {
@@ -23,14 +38,37 @@ static void set_nonblocking(int fd) {
 }
 
 ssize_t gthread_read(int fd, void *buf, size_t count) {
+  return gthread_read_timeout(fd, buf, count, 0);
+}
+
+/* Phase 41: Relative timeout to the absolute deadline the waits take */
+static uint64_t io_deadline(uint64_t timeout_ns) {
+  return timeout_ns ? gthread_now_ns() + timeout_ns : 0;
+}
+
+/* errno is per worker, and the thread may have moved since its last
+   syscall: out of line, so the address is looked up on the worker we are
+   on now rather than reused from before the wait */
+__attribute__((noinline)) static int io_timed_out(void) {
+  errno = ETIMEDOUT;
+  return -1;
+}
+
+ssize_t gthread_read_timeout(int fd, void *buf, size_t count,
+                             uint64_t timeout_ns) {
+  uint64_t deadline = io_deadline(timeout_ns);
+  if (use_uring())
+    return uring_read_until(fd, buf, count, deadline);
+
   set_nonblocking(fd);
   while (1) {
     ssize_t n = read(fd, buf, count);
     if (n < 0) {
       if (errno == EAGAIN || errno == EWOULDBLOCK) {
-        scheduler_register_io_wait(fd, POLLIN); // Block and wait
-        gthread_yield();                        // Switch
-        continue;                               // Retry
+        // Block and wait (on the timer wheel too, with a deadline)
+        if (scheduler_wait_io_until(fd, POLLIN, deadline) < 0)
+          return io_timed_out();
+        continue; // Retry
       }
     }
     return n;
@@ -38,13 +76,16 @@ ssize_t gthread_read(int fd, void *buf, size_t count) {
 }
 
 ssize_t gthread_write(int fd, const void *buf, size_t count) {
+  if (use_uring())
+    return uring_write(fd, buf, count);
+
   set_nonblocking(fd);
   while (1) {
     ssize_t n = write(fd, buf, count);
     if (n < 0) {
       if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        // Blocks until writable, or returns at once if it already is
         scheduler_register_io_wait(fd, POLLOUT);
-        gthread_yield();
         continue;
       }
     }
@@ -53,23 +94,47 @@ ssize_t gthread_write(int fd, const void *buf, size_t count) {
 }
 
 int gthread_accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen) {
+  return gthread_accept_timeout(sockfd, addr, addrlen, 0);
+}
+
+int gthread_accept_timeout(int sockfd, struct sockaddr *addr,
+                           socklen_t *addrlen, uint64_t timeout_ns) {
+  uint64_t deadline = io_deadline(timeout_ns);
+  if (use_uring()) {
+    // No O_NONBLOCK on the new socket: io_uring would just hand EAGAIN back
+    int fd = uring_accept_until(sockfd, addr, addrlen, deadline);
+    reactor_forget_fd(fd);
+    return fd;
+  }
+
   set_nonblocking(sockfd);
   while (1) {
     int fd = accept(sockfd, addr, addrlen);
     if (fd < 0) {
       if (errno == EAGAIN || errno == EWOULDBLOCK) {
-        scheduler_register_io_wait(sockfd, POLLIN);
-        gthread_yield();
+        if (scheduler_wait_io_until(sockfd, POLLIN, deadline) < 0)
+          return io_timed_out();
         continue;
       }
     } else {
       set_nonblocking(fd); // New socket should be NB too
+      // The number may belong to a socket closed without gthread_close
+      reactor_forget_fd(fd);
     }
     return fd;
   }
 }
 
 void gthread_wait_io(int fd, int events) {
+  // The reactor is edge-triggered and only sees new readiness. Callers of
+  // this API may not have drained the fd, so check its level first.
+  struct pollfd pfd = {.fd = fd, .events = events};
+  if (poll(&pfd, 1, 0) > 0)
+    return;
   scheduler_register_io_wait(fd, events);
-  gthread_yield();
+}
+
+int gthread_close(int fd) {
+  reactor_forget_fd(fd);
+  return close(fd);
 }
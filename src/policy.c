@@ -0,0 +1,287 @@
+#include "policy.h"
+#include "scheduler.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+int policy_account_time = 0;
+
+/* Key owed for ns of CPU: a stride per 2^ACCOUNT_SHIFT ns, and never
+   nothing, or a thread that always yields at once would keep the CPU */
+static uint64_t account_charge(gthread_t *t, uint64_t ns) {
+  uint64_t charge = (t->stride * ns) >> ACCOUNT_SHIFT;
+  return charge ? charge : 1;
+}
+
+/* Phase 34: Virtual time. Passes only mean something next to the other
+   passes on the same worker, so each keeps its own clock, and a thread
+   carries its lead over that clock from one worker to the next. */
+static uint64_t vtime_of(gworker_t *w) {
+  return __atomic_load_n(&w->vtime, __ATOMIC_RELAXED);
+}
+
+/* The picked thread has the lowest key, so the clock catches up with it */
+static void vtime_advance(gworker_t *w, gthread_t *t) {
+  if (t->pass > w->vtime)
+    __atomic_store_n(&w->vtime, t->pass, __ATOMIC_RELAXED);
+}
+
+/* t's pass, moved from the clock of the worker it was last queued on to
+   w's. A lead below zero (the thread fell behind while away) counts as
+   none. */
+static uint64_t vtime_rebase(gworker_t *w, gthread_t *t) {
+  uint64_t from = vtime_of(t->last_rq ? t->last_rq : w);
+  uint64_t lead = t->pass > from ? t->pass - from : 0;
+  return vtime_of(w) + lead;
+}
+
+/* Phase 34: The lead over the virtual time is what is left of the last
+   stride; it scales with the stride, so the new share shows from the
+   thread's next turn */
+static void fair_reweight(gworker_t *w, gthread_t *t, uint64_t stride) {
+  uint64_t vt = vtime_of(w);
+  uint64_t lead = t->pass > vt ? t->pass - vt : 0;
+  if (t->stride)
+    lead = lead * stride / t->stride;
+  t->pass = vt + lead;
+  t->stride = stride;
+}
+
+static uint64_t fair_tick(gthread_t *t, uint64_t ns) {
+  return account_charge(t, ns);
+}
+
+/* Stride: min-heap by pass, one per worker. Grows on demand. Entries carry
+   a copy of the pass, so sifting compares inside the array and never loads
+   a TCB; it only stores each moved entry's new slot back into it, which
+   makes finding a thread's slot O(1). */
+static void heap_place(gworker_t *w, int i, heap_entry_t e) {
+  w->ready_heap[i] = e;
+  e.thread->heap_index = i;
+}
+
+static void heap_sift_up(gworker_t *w, int i) {
+  heap_entry_t e = w->ready_heap[i];
+  while (i > 0) {
+    int parent = (i - 1) / 2;
+    if (w->ready_heap[parent].pass <= e.pass) {
+      break;
+    }
+    heap_place(w, i, w->ready_heap[parent]);
+    i = parent;
+  }
+  heap_place(w, i, e);
+}
+
+static void heap_sift_down(gworker_t *w, int i) {
+  heap_entry_t e = w->ready_heap[i];
+  while (1) {
+    int left = 2 * i + 1;
+    int right = 2 * i + 2;
+    int smallest = left;
+
+    if (left >= w->heap_size)
+      break;
+    if (right < w->heap_size &&
+        w->ready_heap[right].pass < w->ready_heap[left].pass) {
+      smallest = right;
+    }
+    if (e.pass <= w->ready_heap[smallest].pass)
+      break;
+
+    heap_place(w, i, w->ready_heap[smallest]);
+    i = smallest;
+  }
+  heap_place(w, i, e);
+}
+
+static void heap_grow(gworker_t *w) {
+  int cap = w->heap_capacity ? w->heap_capacity * 2 : HEAP_INITIAL_CAPACITY;
+  heap_entry_t *heap = realloc(w->ready_heap, cap * sizeof(heap_entry_t));
+  if (!heap) {
+    fprintf(stderr, "Scheduler: Out of memory growing ready heap\n");
+    exit(1);
+  }
+  w->ready_heap = heap;
+  w->heap_capacity = cap;
+}
+
+static void stride_enqueue(gworker_t *w, gthread_t *t) {
+  if (w->heap_size >= w->heap_capacity)
+    heap_grow(w);
+
+  // Insert at end, bubble up
+  int i = w->heap_size++;
+  w->ready_heap[i].pass = t->pass;
+  w->ready_heap[i].thread = t;
+  heap_sift_up(w, i);
+}
+
+static void stride_dequeue(gworker_t *w, gthread_t *t) {
+  int i = t->heap_index;
+  heap_entry_t last = w->ready_heap[--w->heap_size];
+
+  if (i < w->heap_size) {
+    // Move last into the hole, then restore order in whichever direction
+    w->ready_heap[i] = last;
+    if (i > 0 && w->ready_heap[(i - 1) / 2].pass > last.pass)
+      heap_sift_up(w, i);
+    else
+      heap_sift_down(w, i);
+  }
+}
+
+static gthread_t *stride_first(gworker_t *w) {
+  return w->heap_size ? w->ready_heap[0].thread : NULL;
+}
+
+/* A leaf: O(1) to take, and leaves the most urgent threads in place */
+static gthread_t *stride_last(gworker_t *w) {
+  return w->heap_size ? w->ready_heap[w->heap_size - 1].thread : NULL;
+}
+
+/* No catching up on a pass of 0, or on one left behind while blocked */
+static void stride_wake(gworker_t *w, gthread_t *t) {
+  t->pass = vtime_rebase(w, t);
+}
+
+static void stride_pick(gworker_t *w, gthread_t *t) {
+  vtime_advance(w, t);
+  // Counting picks: the stride is paid up front
+  if (!policy_account_time)
+    t->pass += t->stride;
+}
+
+static const gsched_class_t stride_class = {
+    .name = "stride",
+    .wake = stride_wake,
+    .enqueue = stride_enqueue,
+    .dequeue = stride_dequeue,
+    .first = stride_first,
+    .last = stride_last,
+    .pick = stride_pick,
+    .tick = fair_tick,
+    .reweight = fair_reweight,
+};
+
+/* CFS: red-black tree by vruntime, which is `pass` charged by CPU time (a
+   stride per ~1 us, so ns / weight with the tickets as weight). Same
+   virtual time as stride, but a thread that slept rejoins up to
+   CFS_WAKE_CREDIT_NS (at its weight) behind it, ahead of the CPU-bound
+   threads, instead of level with them. Any thread can be unlinked in
+   O(log n). */
+static gthread_t *rq_thread(rb_node_t *n) {
+  return n ? rb_entry(n, gthread_t, rq_node) : NULL;
+}
+
+static void cfs_wake(gworker_t *w, gthread_t *t) {
+  uint64_t vt = vtime_of(w);
+  if (!t->last_rq) {
+    t->pass = vt; // New
+    return;
+  }
+
+  uint64_t from = vtime_of(t->last_rq);
+  if (t->pass >= from) {
+    t->pass = vt + (t->pass - from);
+    return;
+  }
+  uint64_t lag = from - t->pass;
+  uint64_t credit = (CFS_WAKE_CREDIT_NS * t->stride) >> ACCOUNT_SHIFT;
+  if (lag > credit)
+    lag = credit;
+  t->pass = vt > lag ? vt - lag : 0;
+}
+
+static void cfs_enqueue(gworker_t *w, gthread_t *t) {
+  t->rq_node.key = t->pass;
+  rb_insert(&w->cfs_rq, &t->rq_node);
+}
+
+static void cfs_dequeue(gworker_t *w, gthread_t *t) {
+  rb_erase(&w->cfs_rq, &t->rq_node);
+}
+
+static gthread_t *cfs_first(gworker_t *w) {
+  return rq_thread(w->cfs_rq.first);
+}
+
+static gthread_t *cfs_last(gworker_t *w) { return rq_thread(w->cfs_rq.last); }
+
+static const gsched_class_t cfs_class = {
+    .name = "cfs",
+    .wake = cfs_wake,
+    .enqueue = cfs_enqueue,
+    .dequeue = cfs_dequeue,
+    .first = cfs_first,
+    .last = cfs_last,
+    .pick = vtime_advance,
+    .tick = fair_tick,
+    .reweight = fair_reweight,
+};
+
+/* EDF: red-black tree by absolute deadline. Deadlines are CLOCK_MONOTONIC
+   times, the same on every worker, so there is no clock to place a thread
+   against or advance, and nothing to charge. A thief takes the latest
+   deadline. */
+static void edf_nop(gworker_t *w, gthread_t *t) {
+  (void)w;
+  (void)t;
+}
+
+static void edf_enqueue(gworker_t *w, gthread_t *t) {
+  t->rq_node.key = t->deadline_ns;
+  rb_insert(&w->edf_rq, &t->rq_node);
+}
+
+static void edf_dequeue(gworker_t *w, gthread_t *t) {
+  rb_erase(&w->edf_rq, &t->rq_node);
+}
+
+static gthread_t *edf_first(gworker_t *w) {
+  return rq_thread(w->edf_rq.first);
+}
+
+static gthread_t *edf_last(gworker_t *w) { return rq_thread(w->edf_rq.last); }
+
+static uint64_t edf_tick(gthread_t *t, uint64_t ns) {
+  (void)t;
+  (void)ns;
+  return 0;
+}
+
+/* Kept for when the thread drops its deadline */
+static void edf_reweight(gworker_t *w, gthread_t *t, uint64_t stride) {
+  (void)w;
+  t->stride = stride;
+}
+
+static const gsched_class_t edf_class = {
+    .name = "edf",
+    .wake = edf_nop,
+    .enqueue = edf_enqueue,
+    .dequeue = edf_dequeue,
+    .first = edf_first,
+    .last = edf_last,
+    .pick = edf_nop,
+    .tick = edf_tick,
+    .reweight = edf_reweight,
+};
+
+const gsched_class_t *sched_classes[GSCHED_CLASSES] = {
+    [GSCHED_FAIR] = &stride_class,
+    [GSCHED_EDF] = &edf_class,
+};
+
+void policy_set_fair(int policy) {
+  if (policy == GTHREAD_POLICY_CFS) {
+    sched_classes[GSCHED_FAIR] = &cfs_class;
+    policy_account_time = 1;
+  } else {
+    sched_classes[GSCHED_FAIR] = &stride_class;
+  }
+}
+
+void policy_set_accounting(int mode) {
+  policy_account_time = mode == GTHREAD_ACCOUNT_TIME ||
+                        sched_classes[GSCHED_FAIR] == &cfs_class;
+}
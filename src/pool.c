@@ -0,0 +1,136 @@
+#include "pool.h"
+#include "spinlock.h"
+#include "stack.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Free stacks are linked through their top word: the low end is the
+   guard */
+typedef struct pool_block {
+  struct pool_block *next;
+} pool_block_t;
+
+typedef struct {
+  pool_block_t *free;
+  int count;
+} pool_class_t;
+
+static pool_class_t classes[POOL_CLASSES];
+static gspinlock_t pool_lock = GSPINLOCK_INIT;
+static int pool_high = POOL_HIGH_DEFAULT;
+static int pool_low = POOL_LOW_DEFAULT;
+
+/* Free TCBs, linked through their first word */
+static pool_block_t *tcb_free = NULL;
+
+void pool_set_limits(int high, int low) {
+  if (high < 0)
+    high = 0;
+  if (low < 0)
+    low = 0;
+  if (low > high)
+    low = high;
+
+  gspin_lock(&pool_lock);
+  pool_high = high;
+  pool_low = low;
+  gspin_unlock(&pool_lock);
+}
+
+/* Class index for size, or -1 if it is too big to cache */
+static int pool_class(size_t size) {
+  int c = 0;
+  while (c < POOL_CLASSES && ((size_t)1 << (POOL_MIN_SHIFT + c)) < size)
+    c++;
+  return c < POOL_CLASSES ? c : -1;
+}
+
+void *pool_stack_get(size_t *size) {
+  int c = pool_class(*size);
+  if (c < 0)
+    return stack_map(*size, STACK_GUARD_SIZE);
+
+  *size = (size_t)1 << (POOL_MIN_SHIFT + c);
+  pool_class_t *pc = &classes[c];
+
+  gspin_lock(&pool_lock);
+  pool_block_t *b = pc->free;
+  if (b) {
+    pc->free = b->next;
+    pc->count--;
+  }
+  gspin_unlock(&pool_lock);
+
+  return b ? (char *)(b + 1) - *size : stack_map(*size, STACK_GUARD_SIZE);
+}
+
+void pool_stack_put(void *stack, size_t size) {
+  int c = pool_class(size);
+  if (c < 0 || ((size_t)1 << (POOL_MIN_SHIFT + c)) != size) {
+    stack_unmap(stack, size);
+    return;
+  }
+
+  pool_class_t *pc = &classes[c];
+  pool_block_t *b = (pool_block_t *)((char *)stack + size) - 1;
+  pool_block_t *trim = NULL;
+
+  gspin_lock(&pool_lock);
+  b->next = pc->free;
+  pc->free = b;
+  pc->count++;
+
+  // Over the high watermark: hand back a batch, down to the low one
+  if (pc->count > pool_high) {
+    while (pc->count > pool_low) {
+      pool_block_t *victim = pc->free;
+      pc->free = victim->next;
+      pc->count--;
+      victim->next = trim;
+      trim = victim;
+    }
+  }
+  gspin_unlock(&pool_lock);
+
+  // Unmap outside the lock
+  while (trim) {
+    pool_block_t *next = trim->next;
+    stack_unmap((char *)(trim + 1) - size, size);
+    trim = next;
+  }
+}
+
+gthread_t *pool_tcb_get(void) {
+  gspin_lock(&pool_lock);
+  pool_block_t *b = tcb_free;
+  if (b)
+    tcb_free = b->next;
+  gspin_unlock(&pool_lock);
+
+  if (!b) {
+    // Carve a fresh slab: keep the first TCB, shelve the rest
+    gthread_t *slab = aligned_alloc(64, POOL_TCB_SLAB * sizeof(gthread_t));
+    if (!slab)
+      return NULL;
+
+    gspin_lock(&pool_lock);
+    for (int i = POOL_TCB_SLAB - 1; i > 0; i--) {
+      pool_block_t *f = (pool_block_t *)&slab[i];
+      f->next = tcb_free;
+      tcb_free = f;
+    }
+    gspin_unlock(&pool_lock);
+    b = (pool_block_t *)slab;
+  }
+
+  memset(b, 0, sizeof(gthread_t));
+  return (gthread_t *)b;
+}
+
+void pool_tcb_put(gthread_t *t) {
+  pool_block_t *b = (pool_block_t *)t;
+  gspin_lock(&pool_lock);
+  b->next = tcb_free;
+  tcb_free = b;
+  gspin_unlock(&pool_lock);
+}
@@ -0,0 +1,145 @@
+#define _GNU_SOURCE
+#include "preempt.h"
+#include "scheduler.h"
+#include <errno.h>
+#include <link.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+#define PREEMPT_SIGNAL SIGALRM
+#define MAX_TEXT_RANGES 8
+
+__thread int g_nopreempt = 0;
+
+static uint64_t slice_ns = 0;
+
+/* Executable segments of the program itself. Anything outside them (libc,
+   the dynamic loader, the vDSO) may hold locks we know nothing about. */
+static struct {
+  uintptr_t start, end;
+} text_ranges[MAX_TEXT_RANGES];
+static int ntext_ranges = 0;
+
+static int find_program_text(struct dl_phdr_info *info, size_t size,
+                             void *data) {
+  (void)size;
+  (void)data;
+  // The program is always reported first
+  for (int i = 0; i < info->dlpi_phnum; i++) {
+    const ElfW(Phdr) *ph = &info->dlpi_phdr[i];
+    if (ph->p_type != PT_LOAD || !(ph->p_flags & PF_X))
+      continue;
+    if (ntext_ranges == MAX_TEXT_RANGES)
+      break;
+    text_ranges[ntext_ranges].start = info->dlpi_addr + ph->p_vaddr;
+    text_ranges[ntext_ranges].end =
+        info->dlpi_addr + ph->p_vaddr + ph->p_memsz;
+    ntext_ranges++;
+  }
+  return 1;
+}
+
+static int in_program_text(uintptr_t pc) {
+  for (int i = 0; i < ntext_ranges; i++) {
+    if (pc >= text_ranges[i].start && pc < text_ranges[i].end)
+      return 1;
+  }
+  return 0;
+}
+
+/* Runs on the interrupted green thread's stack. SA_NODEFER: a nested tick
+   either bails out on the checks below or completes a whole preemption
+   before this one carries on. */
+static void preempt_handler(int sig, siginfo_t *si, void *uc) {
+  (void)sig;
+  (void)si;
+  int saved_errno = errno;
+  gworker_t *w = scheduler_worker();
+  gthread_t *cur = w->current;
+
+  // Only a thread that has had the CPU since the previous tick has used up
+  // its slice
+  if (w->switches != w->preempt_mark) {
+    w->preempt_mark = w->switches;
+    goto out;
+  }
+
+  if (cur == &w->idle || w->switching || g_nopreempt ||
+      cur->state != GTHREAD_RUNNING)
+    goto out;
+  if (!in_program_text(
+          (uintptr_t)((ucontext_t *)uc)->uc_mcontext.gregs[REG_RIP]))
+    goto out;
+  if (cur->preempt_count > 0) {
+    // gthread_preempt_enable() yields on its behalf
+    cur->preempt_pending = 1;
+    goto out;
+  }
+
+  scheduler_preempt(w);
+out:
+  errno = saved_errno;
+}
+
+void preempt_init(uint64_t ns) {
+  slice_ns = ns;
+  if (!slice_ns)
+    return;
+
+  dl_iterate_phdr(find_program_text, NULL);
+
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_sigaction = preempt_handler;
+  sa.sa_flags = SA_SIGINFO | SA_RESTART | SA_NODEFER;
+  sigemptyset(&sa.sa_mask);
+  if (sigaction(PREEMPT_SIGNAL, &sa, NULL) < 0) {
+    perror("sigaction");
+    slice_ns = 0;
+  }
+}
+
+int preempt_enabled(void) { return slice_ns != 0; }
+
+static void preempt_arm(gworker_t *w, uint64_t ns) {
+  struct timespec ts = {ns / 1000000000, ns % 1000000000};
+  struct itimerspec its = {ts, ts};
+  timer_settime(w->preempt_timer, 0, &its, NULL);
+}
+
+void preempt_start(gworker_t *w) {
+  if (!slice_ns)
+    return;
+
+  struct sigevent sev;
+  memset(&sev, 0, sizeof(sev));
+  sev.sigev_notify = SIGEV_THREAD_ID;
+  sev.sigev_signo = PREEMPT_SIGNAL;
+  sev.sigev_notify_thread_id = (pid_t)syscall(SYS_gettid);
+  if (timer_create(CLOCK_MONOTONIC, &sev, &w->preempt_timer) < 0) {
+    perror("timer_create");
+    return;
+  }
+  w->preempt_armed = 1;
+  preempt_arm(w, slice_ns);
+}
+
+void preempt_pause(gworker_t *w) {
+  if (w->preempt_armed)
+    preempt_arm(w, 0);
+}
+
+void preempt_resume(gworker_t *w) {
+  if (w->preempt_armed)
+    preempt_arm(w, slice_ns);
+}
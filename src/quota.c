@@ -0,0 +1,120 @@
+#include "quota.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static gquota_t *pools = NULL;
+static gspinlock_t pools_lock = GSPINLOCK_INIT;
+static int next_id = 0;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+gquota_t *gquota_create(const char *name, uint64_t runtime_ns,
+                        uint64_t period_ns) {
+  if (!period_ns)
+    return NULL;
+
+  gquota_t *q = calloc(1, sizeof(gquota_t));
+  if (!q)
+    return NULL;
+  gspin_init(&q->lock);
+  q->runtime_ns = runtime_ns;
+  q->period_ns = period_ns;
+  q->period_end = now_ns() + period_ns;
+  q->refs = 1;
+  strncpy(q->name, name ? name : "QUOTA", GTHREAD_NAME_MAX - 1);
+
+  gspin_lock(&pools_lock);
+  q->id = next_id++;
+  q->next = pools;
+  pools = q;
+  gspin_unlock(&pools_lock);
+
+  return q;
+}
+
+static void quota_put(gquota_t *q) {
+  if (__atomic_sub_fetch(&q->refs, 1, __ATOMIC_ACQ_REL) > 0)
+    return;
+
+  gspin_lock(&pools_lock);
+  gquota_t **p = &pools;
+  while (*p != q)
+    p = &(*p)->next;
+  *p = q->next;
+  gspin_unlock(&pools_lock);
+  free(q);
+}
+
+void gquota_destroy(gquota_t *q) {
+  if (q)
+    quota_put(q);
+}
+
+void quota_attach(gthread_t *t, gquota_t *q) {
+  gquota_t *old = t->quota;
+  if (old == q)
+    return;
+
+  if (q) {
+    __atomic_add_fetch(&q->refs, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&q->nr_threads, 1, __ATOMIC_RELAXED);
+  }
+  t->quota = q;
+  t->timed = q || t->group;
+  if (old) {
+    __atomic_sub_fetch(&old->nr_threads, 1, __ATOMIC_RELAXED);
+    quota_put(old);
+  }
+}
+
+void quota_charge(gquota_t *q, uint64_t ns) {
+  gspin_lock(&q->lock);
+  q->used += ns;
+  q->total_ns += ns;
+  gspin_unlock(&q->lock);
+}
+
+/* Caller holds q->lock. Each period that has ended pays off a runtime's
+   worth of what was used. */
+static void quota_refill(gquota_t *q, uint64_t now) {
+  if (now < q->period_end)
+    return;
+  uint64_t periods = (now - q->period_end) / q->period_ns + 1;
+  uint64_t refill = periods * q->runtime_ns;
+  q->used = q->used > refill ? q->used - refill : 0;
+  q->period_end += periods * q->period_ns;
+}
+
+uint64_t quota_exhausted(gquota_t *q, uint64_t now) {
+  gspin_lock(&q->lock);
+  quota_refill(q, now);
+  uint64_t until = q->used >= q->runtime_ns ? q->period_end : 0;
+  gspin_unlock(&q->lock);
+  return until;
+}
+
+void quota_throttled(gquota_t *q) {
+  __atomic_add_fetch(&q->throttles, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&q->nr_throttled, 1, __ATOMIC_RELAXED);
+}
+
+void quota_unthrottled(gquota_t *q) {
+  __atomic_sub_fetch(&q->nr_throttled, 1, __ATOMIC_RELAXED);
+}
+
+void quota_for_each(void (*fn)(gquota_t *q, void *arg), void *arg) {
+  gspin_lock(&pools_lock);
+  for (gquota_t *q = pools; q; q = q->next) {
+    // Settle the period, so `used` is this one's
+    gspin_lock(&q->lock);
+    quota_refill(q, now_ns());
+    gspin_unlock(&q->lock);
+    fn(q, arg);
+  }
+  gspin_unlock(&pools_lock);
+}
@@ -0,0 +1,227 @@
+#include "rbtree.h"
+
+/* Leaves are NULL and count as black */
+static int is_red(const rb_node_t *n) { return n && n->red; }
+
+/* Put v where u hangs */
+static void replace_child(rb_tree_t *t, rb_node_t *u, rb_node_t *v) {
+  if (!u->parent)
+    t->root = v;
+  else if (u == u->parent->left)
+    u->parent->left = v;
+  else
+    u->parent->right = v;
+  if (v)
+    v->parent = u->parent;
+}
+
+static void rotate_left(rb_tree_t *t, rb_node_t *x) {
+  rb_node_t *y = x->right;
+  x->right = y->left;
+  if (y->left)
+    y->left->parent = x;
+  replace_child(t, x, y);
+  y->left = x;
+  x->parent = y;
+}
+
+static void rotate_right(rb_tree_t *t, rb_node_t *x) {
+  rb_node_t *y = x->left;
+  x->left = y->right;
+  if (y->right)
+    y->right->parent = x;
+  replace_child(t, x, y);
+  y->right = x;
+  x->parent = y;
+}
+
+rb_node_t *rb_next(const rb_node_t *n) {
+  if (n->right) {
+    n = n->right;
+    while (n->left)
+      n = n->left;
+    return (rb_node_t *)n;
+  }
+  while (n->parent && n == n->parent->right)
+    n = n->parent;
+  return n->parent;
+}
+
+rb_node_t *rb_prev(const rb_node_t *n) {
+  if (n->left) {
+    n = n->left;
+    while (n->right)
+      n = n->right;
+    return (rb_node_t *)n;
+  }
+  while (n->parent && n == n->parent->left)
+    n = n->parent;
+  return n->parent;
+}
+
+void rb_insert(rb_tree_t *t, rb_node_t *n) {
+  rb_node_t *parent = NULL;
+  rb_node_t **link = &t->root;
+  int leftmost = 1, rightmost = 1;
+
+  // Ties go right: equal keys come out in the order they went in
+  while (*link) {
+    parent = *link;
+    if (n->key < parent->key) {
+      link = &parent->left;
+      rightmost = 0;
+    } else {
+      link = &parent->right;
+      leftmost = 0;
+    }
+  }
+
+  n->parent = parent;
+  n->left = n->right = NULL;
+  n->red = 1;
+  *link = n;
+  if (leftmost)
+    t->first = n;
+  if (rightmost)
+    t->last = n;
+  t->count++;
+
+  // A red parent is never the root, so the grandparent exists
+  while ((parent = n->parent) && parent->red) {
+    rb_node_t *gp = parent->parent;
+    if (parent == gp->left) {
+      rb_node_t *uncle = gp->right;
+      if (is_red(uncle)) {
+        parent->red = uncle->red = 0;
+        gp->red = 1;
+        n = gp;
+        continue;
+      }
+      if (n == parent->right) {
+        rotate_left(t, parent);
+        n = parent;
+        parent = n->parent;
+      }
+      parent->red = 0;
+      gp->red = 1;
+      rotate_right(t, gp);
+    } else {
+      rb_node_t *uncle = gp->left;
+      if (is_red(uncle)) {
+        parent->red = uncle->red = 0;
+        gp->red = 1;
+        n = gp;
+        continue;
+      }
+      if (n == parent->left) {
+        rotate_right(t, parent);
+        n = parent;
+        parent = n->parent;
+      }
+      parent->red = 0;
+      gp->red = 1;
+      rotate_left(t, gp);
+    }
+  }
+  t->root->red = 0;
+}
+
+/* x (possibly a NULL leaf, hence the explicit parent) carries an extra
+   black */
+static void erase_fixup(rb_tree_t *t, rb_node_t *x, rb_node_t *parent) {
+  while (x != t->root && !is_red(x)) {
+    if (x == parent->left) {
+      rb_node_t *s = parent->right;
+      if (s->red) {
+        s->red = 0;
+        parent->red = 1;
+        rotate_left(t, parent);
+        s = parent->right;
+      }
+      if (!is_red(s->left) && !is_red(s->right)) {
+        s->red = 1;
+        x = parent;
+        parent = x->parent;
+        continue;
+      }
+      if (!is_red(s->right)) {
+        s->left->red = 0;
+        s->red = 1;
+        rotate_right(t, s);
+        s = parent->right;
+      }
+      s->red = parent->red;
+      parent->red = 0;
+      s->right->red = 0;
+      rotate_left(t, parent);
+    } else {
+      rb_node_t *s = parent->left;
+      if (s->red) {
+        s->red = 0;
+        parent->red = 1;
+        rotate_right(t, parent);
+        s = parent->left;
+      }
+      if (!is_red(s->left) && !is_red(s->right)) {
+        s->red = 1;
+        x = parent;
+        parent = x->parent;
+        continue;
+      }
+      if (!is_red(s->left)) {
+        s->right->red = 0;
+        s->red = 1;
+        rotate_left(t, s);
+        s = parent->left;
+      }
+      s->red = parent->red;
+      parent->red = 0;
+      s->left->red = 0;
+      rotate_right(t, parent);
+    }
+    x = t->root;
+  }
+  if (x)
+    x->red = 0;
+}
+
+void rb_erase(rb_tree_t *t, rb_node_t *n) {
+  if (t->first == n)
+    t->first = rb_next(n);
+  if (t->last == n)
+    t->last = rb_prev(n);
+  t->count--;
+
+  rb_node_t *x, *parent;
+  int removed_red;
+
+  if (!n->left || !n->right) {
+    // At most one child: it takes n's place
+    x = n->left ? n->left : n->right;
+    parent = n->parent;
+    removed_red = n->red;
+    replace_child(t, n, x);
+  } else {
+    // Two children: n's successor takes its place and colour
+    rb_node_t *y = n->right;
+    while (y->left)
+      y = y->left;
+    removed_red = y->red;
+    x = y->right;
+    if (y->parent == n) {
+      parent = y;
+    } else {
+      parent = y->parent;
+      replace_child(t, y, x);
+      y->right = n->right;
+      y->right->parent = y;
+    }
+    replace_child(t, n, y);
+    y->left = n->left;
+    y->left->parent = y;
+    y->red = n->red;
+  }
+
+  if (!removed_red)
+    erase_fixup(t, x, parent);
+}
@@ -0,0 +1,309 @@
+#include "reactor.h"
+#include "scheduler.h"
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#define REACTOR_BATCH 64
+#define FD_TABLE_MIN 64
+
+/* Per-fd state, indexed by fd number */
+typedef struct {
+  int registered;     // Added to the epoll set at some point
+  uint32_t ready;     // Edges (POLLIN/POLLOUT) that fired with no waiter
+  gthread_t *waiters; // Linked through gthread_t.next
+} reactor_fd_t;
+
+static int epfd = -1;
+static int wake_fd = -1; // eventfd that interrupts a blocked poller
+static int timer_fd = -1; // Sub-ms timeouts when epoll_pwait2 is missing
+static int have_pwait2 = 1;
+static reactor_fd_t *fd_table = NULL;
+static int fd_capacity = 0;
+static int waiter_count = 0;
+static gspinlock_t io_lock = GSPINLOCK_INIT;
+
+void reactor_init(int nworkers) {
+  epfd = epoll_create1(EPOLL_CLOEXEC);
+  if (epfd < 0) {
+    perror("epoll_create1");
+    exit(1);
+  }
+
+  // Only needed when another worker can be blocked in epoll_wait.
+  // Level-triggered: it stays readable until the poller drains it.
+  if (nworkers > 1) {
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    struct epoll_event ev = {.events = EPOLLIN, .data.fd = wake_fd};
+    epoll_ctl(epfd, EPOLL_CTL_ADD, wake_fd, &ev);
+  }
+}
+
+void reactor_watch(int fd) {
+  // data.fd = -1: dispatch skips it, the owner's hook does the draining
+  struct epoll_event ev = {.events = EPOLLIN, .data.fd = -1};
+  epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+/* Caller holds io_lock */
+static int fd_table_grow(int fd) {
+  int cap = fd_capacity ? fd_capacity : FD_TABLE_MIN;
+  while (cap <= fd)
+    cap *= 2;
+
+  reactor_fd_t *table = realloc(fd_table, cap * sizeof(reactor_fd_t));
+  if (!table)
+    return -1;
+  memset(table + fd_capacity, 0, (cap - fd_capacity) * sizeof(reactor_fd_t));
+  fd_table = table;
+  fd_capacity = cap;
+  return 0;
+}
+
+static uint32_t wanted_events(int events) {
+  uint32_t want = 0;
+  if (events & (POLLIN | POLLPRI))
+    want |= POLLIN;
+  if (events & POLLOUT)
+    want |= POLLOUT;
+  return want;
+}
+
+int reactor_arm(gthread_t *t, int fd, int events, uint64_t deadline_ns) {
+  uint32_t want = wanted_events(events);
+  if (fd < 0 || !want)
+    return 0;
+
+  gspin_lock(&io_lock);
+  if (fd >= fd_capacity && fd_table_grow(fd) < 0) {
+    gspin_unlock(&io_lock);
+    return 0;
+  }
+
+  if (!fd_table[fd].waiters) {
+    // Register for both directions; EEXIST means it still is. Not just on
+    // the first wait: a plain close() drops the fd from the epoll set, and
+    // the number may come back as a new file nobody added. (An edge latched
+    // for the old file costs the new one a single spurious retry.) Edges
+    // that fire before we re-lock are latched by the dispatcher.
+    gspin_unlock(&io_lock);
+    struct epoll_event ev = {.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP |
+                                       EPOLLET,
+                             .data.fd = fd};
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0 && errno != EEXIST)
+      return 0; // e.g. a regular file: always ready
+    gspin_lock(&io_lock);
+    fd_table[fd].registered = 1;
+  }
+
+  reactor_fd_t *slot = &fd_table[fd];
+  if (slot->ready & want) {
+    // The edge came between the caller's EAGAIN and now
+    slot->ready &= ~want;
+    gspin_unlock(&io_lock);
+    return 0;
+  }
+
+  t->wait_events = want;
+  t->waiting_fd = fd; // Phase 13
+  t->state = GTHREAD_BLOCKED;
+  t->next = slot->waiters;
+  slot->waiters = t;
+  __atomic_add_fetch(&waiter_count, 1, __ATOMIC_RELAXED);
+  if (deadline_ns)
+    scheduler_block_timeout(t, deadline_ns);
+  gspin_unlock(&io_lock);
+  return 1;
+}
+
+int reactor_timed_out(gthread_t *t, int fd) {
+  if (__atomic_load_n(&t->timed_wait, __ATOMIC_ACQUIRE) != TIMED_WAIT_EXPIRED)
+    return 0;
+
+  gspin_lock(&io_lock);
+  // Still parked unless reactor_forget_fd emptied the slot meanwhile
+  if (fd < fd_capacity) {
+    for (gthread_t **pp = &fd_table[fd].waiters; *pp; pp = &(*pp)->next) {
+      if (*pp == t) {
+        *pp = t->next;
+        __atomic_sub_fetch(&waiter_count, 1, __ATOMIC_RELEASE);
+        break;
+      }
+    }
+  }
+  t->next = NULL;
+  t->waiting_fd = -1;
+  t->timed_wait = TIMED_WAIT_NONE;
+  gspin_unlock(&io_lock);
+  return 1;
+}
+
+/* Wake waiters on the fds that fired. O(ready), not O(registered). */
+static int reactor_dispatch(struct epoll_event *evs, int n) {
+  int woke = 0;
+
+  gspin_lock(&io_lock);
+  for (int i = 0; i < n; i++) {
+    int fd = evs[i].data.fd;
+    if (fd < 0 || fd == wake_fd || fd == timer_fd || fd >= fd_capacity)
+      continue;
+
+    uint32_t fired = 0;
+    if (evs[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+      fired |= POLLIN;
+    if (evs[i].events & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+      fired |= POLLOUT;
+
+    reactor_fd_t *slot = &fd_table[fd];
+    uint32_t unclaimed = fired;
+    gthread_t **pp = &slot->waiters;
+    while (*pp) {
+      gthread_t *t = *pp;
+      // Phase 41: One whose timeout fired takes itself off
+      if (!(t->wait_events & fired) || !scheduler_claim_wakeup(t)) {
+        pp = &t->next;
+        continue;
+      }
+      unclaimed &= ~t->wait_events;
+      *pp = t->next;
+      t->next = NULL;
+      t->waiting_fd = -1; // Phase 13
+
+      // Queue before dropping the count so the deadlock check in
+      // worker_wait always sees the thread somewhere
+      scheduler_enqueue_locked(t);
+      __atomic_sub_fetch(&waiter_count, 1, __ATOMIC_RELEASE);
+      woke++;
+    }
+
+    // Edge-triggered: remember edges nobody consumed
+    slot->ready |= unclaimed;
+  }
+  gspin_unlock(&io_lock);
+
+  return woke;
+}
+
+/* Fallback for kernels before 5.11: a timerfd in the epoll set carries
+   the precise timeout. Caller is the single blocking poller. */
+static int reactor_arm_timerfd(int64_t timeout_ns) {
+  if (timer_fd < 0) {
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd < 0)
+      return -1;
+    struct epoll_event ev = {.events = EPOLLIN, .data.fd = timer_fd};
+    epoll_ctl(epfd, EPOLL_CTL_ADD, timer_fd, &ev);
+  }
+  struct itimerspec its = {{0, 0},
+                           {timeout_ns / 1000000000, timeout_ns % 1000000000}};
+  return timerfd_settime(timer_fd, 0, &its, NULL);
+}
+
+static int reactor_wait(struct epoll_event *evs, int64_t timeout_ns) {
+  if (timeout_ns <= 0)
+    return epoll_wait(epfd, evs, REACTOR_BATCH, timeout_ns < 0 ? -1 : 0);
+
+#ifdef __NR_epoll_pwait2
+  if (have_pwait2) {
+    struct timespec ts = {timeout_ns / 1000000000, timeout_ns % 1000000000};
+    int n = (int)syscall(__NR_epoll_pwait2, epfd, evs, REACTOR_BATCH, &ts,
+                         NULL, 0);
+    if (n >= 0 || errno != ENOSYS)
+      return n;
+    have_pwait2 = 0;
+  }
+#endif
+
+  if (reactor_arm_timerfd(timeout_ns) == 0)
+    return epoll_wait(epfd, evs, REACTOR_BATCH, -1);
+
+  // Millisecond timeout, rounded up so we never wake early
+  int64_t ms = (timeout_ns + 999999) / 1000000;
+  return epoll_wait(epfd, evs, REACTOR_BATCH, ms > INT_MAX ? INT_MAX : (int)ms);
+}
+
+/* Consume a level-triggered internal fd so it stops firing */
+static void reactor_drain(int fd) {
+  uint64_t count;
+  if (read(fd, &count, sizeof(count)) < 0) {
+    // Already drained
+  }
+}
+
+int reactor_poll(int64_t timeout_ns) {
+  struct epoll_event evs[REACTOR_BATCH];
+
+  int n = reactor_wait(evs, timeout_ns);
+  if (n <= 0)
+    return 0;
+
+  // Only the blocking poller drains the wake fd; a non-blocking check
+  // elsewhere must not swallow a wakeup meant for it
+  if (timeout_ns != 0) {
+    for (int i = 0; i < n; i++) {
+      int fd = evs[i].data.fd;
+      if (fd >= 0 && (fd == wake_fd || fd == timer_fd))
+        reactor_drain(fd);
+    }
+  }
+
+  return reactor_dispatch(evs, n);
+}
+
+void reactor_wake(void) {
+  if (wake_fd < 0)
+    return;
+  uint64_t one = 1;
+  if (write(wake_fd, &one, sizeof(one)) < 0) {
+    // Counter saturated: the poller is already being woken
+  }
+}
+
+int reactor_waiters(void) {
+  return __atomic_load_n(&waiter_count, __ATOMIC_ACQUIRE);
+}
+
+void reactor_forget_fd(int fd) {
+  if (fd < 0)
+    return;
+
+  gspin_lock(&io_lock);
+  if (fd >= fd_capacity || !fd_table[fd].registered) {
+    gspin_unlock(&io_lock);
+    return;
+  }
+
+  reactor_fd_t *slot = &fd_table[fd];
+  gthread_t *t = slot->waiters;
+  slot->registered = 0;
+  slot->ready = 0;
+  slot->waiters = NULL;
+
+  // Anyone still parked will retry and see EBADF
+  int woke = 0;
+  while (t) {
+    gthread_t *next = t->next;
+    t->next = NULL;
+    // Phase 41: Unless its timeout has woken it already
+    if (scheduler_claim_wakeup(t)) {
+      t->waiting_fd = -1;
+      scheduler_enqueue_locked(t);
+      woke++;
+    }
+    __atomic_sub_fetch(&waiter_count, 1, __ATOMIC_RELEASE);
+    t = next;
+  }
+  gspin_unlock(&io_lock);
+  scheduler_kick(woke);
+
+  epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+}
@@ -0,0 +1,88 @@
+#include "registry.h"
+#include "pool.h"
+#include "spinlock.h"
+#include <stdlib.h>
+
+#define SLOT_NONE UINT32_MAX
+#define GEN_MASK ((1u << REGISTRY_GEN_BITS) - 1)
+
+typedef struct {
+  gthread_t *thread;  // NULL while free
+  uint32_t gen;       // Bumped when the slot is freed
+  uint32_t next_free; // Free list link
+} reg_slot_t;
+
+static reg_slot_t *slots = NULL;
+static uint32_t nslots = 0; // Slots ever handed out
+static uint32_t capacity = 0;
+static uint32_t free_head = SLOT_NONE;
+static gspinlock_t reg_lock = GSPINLOCK_INIT;
+
+static uint64_t make_id(uint32_t slot, uint32_t gen) {
+  return ((uint64_t)gen << REGISTRY_SLOT_BITS) | slot;
+}
+
+/* Caller holds reg_lock */
+static int registry_grow(void) {
+  uint32_t cap = capacity ? capacity * 2 : REGISTRY_INITIAL;
+  reg_slot_t *table = realloc(slots, cap * sizeof(reg_slot_t));
+  if (!table)
+    return -1;
+  slots = table;
+  capacity = cap;
+  return 0;
+}
+
+int registry_add(gthread_t *t) {
+  gspin_lock(&reg_lock);
+  uint32_t s = free_head;
+  if (s != SLOT_NONE) {
+    free_head = slots[s].next_free;
+  } else {
+    if (nslots == capacity && registry_grow() < 0) {
+      gspin_unlock(&reg_lock);
+      return -1;
+    }
+    s = nslots++;
+    slots[s].gen = 0;
+  }
+  slots[s].thread = t;
+  t->id = make_id(s, slots[s].gen);
+  gspin_unlock(&reg_lock);
+  return 0;
+}
+
+void registry_release(gthread_t *t) {
+  if (__atomic_sub_fetch(&t->reap_refs, 1, __ATOMIC_ACQ_REL) > 0)
+    return;
+
+  uint32_t s = (uint32_t)t->id;
+  gspin_lock(&reg_lock);
+  slots[s].thread = NULL;
+  slots[s].gen = (slots[s].gen + 1) & GEN_MASK;
+  slots[s].next_free = free_head;
+  free_head = s;
+  gspin_unlock(&reg_lock);
+
+  pool_tcb_put(t);
+}
+
+void registry_lock(void) { gspin_lock(&reg_lock); }
+
+void registry_unlock(void) { gspin_unlock(&reg_lock); }
+
+gthread_t *registry_find(uint64_t id) {
+  uint32_t s = (uint32_t)id;
+  if (s >= nslots || !slots[s].thread || make_id(s, slots[s].gen) != id)
+    return NULL;
+  return slots[s].thread;
+}
+
+void registry_for_each(void (*fn)(gthread_t *t, void *arg), void *arg) {
+  gspin_lock(&reg_lock);
+  for (uint32_t s = 0; s < nslots; s++) {
+    if (slots[s].thread)
+      fn(slots[s].thread, arg);
+  }
+  gspin_unlock(&reg_lock);
+}
@@ -1,54 +1,67 @@
 #include "runtime_stats.h"
 #include "gthread.h"
+#include "group.h"
+#include "quota.h"
+#include "registry.h"
 #include "scheduler.h"
+#include "stack.h"
 #include <stdio.h>
 #include <string.h>
 
-// Access internal structures if needed, usually via headers
-// We need to iterate gthread_get_all_threads()
+// Phase 33: Lookups by id go through the registry (registry.h)
 
-extern gthread_t *g_current_thread;
-
-stack_stats_t runtime_get_stack_stats(int tid) {
+stack_stats_t runtime_get_thread_stack_stats(gthread_t *curr) {
   stack_stats_t stats = {0};
-  gthread_t *curr = gthread_get_all_threads();
-  while (curr) {
-    if (curr->id == (uint64_t)tid) {
-      stats.tid = tid;
-      stats.stack_size = curr->stack_size;
-
-      // Calculate usage
-      // Stack grows down from (stack + stack_size)
-      // Current SP is in ctx.rsp OR if running, we approximate
-      uint64_t rsp = curr->ctx.rsp;
-      if (curr == g_current_thread) {
-        // Approximate for running thread
-        uint64_t local_var;
-        rsp = (uint64_t)&local_var;
-      }
-
-      // If stack is NULL (main thread might be), handle it
-      if (curr->stack) {
-        uint64_t high_addr = (uint64_t)curr->stack + curr->stack_size;
-        // Basic range check to prevent underflow wrap-around
-        if (rsp >= (uint64_t)curr->stack && rsp <= high_addr) {
-          stats.stack_used = high_addr - rsp;
-          if (stats.stack_used > curr->stack_size)
-            stats.stack_used = curr->stack_size; // Cap it
-          stats.stack_remaining = curr->stack_size - stats.stack_used;
-        } else {
-          // Invalid SP (maybe thread barely started or context not saved?)
-          stats.stack_used = 0;
-        }
-      } else {
-        // Main thread system stack
-        stats.stack_size = 0; // Unknown
-      }
-      stats.current_sp = (void *)rsp;
-      break;
+  stats.tid = curr->id;
+  stats.stack_size = curr->stack_size;
+
+  // Calculate usage
+  // Stack grows down from (stack + stack_size)
+  // Current SP is in ctx.rsp OR if running, we approximate
+  uint64_t rsp = curr->ctx.rsp;
+  if (curr == g_current_thread) {
+    // Approximate for running thread
+    uint64_t local_var;
+    rsp = (uint64_t)&local_var;
+  }
+
+  // If stack is NULL (main thread might be), handle it
+  if (curr->stack) {
+    uint64_t high_addr = (uint64_t)curr->stack + curr->stack_size;
+    // Basic range check to prevent underflow wrap-around
+    if (rsp >= (uint64_t)curr->stack && rsp <= high_addr) {
+      stats.stack_used = high_addr - rsp;
+      if (stats.stack_used > curr->stack_size)
+        stats.stack_used = curr->stack_size; // Cap it
+      // The guard at the bottom is not usable
+      stats.stack_remaining =
+          curr->stack_size - curr->guard_size > stats.stack_used
+              ? curr->stack_size - curr->guard_size - stats.stack_used
+              : 0;
+      // The reclaim sweep measures resident depth; SP is a lower bound
+      stats.stack_high_water = curr->stack_high_water > stats.stack_used
+                                   ? curr->stack_high_water
+                                   : stats.stack_used;
+      stats.stack_reclaimed = curr->stack_reclaimed;
+    } else {
+      // Invalid SP (maybe thread barely started or context not saved?)
+      stats.stack_used = 0;
     }
-    curr = curr->global_next;
+  } else {
+    // Main thread system stack
+    stats.stack_size = 0; // Unknown
   }
+  stats.current_sp = (void *)rsp;
+  return stats;
+}
+
+stack_stats_t runtime_get_stack_stats(uint64_t tid) {
+  stack_stats_t stats = {0};
+  registry_lock();
+  gthread_t *t = registry_find(tid);
+  if (t)
+    stats = runtime_get_thread_stack_stats(t);
+  registry_unlock();
   return stats;
 }
 
@@ -74,50 +87,124 @@ stack_stats_t runtime_get_stack_stats(int tid) {
 // But I need to support "live updates".
 // Let's follow the plan: Add API to scheduler or gthread.
 
-void runtime_set_tickets(int tid, int tickets) {
-  if (tickets < 1)
-    tickets = 1;
-  gthread_t *curr = gthread_get_all_threads();
-  while (curr) {
-    if (curr->id == (uint64_t)tid) {
-      curr->tickets = tickets;
-      curr->stride = 10000 / tickets;
-      break;
-    }
-    curr = curr->global_next;
-  }
+void runtime_set_tickets(uint64_t tid, int tickets) {
+  registry_lock();
+  gthread_t *curr = registry_find(tid);
+  if (curr)
+    scheduler_set_tickets(curr, tickets); // Phase 34: Re-sorts its heap slot
+  registry_unlock();
 }
 
-int runtime_get_tickets(int tid) {
-  gthread_t *curr = gthread_get_all_threads();
-  while (curr) {
-    if (curr->id == (uint64_t)tid) {
-      return curr->tickets;
-    }
-    curr = curr->global_next;
-  }
-  return 0;
+int runtime_get_tickets(uint64_t tid) {
+  registry_lock();
+  gthread_t *curr = registry_find(tid);
+  int tickets = curr ? (int)curr->tickets : 0;
+  registry_unlock();
+  return tickets;
 }
 
 // IO Stats and Metrics will be filled later after I update scheduler.c to track
 // ctx switches For now stubs
-io_stats_t runtime_get_io_stats(int tid) {
+io_stats_t runtime_get_io_stats(uint64_t tid) {
   io_stats_t stats = {0};
   // To be implemented via lookups
   return stats;
 }
 
+static void count_state(gthread_t *curr, void *arg) {
+  runtime_metrics_t *m = arg;
+  if (curr->state == GTHREAD_READY)
+    m->runnable_count++;
+  else if (curr->state == GTHREAD_BLOCKED)
+    m->waiting_count++; // sleeping is blocked too
+  // Distinguish sleep??
+}
+
 runtime_metrics_t runtime_get_metrics(void) {
   runtime_metrics_t m = {0};
   // Count states
-  gthread_t *curr = gthread_get_all_threads();
-  while (curr) {
-    if (curr->state == GTHREAD_READY)
-      m.runnable_count++;
-    else if (curr->state == GTHREAD_BLOCKED)
-      m.waiting_count++; // sleeping is blocked too
-    // Distinguish sleep??
-    curr = curr->global_next;
-  }
+  gthread_for_each(count_state, &m);
+
+  uint64_t bytes, count;
+  stack_reclaim_totals(&bytes, &count);
+  m.stack_bytes_reclaimed = bytes;
+  m.stack_reclaims = count;
   return m;
 }
+
+typedef struct {
+  quota_stats_t *out;
+  int max;
+  int n;
+} quota_list_t;
+
+static void add_quota(gquota_t *q, void *arg) {
+  quota_list_t *l = arg;
+  if (l->n >= l->max)
+    return;
+
+  quota_stats_t *st = &l->out[l->n++];
+  st->id = q->id;
+  memcpy(st->name, q->name, sizeof(st->name));
+  st->runtime_ns = q->runtime_ns;
+  st->period_ns = q->period_ns;
+  st->used_ns = q->used;
+  st->total_ns = q->total_ns;
+  st->throttles = __atomic_load_n(&q->throttles, __ATOMIC_RELAXED);
+  st->threads = __atomic_load_n(&q->nr_threads, __ATOMIC_RELAXED);
+  st->throttled = __atomic_load_n(&q->nr_throttled, __ATOMIC_RELAXED);
+}
+
+int runtime_get_quota_stats(quota_stats_t *out, int max) {
+  quota_list_t l = {out, max, 0};
+  quota_for_each(add_quota, &l);
+  return l.n;
+}
+
+typedef struct {
+  group_stats_t *out;
+  int max;
+  int n;
+} group_list_t;
+
+static void add_group(ggroup_t *g, void *arg) {
+  group_list_t *l = arg;
+  if (l->n >= l->max)
+    return;
+
+  group_stats_t *st = &l->out[l->n++];
+  st->id = g->id;
+  st->parent = g->parent ? g->parent->id : -1;
+  memcpy(st->name, g->name, sizeof(st->name));
+  st->tickets = g->tickets;
+  st->active = (long)__atomic_load_n(&g->active, __ATOMIC_RELAXED);
+  st->threads = __atomic_load_n(&g->nr_threads, __ATOMIC_RELAXED);
+  st->cpu_ns = __atomic_load_n(&g->cpu_ns, __ATOMIC_RELAXED);
+}
+
+int runtime_get_group_stats(group_stats_t *out, int max) {
+  group_list_t l = {out, max, 0};
+  group_for_each(add_group, &l);
+  return l.n;
+}
+
+typedef struct {
+  int id;
+  int tickets;
+  int found;
+} group_retick_t;
+
+// Under the group list lock, so the group cannot go away meanwhile
+static void retick_group(ggroup_t *g, void *arg) {
+  group_retick_t *r = arg;
+  if (g->id == r->id) {
+    ggroup_set_tickets(g, r->tickets);
+    r->found = 1;
+  }
+}
+
+int runtime_set_group_tickets(int id, int tickets) {
+  group_retick_t r = {id, tickets, 0};
+  group_for_each(retick_group, &r);
+  return r.found ? 0 : -1;
+}
@@ -1,267 +1,1152 @@
 #include "scheduler.h"
 #include "gthread.h"
+#include "group.h"
+#include "policy.h"
+#include "pool.h"
+#include "preempt.h"
+#include "quota.h"
+#include "reactor.h"
+#include "registry.h"
+#include "stack.h"
+#include "timer.h"
+#include "uring.h"
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 // Stride Scheduling Constants
 #define STRIDE_CONSTANT 10000
 
-/* Min-Heap Implementation for Ready Queue */
-#define HEAP_CAPACITY 1024
-static gthread_t *ready_heap[HEAP_CAPACITY];
-static int heap_size = 0;
+#define IDLE_STACK_SIZE (64 * 1024)
 
-gthread_t *g_current_thread = NULL;
 gthread_t g_main_thread;
+int g_nworkers = 1;
+
+/* Worker 0 is the OS thread that called gthread_init */
+static gworker_t g_worker0;
+static gworker_t *workers[MAX_WORKERS] = {&g_worker0};
+static __thread gworker_t *tls_worker = &g_worker0;
 
-/* Zombie thread to be freed */
-static gthread_t *g_zombie_thread = NULL;
+/* Idle workers: one blocks in the reactor (the poller), the rest park on a
+   cond */
+static pthread_mutex_t park_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t park_cond = PTHREAD_COND_INITIALIZER;
+static int idle_workers = 0;
+static int parked_workers = 0;
+static int poller_active = 0;
+
+/* Set when this OS thread queued a pinned thread on another worker.
+   Flushed by scheduler_kick once the caller's locks are released. */
+static __thread int pinned_wake = 0;
 
 /* External assembly function */
 extern void gthread_switch(gthread_ctx_t *new_ctx, gthread_ctx_t *old_ctx);
+extern void gthread_switch_full(gthread_ctx_t *new_ctx, gthread_ctx_t *old_ctx);
+extern void gthread_trampoline(void);
 
-void scheduler_enqueue(gthread_t *t) {
-  if (heap_size >= HEAP_CAPACITY) {
-    fprintf(stderr, "Scheduler: Heap overflow\n");
+static void check_io(gworker_t *w);
+static void check_timers(void);
+static int timer_arm_locked(gthread_t *t, uint64_t deadline_ns);
+
+__attribute__((noinline)) gworker_t *scheduler_worker(void) {
+  return tls_worker;
+}
+
+static uint64_t get_time_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void scheduler_set_accounting(int mode) { policy_set_accounting(mode); }
+
+/* Phase 36: Run queue. The policy classes (policy.c) keep the ordering;
+   this layer does the bookkeeping they share. Caller holds w->rq_lock. */
+static void rq_enqueue(gworker_t *w, gthread_t *t) {
+  const gsched_class_t *c = sched_class_of(t);
+  int woken = t->state != GTHREAD_RUNNING;
+
+  // New and woken threads are placed by their class (Phase 34: against
+  // w's virtual time). A thread coming straight off the CPU is already on
+  // w's clock.
+  if (woken) {
+    // Phase 35: Settle the run that ended in the block first, if its
+    // worker has got that far (otherwise it is settled on dispatch)
+    if (policy_account_time && t->unpaid)
+      t->pass += __atomic_exchange_n(&t->unpaid, 0, __ATOMIC_RELAXED);
+    c->wake(w, t);
+  }
+  t->state = GTHREAD_READY;
+  // Phase 38: Counts in its groups again (after READY: see
+  // scheduler_switch), and its stride follows what they hold now
+  if (t->timed && t->group) {
+    if (woken)
+      group_thread_active(t);
+    t->stride = group_stride(t, STRIDE_CONSTANT / t->tickets);
+  }
+  t->rq = w;
+  t->last_rq = w;
+  c->enqueue(w, t);
+  w->nr_ready++;
+}
+
+static void rq_dequeue(gworker_t *w, gthread_t *t) {
+  sched_class_of(t)->dequeue(w, t);
+  w->nr_ready--;
+  t->rq = NULL;
+}
+
+/* Lock the run queue t is on, if any. t->rq can change until we hold the
+   owner's lock, so re-check after acquiring it. */
+static gworker_t *rq_lock_owner(gthread_t *t) {
+  while (1) {
+    gworker_t *w = __atomic_load_n(&t->rq, __ATOMIC_ACQUIRE);
+    if (!w)
+      return NULL;
+    gspin_lock(&w->rq_lock);
+    if (t->rq == w)
+      return w;
+    gspin_unlock(&w->rq_lock);
+  }
+}
+
+int scheduler_remove(gthread_t *t) {
+  gworker_t *w = rq_lock_owner(t);
+  if (!w)
+    return 0;
+  rq_dequeue(w, t);
+  gspin_unlock(&w->rq_lock);
+  return 1;
+}
+
+void scheduler_set_pass(gthread_t *t, uint64_t pass) {
+  gworker_t *w = rq_lock_owner(t);
+  if (!w) {
+    t->pass = pass;
     return;
   }
 
-  t->state = GTHREAD_READY;
+  const gsched_class_t *c = sched_class_of(t);
+  c->dequeue(w, t);
+  t->pass = pass;
+  c->enqueue(w, t);
+  gspin_unlock(&w->rq_lock);
+}
 
-  // Insert at end
-  int i = heap_size++;
-  ready_heap[i] = t;
+/* Phase 34: A queued thread is re-keyed by its class and re-sorted, so the
+   new share shows from its next turn. Running and blocked threads pick up
+   the stride on their next charge. */
+void scheduler_set_tickets(gthread_t *t, int tickets) {
+  if (tickets < 1)
+    tickets = 1;
+  uint64_t stride = STRIDE_CONSTANT / tickets;
+  if (!stride)
+    stride = 1;
 
-  // Bubble up
-  while (i > 0) {
-    int parent = (i - 1) / 2;
-    if (ready_heap[parent]->pass <= ready_heap[i]->pass) {
-      break;
-    }
-    // Swap
-    gthread_t *temp = ready_heap[parent];
-    ready_heap[parent] = ready_heap[i];
-    ready_heap[i] = temp;
-    i = parent;
+  gworker_t *w = rq_lock_owner(t);
+  t->tickets = tickets;
+  // Phase 38: A member's share of its group changes with it
+  if (t->group) {
+    group_thread_retick(t, tickets);
+    stride = group_stride(t, stride);
+  }
+  if (!w) {
+    t->stride = stride;
+    return;
   }
+
+  const gsched_class_t *c = sched_class_of(t);
+  c->dequeue(w, t);
+  c->reweight(w, t, stride);
+  c->enqueue(w, t);
+  gspin_unlock(&w->rq_lock);
 }
 
-gthread_t *scheduler_dequeue(void) {
-  if (heap_size == 0)
-    return NULL;
+/* Phase 36: Only the calling thread changes class: it is not queued, so
+   nothing needs re-sorting, and the class applies from its next enqueue.
+   Leaving EDF, its stale pass is replaced by the virtual time. */
+void scheduler_set_deadline(uint64_t deadline_ns) {
+  gworker_t *w = scheduler_worker();
+  gthread_t *t = w->current;
+
+  gspin_lock(&w->rq_lock);
+  t->deadline_ns = deadline_ns;
+  if (deadline_ns) {
+    t->sched_class = GSCHED_EDF;
+  } else if (t->sched_class == GSCHED_EDF) {
+    t->sched_class = GSCHED_FAIR;
+    t->pass = 0;
+    t->last_rq = NULL;
+    sched_class_of(t)->wake(w, t);
+    t->last_rq = w; // The clock that pass is on
+  }
+  gspin_unlock(&w->rq_lock);
+}
 
-  gthread_t *min = ready_heap[0];
+/* New work appeared: get an idle worker to come and steal it */
+static void wake_idle_worker(void) {
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&idle_workers, __ATOMIC_RELAXED) == 0)
+    return;
 
-  // Move last to root
-  ready_heap[0] = ready_heap[--heap_size];
+  // Called from green threads: a preempted owner would deadlock the next
+  gpreempt_off();
+  pthread_mutex_lock(&park_lock);
+  if (parked_workers > 0)
+    pthread_cond_signal(&park_cond);
+  else if (poller_active)
+    reactor_wake();
+  pthread_mutex_unlock(&park_lock);
+  gpreempt_on();
+}
 
-  // Bubble down
-  int i = 0;
-  while (1) {
-    int left = 2 * i + 1;
-    int right = 2 * i + 2;
-    int smallest = i;
+/* A pinned thread was queued on some other worker, which may be parked or
+   polling: wake them all, only its home can run it */
+static void wake_all_idle_workers(void) {
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&idle_workers, __ATOMIC_RELAXED) == 0)
+    return;
+
+  gpreempt_off();
+  pthread_mutex_lock(&park_lock);
+  if (parked_workers > 0)
+    pthread_cond_broadcast(&park_cond);
+  if (poller_active)
+    reactor_wake();
+  pthread_mutex_unlock(&park_lock);
+  gpreempt_on();
+}
+
+/* Phase 37: CPU used by a timed thread since run_since, for its pool and
+   (Phase 38) its groups */
+static void charge_run(gthread_t *t, uint64_t now) {
+  uint64_t ns = now - t->run_since;
+  if (t->quota)
+    quota_charge(t->quota, ns);
+  if (t->group)
+    group_charge(t->group, ns);
+}
+
+/* Phase 37: t's CPU pool has used up its period: park t on the timer
+   wheel until the next one, as if asleep, instead of queueing it */
+static int quota_park(gworker_t *self, gthread_t *t, int timer_held) {
+  uint64_t until = quota_exhausted(t->quota, get_time_ns());
+  if (!until)
+    return 0;
+
+  if (!t->throttled) {
+    t->throttled = 1;
+    quota_throttled(t->quota);
+  }
+  // A preempted thread must resume on this worker (see stealable)
+  if (t == self->current)
+    t->last_rq = self;
+  if (!timer_held) {
+    scheduler_enqueue_sleep(t, until);
+  } else {
+    timer_arm_locked(t, until);
+  }
+  return 1;
+}
 
-    if (left < heap_size &&
-        ready_heap[left]->pass < ready_heap[smallest]->pass) {
-      smallest = left;
+/* timer_held: called by check_timers, which holds timer_lock */
+static void enqueue_thread(gthread_t *t, int timer_held) {
+  gworker_t *self = scheduler_worker();
+  gworker_t *w = t->home ? t->home : self;
+  // Phase 37: Preempted, then throttled: back to the worker it left
+  if (t->preempted && t != self->current)
+    w = t->last_rq;
+
+  // Phase 35: Yield or preemption: pay for this run before taking a slot.
+  // Phase 37: Same for its CPU pool (and, Phase 38, its groups).
+  if (t == self->current && (policy_account_time || t->timed)) {
+    uint64_t now = get_time_ns();
+    if (policy_account_time) {
+      t->pass += sched_class_of(t)->tick(t, now - self->run_start_ns);
+      self->run_start_ns = now;
+    }
+    if (t->timed) {
+      charge_run(t, now);
+      t->run_since = now;
     }
-    if (right < heap_size &&
-        ready_heap[right]->pass < ready_heap[smallest]->pass) {
-      smallest = right;
+  }
+  if (t->timed && t->quota) {
+    if (quota_park(self, t, timer_held))
+      return;
+    if (t->throttled) {
+      t->throttled = 0;
+      quota_unthrottled(t->quota);
     }
+  }
 
-    if (smallest == i)
-      break;
+  gspin_lock(&w->rq_lock);
+  rq_enqueue(w, t);
+  gspin_unlock(&w->rq_lock);
+  if (w != self)
+    pinned_wake = 1;
+}
+
+/* Queue on this worker (a shared-stack thread's home worker) without
+   waking anyone. Safe to call while holding the reactor lock. */
+void scheduler_enqueue_locked(gthread_t *t) { enqueue_thread(t, 0); }
+
+void scheduler_enqueue(gthread_t *t) {
+  scheduler_enqueue_locked(t);
+
+  if (pinned_wake) {
+    pinned_wake = 0;
+    wake_all_idle_workers();
+    return;
+  }
+  // A yielding thread re-queues itself; only foreign work is worth a steal
+  if (g_nworkers > 1 && t != g_current_thread)
+    wake_idle_worker();
+}
+
+/* Follow-up to a batch of scheduler_enqueue_locked calls: one extra thread
+   keeps this worker busy, more are worth stealing. */
+void scheduler_kick(int woken) {
+  if (pinned_wake) {
+    pinned_wake = 0;
+    wake_all_idle_workers();
+    return;
+  }
+  if (woken > 1 && g_nworkers > 1)
+    wake_idle_worker();
+}
 
-    gthread_t *temp = ready_heap[i];
-    ready_heap[i] = ready_heap[smallest];
-    ready_heap[smallest] = temp;
-    i = smallest;
+/* Phase 43: Wake a list of blocked threads linked through t->next, taken
+   off whatever they waited on: one kick for the lot, not one per thread */
+void scheduler_enqueue_list(gthread_t *t) {
+  if (!t)
+    return;
+  if (!t->next) {
+    scheduler_enqueue(t);
+    return;
   }
 
-  return min;
+  int woken = 0;
+  while (t) {
+    gthread_t *next = t->next; // t may run as soon as it is queued
+    t->next = NULL;
+    scheduler_enqueue_locked(t);
+    woken++;
+    t = next;
+  }
+  scheduler_kick(woken);
 }
 
-static void free_zombie(void) {
-  if (g_zombie_thread) {
-    if (g_zombie_thread->stack) {
-      free(g_zombie_thread->stack);
+/* Pop the most urgent thread of the highest class that has one, unless
+   another worker is still switching off its stack. Running it now would
+   corrupt its saved context. */
+static gthread_t *rq_pop(gworker_t *w) {
+  if (__atomic_load_n(&w->nr_ready, __ATOMIC_RELAXED) == 0)
+    return NULL;
+
+  gthread_t *t = NULL;
+  gspin_lock(&w->rq_lock);
+  for (int c = GSCHED_CLASSES - 1; c >= 0; c--) {
+    gthread_t *first = sched_classes[c]->first(w);
+    if (!first)
+      continue;
+    if (first == w->current ||
+        !__atomic_load_n(&first->on_cpu, __ATOMIC_ACQUIRE)) {
+      rq_dequeue(w, first);
+      t = first;
     }
-    free(g_zombie_thread);
-    g_zombie_thread = NULL;
+    break;
   }
+  gspin_unlock(&w->rq_lock);
+  return t;
 }
 
-/* Sleep Queue (Unsorted List) */
-static gthread_t *sleep_list = NULL;
+/* Can another worker take t? Not while its old worker is still switching
+   off its stack, nor a preempted thread (its signal frame expects the OS
+   thread it was interrupted on) or one living on a shared stack. */
+static int stealable(gthread_t *t) {
+  return !__atomic_load_n(&t->on_cpu, __ATOMIC_ACQUIRE) && !t->preempted &&
+         !t->home;
+}
 
-void scheduler_enqueue_sleep(gthread_t *t) {
-  t->state = GTHREAD_BLOCKED;
-  t->next = sleep_list;
-  sleep_list = t;
+/* Least urgent stealable thread queued on v, highest class first */
+static gthread_t *rq_steal_candidate(gworker_t *v) {
+  for (int c = GSCHED_CLASSES - 1; c >= 0; c--) {
+    gthread_t *t = sched_classes[c]->last(v);
+    if (t && stealable(t))
+      return t;
+  }
+  return NULL;
 }
 
-#include <time.h>
-static uint64_t get_time_ms(void) {
-  struct timespec ts;
-  clock_gettime(CLOCK_MONOTONIC, &ts);
-  return (uint64_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+/* Take the least urgent thread from another worker: cheap to find (a heap
+   leaf, a tree's cached last node), and leaves the victim's most urgent
+   threads in place. */
+static gthread_t *rq_steal(gworker_t *self) {
+  for (int i = 1; i < g_nworkers; i++) {
+    gworker_t *v = workers[(self->id + i) % g_nworkers];
+    if (__atomic_load_n(&v->nr_ready, __ATOMIC_RELAXED) == 0)
+      continue;
+    if (!gspin_trylock(&v->rq_lock))
+      continue;
+
+    gthread_t *t = rq_steal_candidate(v);
+    int more = 0;
+    if (t) {
+      rq_dequeue(v, t);
+      // Phase 34: Same lead, on our clock
+      sched_class_of(t)->wake(self, t);
+      t->last_rq = self;
+      more = rq_steal_candidate(v) != NULL;
+    }
+    gspin_unlock(&v->rq_lock);
+    // One kick woke us for a whole batch, and v may never schedule again
+    // (its thread does not yield): pass the wakeup on for the rest
+    if (more)
+      wake_idle_worker();
+    if (t)
+      return t;
+  }
+  return NULL;
 }
 
-static void check_timers(void) {
-  if (!sleep_list)
-    return;
+static gthread_t *scheduler_dequeue(gworker_t *w) {
+  gthread_t *t = rq_pop(w);
+  if (!t && g_nworkers > 1)
+    t = rq_steal(w);
+  return t;
+}
+
+/* Is there anything this worker could pick up right now? */
+static int scheduler_has_work(gworker_t *self) {
+  for (int i = 0; i < g_nworkers; i++) {
+    gworker_t *w = workers[i];
+    if (__atomic_load_n(&w->nr_ready, __ATOMIC_RELAXED) == 0)
+      continue;
+    if (w == self)
+      return 1;
+
+    gspin_lock(&w->rq_lock);
+    int found = rq_steal_candidate(w) != NULL;
+    gspin_unlock(&w->rq_lock);
+    if (found)
+      return 1;
+  }
+  return 0;
+}
+
+/* Anything queued anywhere, stealable or not */
+static int scheduler_any_queued(void) {
+  for (int i = 0; i < g_nworkers; i++) {
+    if (__atomic_load_n(&workers[i]->nr_ready, __ATOMIC_RELAXED) > 0)
+      return 1;
+  }
+  return 0;
+}
+
+/* Release the stack, then the exit's reference to the TCB (Phase 33): a
+   joiner on another worker may still be reading it. */
+static void free_zombie(gworker_t *w, gthread_t *z) {
+  if (z->stack) {
+    // Phase 32: Only stacks with the default guard are interchangeable
+    if (z->guard_size == STACK_GUARD_SIZE)
+      pool_stack_put(z->stack, z->stack_size);
+    else
+      stack_unmap(z->stack, z->stack_size);
+    z->stack = NULL;
+  }
+  if (z->home) {
+    if (w->stack_owner == z)
+      w->stack_owner = NULL;
+    free(z->saved_stack);
+    z->saved_stack = NULL;
+    z->saved_cap = z->saved_size = 0;
+  }
+  // Phase 37: Charged for the last time. Under the registry lock, so the
+  // dashboards never follow it to a freed pool (or Phase 38 group).
+  if (z->timed) {
+    registry_lock();
+    quota_attach(z, NULL);
+    group_attach(z, NULL, 0);
+    registry_unlock();
+  }
+  registry_release(z);
+}
 
-  uint64_t now = get_time_ms();
+/* Runs on the new thread's stack right after gthread_switch (or from the
+   trampoline for a fresh thread): the old stack is no longer in use. */
+/* The preemption handler runs on this OS thread, so a compiler barrier is
+   all the ordering it needs */
+static void set_switching(gworker_t *w, int on) {
+  __atomic_signal_fence(__ATOMIC_SEQ_CST);
+  w->switching = on;
+  __atomic_signal_fence(__ATOMIC_SEQ_CST);
+}
+
+void scheduler_finish_switch(void) {
+  gworker_t *w = scheduler_worker();
+  gthread_t *prev = w->prev;
+  if (prev) {
+    w->prev = NULL;
+
+    __atomic_store_n(&prev->on_cpu, 0, __ATOMIC_RELEASE);
+
+    // We are off its stack now, so a finished thread can go right away
+    // and a stale id stops resolving as soon as it has been joined
+    if (prev->state == GTHREAD_TERMINATED && prev != &g_main_thread)
+      free_zombie(w, prev);
+  }
+  set_switching(w, 0);
+}
+
+/* Shared stacks (copy-stack mode) */
+static size_t shared_stack_size = 0;
+static int next_home = 0;
+
+static char *shared_top(gworker_t *w) {
+  return (char *)w->shared_stack + w->shared_size;
+}
+
+uint64_t scheduler_shared_stack_top(gthread_t *t) {
+  if (!shared_stack_size)
+    return 0;
+  int i = __atomic_fetch_add(&next_home, 1, __ATOMIC_RELAXED) % g_nworkers;
+  t->home = workers[i];
+  return (uint64_t)shared_top(t->home) & ~0xFUL;
+}
+
+/* Park the owner's live frames in its buffer and put next's back on the
+   shared stack. Must not run on the shared stack itself. */
+static void shared_stack_load(gworker_t *w, gthread_t *next) {
+  char *top = shared_top(w);
+  gthread_t *owner = w->stack_owner;
+
+  if (owner && owner->state != GTHREAD_TERMINATED) {
+    size_t size = top - (char *)owner->ctx.rsp;
+    // Right-size: grow to fit, give back memory after a deep excursion
+    if (size > owner->saved_cap || size * 4 < owner->saved_cap) {
+      size_t cap = (size + 255) & ~(size_t)255;
+      void *buf = realloc(owner->saved_stack, cap ? cap : 256);
+      if (!buf) {
+        fprintf(stderr, "Scheduler: Out of memory saving a shared stack\n");
+        exit(1);
+      }
+      owner->saved_stack = buf;
+      owner->saved_cap = cap ? cap : 256;
+    }
+    memcpy(owner->saved_stack, top - size, size);
+    owner->saved_size = size;
+  }
+
+  memcpy(top - next->saved_size, next->saved_stack, next->saved_size);
+  w->stack_owner = next;
+}
+
+/* Body of each worker's copier context. Entered (not called) with the
+   switch still in progress, so it skips scheduler_finish_switch. */
+static void copier_main(void) {
+  gworker_t *w = scheduler_worker();
+  while (1) {
+    gthread_t *next = w->copy_next;
+    shared_stack_load(w, next);
+    gthread_switch(&next->ctx, &w->copier.ctx);
+  }
+}
+
+/* full: called from the preemption handler, keep the FPU state too */
+static void scheduler_switch(gworker_t *w, gthread_t *next, int full) {
+  gthread_t *prev = w->current;
+  set_switching(w, 1);
 
-  gthread_t *prev = NULL;
-  gthread_t *curr = sleep_list;
+  // Phase 35: Time accounting. A thread that re-queued itself has paid
+  // already; one that blocked or exited owes for its run until now.
+  uint64_t now = 0;
+  if (policy_account_time && prev->state != GTHREAD_READY) {
+    now = get_time_ns();
+    if (prev != &w->idle) {
+      uint64_t ran = now - w->run_start_ns;
+      uint64_t charge = sched_class_of(prev)->tick(prev, ran);
+      if (charge)
+        __atomic_add_fetch(&prev->unpaid, charge, __ATOMIC_RELAXED);
+    }
+    w->run_start_ns = now;
+  }
+
+  // Phase 37: Quota runs are timed whatever the accounting mode
+  if (prev->timed && prev->state != GTHREAD_READY) {
+    if (!now)
+      now = get_time_ns();
+    charge_run(prev, now);
+  }
+  if (next->timed) {
+    if (!now)
+      now = get_time_ns();
+    next->run_since = now;
+  }
 
-  while (curr) {
-    if (curr->wake_time_ms <= now) {
-      // Wake up
-      gthread_t *next = curr->next;
+  // Phase 38: A thread that blocked or exited stops counting in its groups.
+  // A waker may have queued it again meanwhile: it sets READY before
+  // counting it back in, so whichever of us goes second restores it.
+  if (prev->timed && prev->group &&
+      (prev->state == GTHREAD_BLOCKED || prev->state == GTHREAD_TERMINATED)) {
+    group_thread_inactive(prev);
+    if (__atomic_load_n(&prev->state, __ATOMIC_ACQUIRE) == GTHREAD_READY)
+      group_thread_active(prev);
+  }
 
-      if (prev)
-        prev->next = next;
-      else
-        sleep_list = next;
+  // Update Pass. Phase 36: next's class does its bookkeeping (the fair
+  // classes advance the virtual time; stride counting picks pays up front).
+  if (next != &w->idle) {
+    sched_class_of(next)->pick(w, next);
+    if (policy_account_time && next->unpaid) // Woken before its old worker
+      next->pass += __atomic_exchange_n(&next->unpaid, 0, __ATOMIC_RELAXED);
+  }
 
-      scheduler_enqueue(curr);
-      curr = next;
+  w->current = next;
+  next->state = GTHREAD_RUNNING;
+  next->runs++;
+
+  if (prev == next) {
+    set_switching(w, 0);
+    return;
+  }
+
+  __atomic_store_n(&next->on_cpu, 1, __ATOMIC_RELAXED);
+  w->prev = prev;
+  w->switches++;
+
+  gthread_ctx_t *to = &next->ctx;
+  if (next->home && w->stack_owner != next) {
+    if (prev->home) {
+      // Running on the stack we are about to overwrite: go via the copier
+      w->copy_next = next;
+      to = &w->copier.ctx;
     } else {
-      prev = curr;
-      curr = curr->next;
+      shared_stack_load(w, next);
     }
   }
+
+  if (full)
+    gthread_switch_full(to, &prev->ctx);
+  else
+    gthread_switch(to, &prev->ctx);
+
+  // Possibly resumed on another worker
+  scheduler_finish_switch();
+}
+
+/* From the preemption handler: the current thread overran its slice. It is
+   queued like a yield but pinned to this worker (see stealable), so the
+   handler returns on the OS thread its signal frame belongs to. Threads
+   that never yield reach no other scheduling point, so this one services
+   the timers and (when due) the reactor too. */
+void scheduler_preempt(gworker_t *w) {
+  gthread_t *cur = w->current;
+  set_switching(w, 1);
+
+  cur->preempted = 1;
+  scheduler_enqueue_locked(cur);
+  check_io(w);
+  check_timers();
+  gthread_t *next = rq_pop(w);
+  // Phase 37: Out of CPU quota, and parked
+  if (!next && cur->state == GTHREAD_BLOCKED)
+    next = &w->idle;
+  if (next) {
+    scheduler_switch(w, next, 1);
+  } else {
+    // The most urgent thread is still switching off another worker: keep
+    // running
+    scheduler_remove(cur);
+    cur->state = GTHREAD_RUNNING;
+    set_switching(w, 0);
+  }
+  cur->preempted = 0;
 }
 
-#include <poll.h>
+/* Sleep Queue (Timer Wheel) */
+static timer_wheel_t timer_wheel;
+static gspinlock_t timer_lock = GSPINLOCK_INIT;
+// timer_next_ns() cached for the lock-free checks below
+static uint64_t next_expiry_ns = TIMER_NEVER;
 
-#define MAX_POLL_FDS 128
-static struct pollfd poll_fds[MAX_POLL_FDS];
-static gthread_t *poll_threads[MAX_POLL_FDS];
-static int poll_count = 0;
+static gthread_t *timer_thread(gtimer_t *tm) {
+  return (gthread_t *)((char *)tm - offsetof(gthread_t, timer));
+}
 
-void scheduler_register_io_wait(int fd, int events) {
-  if (poll_count >= MAX_POLL_FDS)
+/* Caller holds timer_lock. Returns whether this is now the first
+   deadline. */
+static int timer_arm_locked(gthread_t *t, uint64_t deadline_ns) {
+  t->state = GTHREAD_BLOCKED;
+  t->timer.deadline_ns = deadline_ns;
+  timer_add(&timer_wheel, &t->timer);
+
+  uint64_t next = timer_next_ns(&timer_wheel);
+  int earlier = next < next_expiry_ns;
+  __atomic_store_n(&next_expiry_ns, next, __ATOMIC_RELAXED);
+  return earlier;
+}
+
+void scheduler_enqueue_sleep(gthread_t *t, uint64_t deadline_ns) {
+  gspin_lock(&timer_lock);
+  int earlier = timer_arm_locked(t, deadline_ns);
+  gspin_unlock(&timer_lock);
+
+  // The poller may be waiting for a later deadline
+  if (!earlier)
     return;
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&poller_active, __ATOMIC_RELAXED))
+    reactor_wake();
+}
 
-  poll_fds[poll_count].fd = fd;
-  poll_fds[poll_count].events = events;
-  poll_fds[poll_count].revents = 0;
+/* Phase 41: Timed waits. t has queued itself on a wait object, under that
+   object's lock; its timer goes on the wheel next to the wait. */
+void scheduler_block_timeout(gthread_t *t, uint64_t deadline_ns) {
+  t->timed_wait = TIMED_WAIT_ARMED;
+  scheduler_enqueue_sleep(t, deadline_ns);
+}
 
-  poll_threads[poll_count] = g_current_thread;
-  g_current_thread->state = GTHREAD_BLOCKED;
-  g_current_thread->waiting_fd = fd; // Phase 13
+/* The timer and the wait object race to wake t: the first to claim it
+   does, and whichever loses leaves t alone. Claiming cancels the timer,
+   O(1), in the same critical section, so a timer that fires on t later
+   is a sleep or a throttle again. */
+int scheduler_claim_wakeup(gthread_t *t) {
+  if (__atomic_load_n(&t->timed_wait, __ATOMIC_ACQUIRE) == TIMED_WAIT_NONE)
+    return 1;
 
-  poll_count++;
-  scheduler_schedule();
+  gspin_lock(&timer_lock);
+  int won = t->timed_wait == TIMED_WAIT_ARMED;
+  if (won) {
+    t->timed_wait = TIMED_WAIT_NONE;
+    // next_expiry_ns may now be early: the pass that finds nothing due
+    // then recomputes it, which is cheaper than doing so on every wakeup
+    timer_cancel(&timer_wheel, &t->timer);
+  }
+  gspin_unlock(&timer_lock);
+  return won;
 }
 
-static void check_io(int timeout_ms) {
-  if (poll_count == 0 && timeout_ms > 0) {
-    usleep(timeout_ms * 1000);
+static void check_timers(void) {
+  // Common case costs one clock read: nothing due yet
+  uint64_t next = __atomic_load_n(&next_expiry_ns, __ATOMIC_RELAXED);
+  if (next == TIMER_NEVER)
     return;
+  uint64_t now = get_time_ns();
+  if (now < next)
+    return;
+
+  int woke = 0;
+  gspin_lock(&timer_lock);
+  gtimer_t *tm = timer_expire(&timer_wheel, now);
+  while (tm) {
+    gtimer_t *next_tm = tm->next;
+    tm->next = NULL;
+    // Phase 41: A timed wait that nobody claimed has timed out. The thread
+    // takes itself off its wait object when it runs.
+    gthread_t *t = timer_thread(tm);
+    if (t->timed_wait == TIMED_WAIT_ARMED)
+      t->timed_wait = TIMED_WAIT_EXPIRED;
+    // Enqueue under timer_lock so the thread is never invisible to the
+    // deadlock check in worker_wait. Phase 37: A throttled thread whose
+    // pool is still in debt goes straight back on the wheel.
+    enqueue_thread(t, 1);
+    woke++;
+    tm = next_tm;
+  }
+  __atomic_store_n(&next_expiry_ns, timer_next_ns(&timer_wheel),
+                   __ATOMIC_RELAXED);
+  gspin_unlock(&timer_lock);
+
+  scheduler_kick(woke);
+}
+
+/* Nanoseconds until the timer wheel next needs service, or -1 if empty */
+static int64_t next_timer_timeout(void) {
+  gspin_lock(&timer_lock);
+  // Phase 41: Exact, not the hint a claimed wakeup can leave early
+  uint64_t next = timer_next_ns(&timer_wheel);
+  __atomic_store_n(&next_expiry_ns, next, __ATOMIC_RELAXED);
+  gspin_unlock(&timer_lock);
+  if (next == TIMER_NEVER)
+    return -1;
+
+  uint64_t now = get_time_ns();
+  if (next <= now)
+    return 0;
+  uint64_t ns = next - now;
+  return ns > INT64_MAX ? INT64_MAX : (int64_t)ns;
+}
+
+void scheduler_register_io_wait(int fd, int events) {
+  // New registrations are seen by an epoll_wait already in progress, so
+  // unlike timers there is no need to wake the poller
+  if (reactor_arm(g_current_thread, fd, events, 0))
+    scheduler_schedule();
+}
+
+int scheduler_wait_io_until(int fd, int events, uint64_t deadline_ns) {
+  gthread_t *cur = g_current_thread;
+  if (!reactor_arm(cur, fd, events, deadline_ns))
+    return 0;
+  scheduler_schedule();
+  return reactor_timed_out(cur, fd) ? -1 : 0;
+}
+
+/* Reactor polling policy, see gthread_set_io_poll */
+static int io_poll_every = IO_POLL_EVERY_DEFAULT;
+static uint64_t io_poll_budget_ns = IO_POLL_BUDGET_DEFAULT;
+
+void scheduler_set_io_poll(int every_switches, uint64_t budget_ns) {
+  io_poll_every = every_switches < 1 ? 1 : every_switches;
+  io_poll_budget_ns = budget_ns;
+}
+
+/* Is this switch due an epoll_wait? Keeps a yield between busy threads
+   free of syscalls. */
+static int io_poll_due(gworker_t *w) {
+  // Nothing else to run (a yielding thread has re-queued itself)
+  if (w->nr_ready <= (w->current->state == GTHREAD_READY))
+    return 1;
+  if (++w->io_switches >= io_poll_every)
+    return 1;
+  return io_poll_budget_ns &&
+         get_time_ns() - w->io_poll_ns >= io_poll_budget_ns;
+}
+
+/* Non-blocking readiness check, run on every scheduling decision. io_uring
+   submissions are batched until this worker runs out of work. */
+static void check_io(gworker_t *w) {
+  int idle = __atomic_load_n(&w->nr_ready, __ATOMIC_RELAXED) == 0;
+  int woke = uring_poll(idle);
+  if (reactor_waiters() > 0 && io_poll_due(w)) {
+    woke += reactor_poll(0);
+    w->io_switches = 0;
+    if (io_poll_budget_ns)
+      w->io_poll_ns = get_time_ns();
+  }
+  scheduler_kick(woke);
+}
+
+/* Phase 31: Idle stack reclaim. A sweep over all threads times each
+   blocked spell (from first sight, via `runs`) and releases the stack
+   below the saved SP once it passes the threshold. */
+static uint64_t reclaim_idle_ns = RECLAIM_IDLE_DEFAULT;
+static uint64_t reclaim_next_ns = 0;
+static int reclaim_armed = 0; // Spells are being timed: keep sweeping
+static int reclaim_busy = 0;
+
+void scheduler_set_stack_reclaim(uint64_t idle_ns) {
+  __atomic_store_n(&reclaim_idle_ns, idle_ns, __ATOMIC_RELAXED);
+}
+
+static int reclaim_enabled(void) {
+  return __atomic_load_n(&reclaim_idle_ns, __ATOMIC_RELAXED) &&
+         !shared_stack_size;
+}
+
+/* Keep other workers off t's stack, as if it were switching off a CPU.
+   Only a blocked thread qualifies: it is on no heap and nobody can pick it
+   until on_cpu drops. */
+static int reclaim_claim(gthread_t *t) {
+  int idle = 0;
+  if (!__atomic_compare_exchange_n(&t->on_cpu, &idle, 1, 0, __ATOMIC_SEQ_CST,
+                                   __ATOMIC_RELAXED))
+    return 0;
+  if (__atomic_load_n(&t->state, __ATOMIC_SEQ_CST) == GTHREAD_BLOCKED)
+    return 1;
+
+  // Woken under us. Still queued: nobody can have popped it, undo. Not
+  // queued: a worker took it just before the claim and will set on_cpu
+  // itself, so leave it.
+  gworker_t *w = rq_lock_owner(t);
+  if (w) {
+    __atomic_store_n(&t->on_cpu, 0, __ATOMIC_RELEASE);
+    gspin_unlock(&w->rq_lock);
   }
-  if (poll_count == 0 && timeout_ms <= 0)
+  return 0;
+}
+
+typedef struct {
+  uint64_t now;
+  uint64_t idle_ns;
+  int pending;
+} reclaim_sweep_t;
+
+/* Called for each thread under the registry lock (Phase 33), which keeps
+   the TCB from being reaped meanwhile */
+static void reclaim_visit(gthread_t *t, void *arg) {
+  reclaim_sweep_t *sw = arg;
+  if (!t->stack || t->home ||
+      __atomic_load_n(&t->state, __ATOMIC_ACQUIRE) != GTHREAD_BLOCKED)
     return;
 
-  int ret = poll(poll_fds, poll_count, timeout_ms);
-  if (ret > 0) {
-    for (int i = 0; i < poll_count; i++) {
-      if (poll_fds[i].revents) {
-        gthread_t *t = poll_threads[i];
-        t->waiting_fd = -1; // Phase 13
-        scheduler_enqueue(t);
-
-        // Remove
-        poll_fds[i] = poll_fds[poll_count - 1];
-        poll_threads[i] = poll_threads[poll_count - 1];
-        poll_count--;
-        i--;
-      }
-    }
+  uint32_t runs = __atomic_load_n(&t->runs, __ATOMIC_RELAXED);
+  if (runs != t->reclaim_runs) {
+    // A new spell: start timing it
+    t->reclaim_runs = runs;
+    t->reclaim_since_ns = sw->now;
+    t->reclaim_done = 0;
+    sw->pending = 1;
+    return;
+  }
+  if (t->reclaim_done)
+    return;
+  if (sw->now - t->reclaim_since_ns < sw->idle_ns || !reclaim_claim(t)) {
+    sw->pending = 1;
+    return;
   }
+
+  t->stack_reclaimed +=
+      stack_reclaim(t->stack, t->stack_size, t->guard_size, t->ctx.rsp,
+                    &t->stack_high_water);
+  t->reclaim_done = 1;
+  __atomic_store_n(&t->on_cpu, 0, __ATOMIC_RELEASE);
 }
 
-void scheduler_schedule(void) {
-  // Try to clear IO first
-  check_io(0);
-  check_timers();
+static void reclaim_sweep(uint64_t now, uint64_t idle_ns) {
+  reclaim_sweep_t sw = {now, idle_ns, 0};
+  __atomic_store_n(&reclaim_armed, 0, __ATOMIC_SEQ_CST);
+  registry_for_each(reclaim_visit, &sw);
+  if (sw.pending)
+    __atomic_store_n(&reclaim_armed, 1, __ATOMIC_SEQ_CST);
+}
 
-  gthread_t *prev = g_current_thread;
-  gthread_t *next = scheduler_dequeue();
-
-  while (!next) {
-    // Logic: If no threads, we wait.
-    // Calc timeout:
-    int timeout = -1;
-    if (sleep_list) {
-      uint64_t now = get_time_ms();
-      // Find min wake time
-      gthread_t *curr = sleep_list;
-      uint64_t min_wake = (uint64_t)-1;
-      while (curr) {
-        if (curr->wake_time_ms < min_wake)
-          min_wake = curr->wake_time_ms;
-        curr = curr->next;
-      }
-      if (min_wake > now)
-        timeout = (int)(min_wake - now);
-      else
-        timeout = 0;
+/* Sweep if one is due. A claimed thread stalls whoever wants to run it, so
+   the sweep must not be preempted halfway. */
+static void reclaim_poll(void) {
+  uint64_t idle_ns = __atomic_load_n(&reclaim_idle_ns, __ATOMIC_RELAXED);
+  if (!reclaim_enabled())
+    return;
+  uint64_t now = get_time_ns();
+  if (now < __atomic_load_n(&reclaim_next_ns, __ATOMIC_RELAXED))
+    return;
+  if (__atomic_exchange_n(&reclaim_busy, 1, __ATOMIC_ACQUIRE))
+    return;
+
+  __atomic_store_n(&reclaim_next_ns, now + idle_ns / 2, __ATOMIC_RELAXED);
+  gpreempt_off();
+  reclaim_sweep(now, idle_ns);
+  gpreempt_on();
+  __atomic_store_n(&reclaim_busy, 0, __ATOMIC_RELEASE);
+}
+
+/* This worker has run threads since it last looked: they may have blocked,
+   so sweeps are needed again. Returns 1 if that is news. */
+static int reclaim_arm(gworker_t *w) {
+  if (!reclaim_enabled() || w->switches == w->reclaim_mark)
+    return 0;
+  w->reclaim_mark = w->switches;
+  return !__atomic_exchange_n(&reclaim_armed, 1, __ATOMIC_SEQ_CST);
+}
+
+/* How long the poller may block before the next sweep, or -1 */
+static int64_t reclaim_timeout(void) {
+  if (!__atomic_load_n(&reclaim_armed, __ATOMIC_SEQ_CST))
+    return -1;
+  uint64_t now = get_time_ns();
+  uint64_t next = __atomic_load_n(&reclaim_next_ns, __ATOMIC_RELAXED);
+  return next > now ? (int64_t)(next - now) : 0;
+}
+
+static int64_t min_timeout(int64_t a, int64_t b) {
+  if (a < 0)
+    return b;
+  if (b < 0)
+    return a;
+  return a < b ? a : b;
+}
+
+/* Nothing runnable on this worker: block until work, IO or a timer */
+static void worker_wait(gworker_t *w) {
+  pthread_mutex_lock(&park_lock);
+  __atomic_add_fetch(&idle_workers, 1, __ATOMIC_SEQ_CST);
+
+  // Timers and IO first: a wakeup moves its thread onto a heap while
+  // holding their lock, so it cannot slip between the two checks
+  int64_t timeout = next_timer_timeout();
+  int io_pending = reactor_waiters() > 0 || uring_inflight() > 0;
+
+  if (!scheduler_has_work(w)) {
+    // A pinned thread may be queued for a worker that has not woken yet
+    if (timeout == -1 && !io_pending && idle_workers == g_nworkers &&
+        !scheduler_any_queued()) {
+      fprintf(stderr, "Scheduler: Deadlock (Main blocked, no IO/Timers)\n");
+      exit(1);
     }
 
-    // If no IO and no timers, and Main is blocked (or we are not main), check
-    // deadlock
-    if (poll_count == 0 && timeout == -1) {
-      if (prev != &g_main_thread && prev->state != GTHREAD_TERMINATED &&
-          prev->state != GTHREAD_BLOCKED) {
-        return; // Keep running prev
-      }
-      if (prev != &g_main_thread) {
-        next = &g_main_thread; // Switch to Main
-        if (g_main_thread.state != GTHREAD_BLOCKED)
-          break;
-      }
-      // Deadlock if Main is blocked or we are main and blocked
-      if (g_main_thread.state == GTHREAD_BLOCKED) {
-        fprintf(stderr, "Scheduler: Deadlock (Main blocked, no IO/Timers)\n");
-        exit(1);
-      }
+    // No ticks while there is nothing to slice
+    preempt_pause(w);
+    if (!poller_active) {
+      __atomic_store_n(&poller_active, 1, __ATOMIC_SEQ_CST);
+      pthread_mutex_unlock(&park_lock);
+
+      // Re-read the deadline: sleepers added from now on will wake us
+      scheduler_kick(
+          reactor_poll(min_timeout(next_timer_timeout(), reclaim_timeout())));
+      check_timers();
+
+      pthread_mutex_lock(&park_lock);
+      poller_active = 0;
+      // Hand the poller role to a parked worker
+      if (parked_workers > 0)
+        pthread_cond_signal(&park_cond);
+    } else {
+      parked_workers++;
+      pthread_cond_wait(&park_cond, &park_lock);
+      parked_workers--;
     }
+    preempt_resume(w);
+  }
+
+  __atomic_sub_fetch(&idle_workers, 1, __ATOMIC_SEQ_CST);
+  pthread_mutex_unlock(&park_lock);
+}
 
-    // Allow interruptible wait
-    check_io(timeout == -1 ? 100
-                           : timeout); // 100ms default if no timers but IO
+/* Body of each worker's idle context */
+static void worker_idle_loop(void *arg) {
+  gworker_t *w = (gworker_t *)arg;
+
+  while (1) {
+    check_io(w);
     check_timers();
-    next = scheduler_dequeue();
 
-    if (next)
-      break;
+    // A poller blocked with no sweep pending must recompute its timeout
+    if (reclaim_arm(w) && __atomic_load_n(&poller_active, __ATOMIC_SEQ_CST))
+      reactor_wake();
+    reclaim_poll();
 
-    // If still nothing and poll_count 0 and timeout -1? loop or exit logic
-    // above handles deadlock
-    if (poll_count == 0 && timeout == -1) {
-      break; // Fallback to main loop logic
+    gthread_t *next = scheduler_dequeue(w);
+    if (next) {
+      scheduler_switch(w, next, 0);
+      continue;
     }
+    worker_wait(w);
   }
+}
 
-  // Check if prev is terminating
-  if (prev->state == GTHREAD_TERMINATED && prev != &g_main_thread) {
-    free_zombie(); // Free any previous zombie
-    g_zombie_thread = prev;
+static void *worker_main(void *arg) {
+  gworker_t *w = (gworker_t *)arg;
+  tls_worker = w;
+  stack_thread_init();
+
+  // The pthread's own stack serves as the idle context
+  w->idle.state = GTHREAD_RUNNING;
+  w->idle.on_cpu = 1;
+  w->current = &w->idle;
+  preempt_start(w);
+
+  worker_idle_loop(w);
+  return NULL;
+}
+
+/* Stack for one of a worker's internal contexts (idle, copier) */
+static void *alloc_context_stack(gthread_t *t, size_t size) {
+  t->stack_size = size;
+  t->stack = malloc(size);
+  if (!t->stack) {
+    fprintf(stderr, "Scheduler: Cannot allocate idle stack\n");
+    exit(1);
   }
+  return (char *)t->stack + size;
+}
 
-  // Update Pass
-  next->pass += next->stride;
+static void shared_stack_init(gworker_t *w) {
+  w->shared_size = shared_stack_size;
+  w->shared_stack = stack_map(shared_stack_size, STACK_GUARD_SIZE);
+  if (!w->shared_stack) {
+    fprintf(stderr, "Scheduler: Cannot map shared stack\n");
+    exit(1);
+  }
 
-  g_current_thread = next;
-  next->state = GTHREAD_RUNNING;
+  // Enter copier_main as if called: return address slot below an aligned top
+  uint64_t top =
+      (uint64_t)alloc_context_stack(&w->copier, IDLE_STACK_SIZE) & ~0xFUL;
+  top -= 8;
+  *(uint64_t *)top = 0;
+  w->copier.ctx.rsp = top;
+  w->copier.ctx.rip = (uint64_t)copier_main;
+}
 
-  if (prev != next) {
-    gthread_switch(&next->ctx, &prev->ctx);
+void scheduler_init(int nworkers, size_t shared_stack) {
+  if (nworkers < 1)
+    nworkers = 1;
+  if (nworkers > MAX_WORKERS)
+    nworkers = MAX_WORKERS;
+
+  for (int i = 0; i < nworkers; i++) {
+    // Cache-line aligned: the embedded idle/copier TCBs require it
+    gworker_t *w = i == 0 ? &g_worker0 : aligned_alloc(64, sizeof(gworker_t));
+    if (!w) {
+      nworkers = i;
+      break;
+    }
+    if (i > 0)
+      memset(w, 0, sizeof(gworker_t));
+    w->id = i;
+    w->idle.waiting_fd = -1;
+    gspin_init(&w->rq_lock);
+    workers[i] = w;
+  }
+  g_nworkers = nworkers;
+
+  // Phase 29: Copy-stack mode
+  if (shared_stack > STACK_GUARD_SIZE) {
+    shared_stack_size = shared_stack;
+    for (int i = 0; i < nworkers; i++)
+      shared_stack_init(workers[i]);
   }
+
+  reactor_init(nworkers);
+  timer_wheel_init(&timer_wheel, get_time_ns());
+
+  // Worker 0 keeps running main; its idle context needs a stack of its own
+  gworker_t *w0 = &g_worker0;
+  w0->os_thread = pthread_self();
+  uint64_t top =
+      (uint64_t)alloc_context_stack(&w0->idle, IDLE_STACK_SIZE) & ~0xFUL;
+  w0->idle.ctx.rsp = top;
+  w0->idle.ctx.rip = (uint64_t)gthread_trampoline;
+  w0->idle.ctx.r12 = (uint64_t)worker_idle_loop;
+  w0->idle.ctx.r13 = (uint64_t)w0;
+
+  g_main_thread.on_cpu = 1;
+  w0->current = &g_main_thread;
+  w0->run_start_ns = get_time_ns();
+  preempt_start(w0);
+
+  if (nworkers > 1) {
+    for (int i = 1; i < nworkers; i++) {
+      if (pthread_create(&workers[i]->os_thread, NULL, worker_main,
+                         workers[i]) != 0) {
+        fprintf(stderr, "Scheduler: Cannot start worker %d\n", i);
+        exit(1);
+      }
+    }
+  }
+}
+
+void scheduler_schedule(void) {
+  gworker_t *w = scheduler_worker();
+
+  // Try to clear IO first
+  check_io(w);
+  check_timers();
+  if (w->switches - w->reclaim_mark >= RECLAIM_POLL_EVERY) {
+    reclaim_arm(w);
+    reclaim_poll();
+  }
+
+  gthread_t *next = scheduler_dequeue(w);
+  if (!next) {
+    // Nothing else runnable and we never gave up the CPU: keep running
+    if (w->current->state == GTHREAD_RUNNING)
+      return;
+    // Otherwise wait for IO/timers/steals on the idle context
+    next = &w->idle;
+  }
+
+  scheduler_switch(w, next, 0);
 }
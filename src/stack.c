@@ -0,0 +1,197 @@
+#define _GNU_SOURCE
+#include "stack.h"
+#include "scheduler.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define ALT_STACK_SIZE (64 * 1024)
+#define MINCORE_BATCH 256 // Pages per mincore() call
+
+static pthread_once_t handler_once = PTHREAD_ONCE_INIT;
+static uint64_t reclaimed_bytes = 0;
+static uint64_t reclaim_count = 0;
+static pthread_once_t limit_once = PTHREAD_ONCE_INIT;
+static long guard_budget = 0;
+static long stacks_live = 0;
+static int unguarded_warned = 0;
+
+/* Guarded stacks may use up to 3/4 of vm.max_map_count (two VMAs each);
+   the rest is left to malloc, libraries and the unguarded stacks */
+static void read_limit(void) {
+  long max = 65530;
+  FILE *f = fopen("/proc/sys/vm/max_map_count", "r");
+  if (f) {
+    if (fscanf(f, "%ld", &max) != 1)
+      max = 65530;
+    fclose(f);
+  }
+  guard_budget = max / 4 * 3 / 2;
+}
+
+static void warn_unguarded(void) {
+  if (!__atomic_exchange_n(&unguarded_warned, 1, __ATOMIC_RELAXED))
+    fprintf(stderr, "gthread: near vm.max_map_count, new stacks have no "
+                    "guard page\n");
+}
+
+void *stack_map(size_t size, size_t guard) {
+  if (size <= guard)
+    return NULL;
+  pthread_once(&limit_once, read_limit);
+
+  // NORESERVE: only touched pages count against memory, not the reservation
+  void *base = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK,
+                    -1, 0);
+  if (base == MAP_FAILED)
+    return NULL;
+  // Guarded stacks never outnumber live ones, so capping the live count at
+  // the time of the split caps the guards' VMAs. Past it the stack goes
+  // without: it merges with unguarded neighbours instead of costing two.
+  long live = __atomic_add_fetch(&stacks_live, 1, __ATOMIC_RELAXED);
+  if (guard && live > guard_budget) {
+    warn_unguarded();
+  } else if (guard && mprotect(base, guard, PROT_NONE) < 0) {
+    if (errno != ENOMEM) {
+      stack_unmap(base, size);
+      return NULL;
+    }
+    warn_unguarded(); // Something else used up the VMAs
+  }
+  return base;
+}
+
+void stack_unmap(void *base, size_t size) {
+  munmap(base, size);
+  __atomic_sub_fetch(&stacks_live, 1, __ATOMIC_RELAXED);
+}
+
+size_t stack_reclaim(void *base, size_t size, size_t guard, uint64_t sp,
+                     size_t *high_water) {
+  uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+  uintptr_t lo = (uintptr_t)base + guard;
+  uintptr_t hi = (uintptr_t)sp & ~(page - 1); // sp's own page is live
+  if (hi <= lo || hi > (uintptr_t)base + size)
+    return 0;
+
+  // Find the deepest resident page and count what lies below sp
+  unsigned char vec[MINCORE_BATCH];
+  uintptr_t deepest = 0;
+  size_t resident = 0;
+  for (uintptr_t a = lo; a < hi; a += MINCORE_BATCH * page) {
+    size_t len = hi - a < MINCORE_BATCH * page ? hi - a : MINCORE_BATCH * page;
+    if (mincore((void *)a, len, vec) < 0)
+      return 0;
+    for (size_t i = 0; i < len / page; i++) {
+      if (!(vec[i] & 1))
+        continue;
+      if (!deepest)
+        deepest = a + i * page;
+      resident++;
+    }
+  }
+  if (!resident)
+    return 0;
+
+  size_t depth = (uintptr_t)base + size - deepest;
+  if (depth > *high_water)
+    *high_water = depth;
+
+  if (madvise((void *)deepest, hi - deepest, MADV_DONTNEED) < 0)
+    return 0;
+  size_t bytes = resident * page;
+  __atomic_add_fetch(&reclaimed_bytes, bytes, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&reclaim_count, 1, __ATOMIC_RELAXED);
+  return bytes;
+}
+
+void stack_reclaim_totals(uint64_t *bytes, uint64_t *count) {
+  *bytes = __atomic_load_n(&reclaimed_bytes, __ATOMIC_RELAXED);
+  *count = __atomic_load_n(&reclaim_count, __ATOMIC_RELAXED);
+}
+
+/* Async-signal-safe formatting for the overflow report */
+static char *fmt_u64(char *p, uint64_t v) {
+  char tmp[20];
+  int n = 0;
+  do {
+    tmp[n++] = '0' + v % 10;
+    v /= 10;
+  } while (v);
+  while (n)
+    *p++ = tmp[--n];
+  return p;
+}
+
+static char *fmt_str(char *p, const char *s) {
+  while (*s)
+    *p++ = *s++;
+  return p;
+}
+
+static void overflow_handler(int sig, siginfo_t *si, void *uc) {
+  (void)uc;
+  uintptr_t addr = (uintptr_t)si->si_addr;
+  gthread_t *cur = scheduler_worker()->current;
+  uintptr_t base = 0;
+  size_t size = 0, guard = 0;
+  if (cur && cur->home) {
+    base = (uintptr_t)cur->home->shared_stack;
+    size = cur->home->shared_size;
+    guard = STACK_GUARD_SIZE;
+  } else if (cur && cur->stack) {
+    base = (uintptr_t)cur->stack;
+    size = cur->stack_size;
+    guard = cur->guard_size;
+  }
+
+  if (base && addr >= base && addr < base + guard) {
+    char msg[128];
+    char *p = fmt_str(msg, "gthread: thread ");
+    p = fmt_u64(p, cur->id);
+    p = fmt_str(p, " overflowed its ");
+    p = fmt_u64(p, (size - guard) / 1024);
+    p = fmt_str(p, " KB stack\n");
+    if (write(STDERR_FILENO, msg, p - msg) < 0) {
+      // Dying anyway
+    }
+    abort();
+  }
+
+  // Someone else's bug: let the fault happen again with the default action
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = SIG_DFL;
+  sigaction(sig, &sa, NULL);
+}
+
+static void install_handler(void) {
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_sigaction = overflow_handler;
+  sa.sa_flags = SA_SIGINFO | SA_ONSTACK;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGSEGV, &sa, NULL);
+}
+
+void stack_thread_init(void) {
+  // The faulting stack is the one that overflowed: the handler needs its own
+  stack_t ss;
+  ss.ss_sp = mmap(NULL, ALT_STACK_SIZE, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ss.ss_sp == MAP_FAILED)
+    return;
+  ss.ss_size = ALT_STACK_SIZE;
+  ss.ss_flags = 0;
+  if (sigaltstack(&ss, NULL) < 0) {
+    munmap(ss.ss_sp, ALT_STACK_SIZE);
+    return;
+  }
+  pthread_once(&handler_once, install_handler);
+}
@@ -5,80 +5,522 @@
 #include <stdlib.h>
 
 
-/* Internal helper: Add thread to a waiting list (not ready queue) */
-static void wait_list_enqueue(gthread_t **head, gthread_t *t) {
+/* Internal helpers: Waiting lists (not ready queues). Callers hold the
+   guard of the object the list belongs to. */
+static void wait_list_enqueue(gwaitq_t *q, gthread_t *t) {
   t->next = NULL;
-  if (!*head) {
-    *head = t;
-  } else {
-    gthread_t *curr = *head;
-    while (curr->next)
-      curr = curr->next;
-    curr->next = t;
-  }
+  if (q->tail)
+    q->tail->next = t;
+  else
+    q->head = t;
+  q->tail = t;
+}
+
+// For a waiter that keeps its place after losing a race
+static void wait_list_push_front(gwaitq_t *q, gthread_t *t) {
+  t->next = q->head;
+  q->head = t;
+  if (!q->tail)
+    q->tail = t;
 }
 
-static gthread_t *wait_list_dequeue(gthread_t **head) {
-  if (!*head)
+static gthread_t *wait_list_dequeue(gwaitq_t *q) {
+  gthread_t *t = q->head;
+  if (!t)
     return NULL;
-  gthread_t *t = *head;
-  *head = t->next;
+  q->head = t->next;
+  if (!q->head)
+    q->tail = NULL;
   t->next = NULL;
   return t;
 }
 
+/* Phase 41: Timed waits. A waiter whose timeout fired is still queued
+   until it runs and takes itself off, O(n); a wakeup that dequeues it
+   first loses the claim and passes over it. */
+static int wait_list_remove(gwaitq_t *q, gthread_t *t) {
+  gthread_t *prev = NULL;
+  for (gthread_t *c = q->head; c; prev = c, c = c->next) {
+    if (c != t)
+      continue;
+    if (prev)
+      prev->next = t->next;
+    else
+      q->head = t->next;
+    if (q->tail == t)
+      q->tail = prev;
+    t->next = NULL;
+    return 1;
+  }
+  return 0;
+}
+
+// First waiter that can still be woken
+static gthread_t *wait_list_claim(gwaitq_t *q) {
+  gthread_t *t;
+  while ((t = wait_list_dequeue(q)) && !scheduler_claim_wakeup(t))
+    ;
+  return t;
+}
+
+// Keep only the waiters that can still be woken
+static void wait_list_claim_all(gwaitq_t *q) {
+  gthread_t *t = q->head;
+  q->head = q->tail = NULL;
+  while (t) {
+    gthread_t *next = t->next;
+    if (scheduler_claim_wakeup(t))
+      wait_list_enqueue(q, t);
+    else
+      t->next = NULL;
+    t = next;
+  }
+}
+
+/* Back from a wait armed with a deadline, under the guard q belongs to:
+   -1 if it was the deadline that woke us, and we are off q */
+static int wait_timed_out(gwaitq_t *q, gthread_t *cur) {
+  if (cur->timed_wait != TIMED_WAIT_EXPIRED)
+    return 0;
+  wait_list_remove(q, cur);
+  cur->timed_wait = TIMED_WAIT_NONE;
+  return -1;
+}
+
 /* Mutex */
 void gmutex_init(gmutex_t *m) {
   m->locked = 0;
-  m->wait_queue = NULL;
+  m->owner = NULL;
+  m->wait_queue.head = m->wait_queue.tail = NULL;
+  m->barge_limit = 0;
+  m->barges = 0;
+  m->waking = NULL;
+  gspin_init(&m->guard);
+}
+
+void gmutex_set_barging(gmutex_t *m, int limit) {
+  gspin_lock(&m->guard);
+  m->barge_limit = limit < 0 ? 0 : limit;
+  gspin_unlock(&m->guard);
 }
 
-void gmutex_lock(gmutex_t *m) {
-  // Cooperative: No atomics needed if we assume running on one core
-  while (m->locked) {
-    gthread_t *cur = g_current_thread;
-    cur->state = GTHREAD_BLOCKED;
+/* Block on m's queue, at the front if `front`, until woken (Phase 41: or
+   until deadline_ns, if non-zero). Caller holds the guard, and holds it
+   again on return. -1 if the deadline came first. */
+static int mutex_block(gmutex_t *m, gthread_t *cur, int front,
+                       uint64_t deadline_ns) {
+  cur->state = GTHREAD_BLOCKED;
+  if (front)
+    wait_list_push_front(&m->wait_queue, cur);
+  else
     wait_list_enqueue(&m->wait_queue, cur);
-    scheduler_schedule(); // Yield
+  if (deadline_ns)
+    scheduler_block_timeout(cur, deadline_ns);
+  gspin_unlock(&m->guard);
+  scheduler_schedule(); // Yield
+  gspin_lock(&m->guard);
+  return wait_timed_out(&m->wait_queue, cur);
+}
+
+/* cur has been woken from m's wait queue, and the caller holds the guard.
+   Returns 0 owning m, or -1 if deadline_ns (0: none) passed first; the
+   guard is released either way. */
+static int mutex_acquire_woken(gmutex_t *m, gthread_t *cur,
+                               uint64_t deadline_ns) {
+  int ret = 0;
+  cur->cond_requeued = 0;
+  for (;;) {
+    if (m->waking == cur)
+      m->waking = NULL;
+    if (m->owner == cur)
+      break; // Handed over
+    if (!m->locked) {
+      // Woken to take it (barging mode, or Phase 40's cond waiters), and
+      // nobody beat us to it
+      m->locked = 1;
+      m->owner = cur;
+      break;
+    }
+    // Barged, by a holder whose unlock no longer sees us waking: count it
+    // here, and keep our place at the front
+    m->barges++;
+    if (mutex_block(m, cur, 1, deadline_ns) < 0) {
+      ret = -1;
+      break;
+    }
+  }
+  m->barges = 0;
+  gspin_unlock(&m->guard);
+  return ret;
+}
+
+static int mutex_lock_until(gmutex_t *m, uint64_t deadline_ns) {
+  // The guard only covers the queue update; other workers may be running
+  gthread_t *cur = g_current_thread;
+  gspin_lock(&m->guard);
+  if (!m->locked) {
+    m->locked = 1;
+    m->owner = cur;
+    gspin_unlock(&m->guard);
+    return 0;
+  }
+
+  if (deadline_ns && deadline_ns <= gthread_now_ns()) {
+    gspin_unlock(&m->guard);
+    return -1;
+  }
+  if (mutex_block(m, cur, 0, deadline_ns) < 0) {
+    gspin_unlock(&m->guard);
+    return -1;
   }
-  m->locked = 1;
+  return mutex_acquire_woken(m, cur, deadline_ns);
+}
+
+void gmutex_lock(gmutex_t *m) { mutex_lock_until(m, 0); }
+
+int gmutex_timedlock(gmutex_t *m, uint64_t deadline_ns) {
+  // 0 is as past as any deadline gets
+  return mutex_lock_until(m, deadline_ns ? deadline_ns : 1);
 }
 
 void gmutex_unlock(gmutex_t *m) {
-  if (m->wait_queue) {
-    gthread_t *t = wait_list_dequeue(&m->wait_queue);
-    scheduler_enqueue(t); // Make it ready
+  gspin_lock(&m->guard);
+  gthread_t *t = NULL;
+  m->owner = NULL;
+  if (m->waking) {
+    // The lock was taken while the woken waiter was on its way
+    if (++m->barges >= m->barge_limit)
+      m->owner = m->waking;
+  } else if (m->barges >= m->barge_limit) {
+    t = wait_list_claim(&m->wait_queue);
+    // Stays locked: the first waiter owns it before it even runs. Phase
+    // 40: Unless it came from a condition variable: then it is woken to
+    // take m, and handed it at the next unlock if someone gets there
+    // first, so whoever just left is not made to queue behind it.
+    if (t && t->cond_requeued)
+      m->waking = t;
+    else
+      m->owner = t;
+  } else {
+    // Barging: free it, and wake one waiter to compete
+    t = wait_list_claim(&m->wait_queue);
+    m->waking = t;
   }
-  m->locked = 0; // Wait, if we unblock someone, they will retry lock loop.
-                 // But if we set locked=0, any stride scheduled thread could
-                 // grab it. This is fair/correct. The unblocked thread needs to
-                 // be scheduled first.
+  m->locked = m->owner != NULL;
+  gspin_unlock(&m->guard);
+
+  if (t)
+    scheduler_enqueue(t); // Make it ready
 }
 
 /* Cond Var */
-void gcond_init(gcond_t *c) { c->wait_queue = NULL; }
-
-void gcond_wait(gcond_t *c, gmutex_t *m) {
-  gmutex_unlock(m);
+void gcond_init(gcond_t *c) {
+  c->wait_queue.head = c->wait_queue.tail = NULL;
+  c->mutex = NULL;
+  c->nr_timed = 0;
+  gspin_init(&c->guard);
+}
 
+static int cond_wait_until(gcond_t *c, gmutex_t *m, uint64_t deadline_ns) {
+  // Queue up before releasing m, or a signal on another worker could be lost
   gthread_t *cur = g_current_thread;
+  gspin_lock(&c->guard);
   cur->state = GTHREAD_BLOCKED;
   wait_list_enqueue(&c->wait_queue, cur);
+  c->mutex = m;
+  cur->cond_requeued = 1; // For when signal moves it to m
+  if (deadline_ns) {
+    __atomic_add_fetch(&c->nr_timed, 1, __ATOMIC_RELAXED);
+    scheduler_block_timeout(cur, deadline_ns);
+  }
+  gspin_unlock(&c->guard);
+
+  gmutex_unlock(m);
   scheduler_schedule();
 
-  gmutex_lock(m);
+  // Phase 41: Timed out on c: take m the usual way. Only we reset an
+  // expired wait, so a claimed one needs no lock to tell. While we are
+  // still on c's queue nr_timed must count us, or a broadcast would splice
+  // us onto m's queue unclaimed; a claimed waiter was already taken off
+  // under c->guard.
+  if (deadline_ns) {
+    if (__atomic_load_n(&cur->timed_wait, __ATOMIC_ACQUIRE) ==
+        TIMED_WAIT_EXPIRED) {
+      gspin_lock(&c->guard);
+      wait_timed_out(&c->wait_queue, cur);
+      __atomic_sub_fetch(&c->nr_timed, 1, __ATOMIC_RELAXED);
+      gspin_unlock(&c->guard);
+      cur->cond_requeued = 0;
+      gmutex_lock(m);
+      return -1;
+    }
+    __atomic_sub_fetch(&c->nr_timed, 1, __ATOMIC_RELAXED);
+  }
+
+  // Phase 40: The signal moved us to m's queue (or woke us to take m)
+  gspin_lock(&m->guard);
+  return mutex_acquire_woken(m, cur, 0);
 }
 
-void gcond_signal(gcond_t *c) {
-  if (c->wait_queue) {
-    gthread_t *t = wait_list_dequeue(&c->wait_queue);
-    scheduler_enqueue(t);
+void gcond_wait(gcond_t *c, gmutex_t *m) { cond_wait_until(c, m, 0); }
+
+int gcond_timedwait(gcond_t *c, gmutex_t *m, uint64_t deadline_ns) {
+  return cond_wait_until(c, m, deadline_ns ? deadline_ns : 1);
+}
+
+/* Phase 40: Wait morphing. Waiters taken off c go straight onto m's wait
+   queue, still blocked, rather than woken only to block on m again. Each
+   is woken when m is free, and handed it at the next unlock if another
+   thread takes it first (see gmutex_unlock), so it is switched in once,
+   owning m. The waiters q holds are linked and in order; they may still
+   be switching out (the scheduler holds their wakeups until they are off
+   the CPU). */
+static void cond_requeue(gmutex_t *m, gwaitq_t *q) {
+  gthread_t *t = NULL;
+  gspin_lock(&m->guard);
+  if (!m->locked && !m->waking) {
+    t = wait_list_dequeue(q);
+    m->waking = t;
   }
+  if (q->head) {
+    // Spliced on whole: O(1) however many there are
+    if (m->wait_queue.tail)
+      m->wait_queue.tail->next = q->head;
+    else
+      m->wait_queue.head = q->head;
+    m->wait_queue.tail = q->tail;
+  }
+  gspin_unlock(&m->guard);
+
+  if (t)
+    scheduler_enqueue(t);
+}
+
+void gcond_signal(gcond_t *c) {
+  gspin_lock(&c->guard);
+  gthread_t *t = wait_list_claim(&c->wait_queue);
+  gmutex_t *m = c->mutex;
+  gspin_unlock(&c->guard);
+  if (!t)
+    return;
+
+  gwaitq_t one = {t, t};
+  cond_requeue(m, &one);
 }
 
 void gcond_broadcast(gcond_t *c) {
-  while (c->wait_queue) {
-    gthread_t *t = wait_list_dequeue(&c->wait_queue);
+  gspin_lock(&c->guard);
+  gwaitq_t all = c->wait_queue;
+  c->wait_queue.head = c->wait_queue.tail = NULL;
+  // Phase 41: Timed waiters must be claimed one by one
+  if (__atomic_load_n(&c->nr_timed, __ATOMIC_RELAXED))
+    wait_list_claim_all(&all);
+  gmutex_t *m = c->mutex;
+  gspin_unlock(&c->guard);
+  if (!all.head)
+    return;
+
+  cond_requeue(m, &all);
+}
+
+/* Phase 42: Handoff primitives. Each wakes exactly the threads that can
+   proceed, having already given them what they waited for (a read share,
+   the write lock, a permit, a finished round), so a woken thread returns
+   without re-taking the guard or re-checking anything. Batches go to the
+   run queues through scheduler_enqueue_list. */
+
+/* Block on q, whose guard the caller holds and which is released here,
+   until a waker hands over whatever we wait for */
+static void wait_handoff(gwaitq_t *q, gspinlock_t *guard, gthread_t *cur) {
+  cur->state = GTHREAD_BLOCKED;
+  wait_list_enqueue(q, cur);
+  gspin_unlock(guard);
+  scheduler_schedule();
+}
+
+// Take every waiter off q, and count them
+static gthread_t *wait_list_take_all(gwaitq_t *q, int *count) {
+  gthread_t *t = q->head;
+  q->head = q->tail = NULL;
+  int n = 0;
+  for (gthread_t *c = t; c; c = c->next)
+    n++;
+  *count = n;
+  return t;
+}
+
+/* RW Lock */
+void grwlock_init(grwlock_t *rw) {
+  rw->readers = 0;
+  rw->writer = NULL;
+  rw->read_queue.head = rw->read_queue.tail = NULL;
+  rw->write_queue.head = rw->write_queue.tail = NULL;
+  gspin_init(&rw->guard);
+}
+
+void grwlock_rdlock(grwlock_t *rw) {
+  gspin_lock(&rw->guard);
+  // Writer-preferring: a waiting writer holds new readers back
+  if (!rw->writer && !rw->write_queue.head) {
+    rw->readers++;
+    gspin_unlock(&rw->guard);
+    return;
+  }
+  wait_handoff(&rw->read_queue, &rw->guard, g_current_thread);
+  // Admitted with our batch: the share was counted for us
+}
+
+int grwlock_tryrdlock(grwlock_t *rw) {
+  gspin_lock(&rw->guard);
+  int ok = !rw->writer && !rw->write_queue.head;
+  if (ok)
+    rw->readers++;
+  gspin_unlock(&rw->guard);
+  return ok ? 0 : -1;
+}
+
+void grwlock_wrlock(grwlock_t *rw) {
+  gthread_t *cur = g_current_thread;
+  gspin_lock(&rw->guard);
+  if (!rw->writer && !rw->readers) {
+    rw->writer = cur;
+    gspin_unlock(&rw->guard);
+    return;
+  }
+  wait_handoff(&rw->write_queue, &rw->guard, cur);
+  // Handed the lock
+}
+
+int grwlock_trywrlock(grwlock_t *rw) {
+  gspin_lock(&rw->guard);
+  int ok = !rw->writer && !rw->readers;
+  if (ok)
+    rw->writer = g_current_thread;
+  gspin_unlock(&rw->guard);
+  return ok ? 0 : -1;
+}
+
+void grwlock_unlock(grwlock_t *rw) {
+  gthread_t *wake = NULL;
+  gspin_lock(&rw->guard);
+  if (rw->writer == g_current_thread) {
+    rw->writer = NULL;
+    if (rw->read_queue.head) {
+      // Every reader that queued behind this writer goes in as one batch,
+      // ahead of the next writer, so neither side can starve the other
+      int n;
+      wake = wait_list_take_all(&rw->read_queue, &n);
+      rw->readers += n;
+    } else if (rw->write_queue.head) {
+      wake = wait_list_dequeue(&rw->write_queue);
+      rw->writer = wake;
+    }
+  } else if (--rw->readers == 0 && rw->write_queue.head) {
+    // Last reader out hands over to the first writer
+    wake = wait_list_dequeue(&rw->write_queue);
+    rw->writer = wake;
+  }
+  gspin_unlock(&rw->guard);
+
+  scheduler_enqueue_list(wake);
+}
+
+/* Semaphore */
+void gsem_init(gsem_t *s, int count) {
+  s->count = count < 0 ? 0 : count;
+  s->wait_queue.head = s->wait_queue.tail = NULL;
+  gspin_init(&s->guard);
+}
+
+void gsem_wait(gsem_t *s) {
+  gspin_lock(&s->guard);
+  if (s->count > 0) {
+    s->count--;
+    gspin_unlock(&s->guard);
+    return;
+  }
+  wait_handoff(&s->wait_queue, &s->guard, g_current_thread);
+  // gsem_post passed its permit straight to us
+}
+
+int gsem_trywait(gsem_t *s) {
+  gspin_lock(&s->guard);
+  int ok = s->count > 0;
+  if (ok)
+    s->count--;
+  gspin_unlock(&s->guard);
+  return ok ? 0 : -1;
+}
+
+void gsem_post(gsem_t *s) {
+  gspin_lock(&s->guard);
+  // A waiter takes the permit as it is woken: the count never goes up for
+  // someone else to grab first
+  gthread_t *t = wait_list_dequeue(&s->wait_queue);
+  if (!t)
+    s->count++;
+  gspin_unlock(&s->guard);
+
+  if (t)
     scheduler_enqueue(t);
+}
+
+/* Barrier */
+void gbarrier_init(gbarrier_t *b, int parties) {
+  b->parties = parties < 1 ? 1 : parties;
+  b->arrived = 0;
+  b->wait_queue.head = b->wait_queue.tail = NULL;
+  gspin_init(&b->guard);
+}
+
+int gbarrier_wait(gbarrier_t *b) {
+  gspin_lock(&b->guard);
+  if (++b->arrived < b->parties) {
+    wait_handoff(&b->wait_queue, &b->guard, g_current_thread);
+    return 0;
+  }
+
+  // Last in: release the round, which leaves the barrier ready for the
+  // next one (a released thread never looks at it again)
+  int n;
+  gthread_t *all = wait_list_take_all(&b->wait_queue, &n);
+  b->arrived = 0;
+  gspin_unlock(&b->guard);
+  scheduler_enqueue_list(all);
+  return 1;
+}
+
+/* Wait Group */
+void gwaitgroup_init(gwaitgroup_t *wg) {
+  wg->count = 0;
+  wg->wait_queue.head = wg->wait_queue.tail = NULL;
+  gspin_init(&wg->guard);
+}
+
+void gwaitgroup_add(gwaitgroup_t *wg, int delta) {
+  gthread_t *all = NULL;
+  gspin_lock(&wg->guard);
+  wg->count += delta;
+  if (wg->count < 0) {
+    fprintf(stderr, "WaitGroup: Negative counter\n");
+    exit(1);
+  }
+  if (wg->count == 0) {
+    int n;
+    all = wait_list_take_all(&wg->wait_queue, &n);
+  }
+  gspin_unlock(&wg->guard);
+
+  scheduler_enqueue_list(all);
+}
+
+void gwaitgroup_done(gwaitgroup_t *wg) { gwaitgroup_add(wg, -1); }
+
+void gwaitgroup_wait(gwaitgroup_t *wg) {
+  gspin_lock(&wg->guard);
+  if (wg->count == 0) {
+    gspin_unlock(&wg->guard);
+    return;
   }
+  wait_handoff(&wg->wait_queue, &wg->guard, g_current_thread);
 }
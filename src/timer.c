@@ -0,0 +1,156 @@
+#include "timer.h"
+#include <string.h>
+
+#define SLOT_MASK (TIMER_SLOTS - 1)
+#define LEVEL_SHIFT(l) (TIMER_SLOT_BITS * (l))
+#define WHEEL_SPAN (1ULL << LEVEL_SHIFT(TIMER_LEVELS))
+
+void timer_wheel_init(timer_wheel_t *w, uint64_t now_ns) {
+  memset(w, 0, sizeof(*w));
+  w->now = now_ns / TIMER_TICK_NS;
+}
+
+static void list_push(gtimer_t **head, gtimer_t *t) {
+  t->next = *head;
+  if (*head)
+    (*head)->pprev = &t->next;
+  *head = t;
+  t->pprev = head;
+}
+
+/* File t under the slot its expiry falls in, relative to w->now */
+static void wheel_link(timer_wheel_t *w, gtimer_t *t) {
+  if (t->expires <= w->now) {
+    t->level = TIMER_LEVELS;
+    list_push(&w->due, t);
+    return;
+  }
+
+  uint64_t delta = t->expires - w->now;
+  uint64_t ticks = t->expires;
+  int level = 0;
+  while (level < TIMER_LEVELS - 1 && delta >= 1ULL << LEVEL_SHIFT(level + 1))
+    level++;
+  // Beyond the wheel: park in the farthest slot, re-filed when it cascades
+  if (delta >= WHEEL_SPAN)
+    ticks = w->now + WHEEL_SPAN - 1;
+
+  int slot = (ticks >> LEVEL_SHIFT(level)) & SLOT_MASK;
+  t->level = level;
+  t->slot = slot;
+  w->occupied[level] |= 1ULL << slot;
+  list_push(&w->slots[level][slot], t);
+}
+
+void timer_add(timer_wheel_t *w, gtimer_t *t) {
+  // Round up: a timer may fire late by up to a tick, never early
+  t->expires = (t->deadline_ns + TIMER_TICK_NS - 1) / TIMER_TICK_NS;
+  wheel_link(w, t);
+  w->count++;
+}
+
+void timer_cancel(timer_wheel_t *w, gtimer_t *t) {
+  if (!t->pprev)
+    return;
+
+  *t->pprev = t->next;
+  if (t->next)
+    t->next->pprev = t->pprev;
+  if (t->level < TIMER_LEVELS && !w->slots[t->level][t->slot])
+    w->occupied[t->level] &= ~(1ULL << t->slot);
+
+  t->next = NULL;
+  t->pprev = NULL;
+  w->count--;
+}
+
+static uint64_t ror64(uint64_t x, unsigned n) {
+  n &= 63;
+  return n ? (x >> n) | (x << (64 - n)) : x;
+}
+
+/* First tick after w->now at which some slot needs attention */
+static uint64_t wheel_next_tick(const timer_wheel_t *w) {
+  uint64_t best = TIMER_NEVER;
+  for (int level = 0; level < TIMER_LEVELS; level++) {
+    uint64_t bm = w->occupied[level];
+    if (!bm)
+      continue;
+    uint64_t pos = w->now >> LEVEL_SHIFT(level);
+    // Bit i of the rotated map is the slot i + 1 positions ahead
+    unsigned ahead = __builtin_ctzll(ror64(bm, (pos & SLOT_MASK) + 1)) + 1;
+    uint64_t start = (pos + ahead) << LEVEL_SHIFT(level);
+    if (start < best)
+      best = start;
+  }
+  return best;
+}
+
+/* Unlink a whole slot */
+static gtimer_t *slot_take(timer_wheel_t *w, int level, int slot) {
+  gtimer_t *list = w->slots[level][slot];
+  w->slots[level][slot] = NULL;
+  w->occupied[level] &= ~(1ULL << slot);
+  return list;
+}
+
+/* Move the due list onto out */
+static void take_due(timer_wheel_t *w, gtimer_t **out) {
+  while (w->due) {
+    gtimer_t *t = w->due;
+    w->due = t->next;
+    t->pprev = NULL;
+    t->next = *out;
+    *out = t;
+    w->count--;
+  }
+}
+
+gtimer_t *timer_expire(timer_wheel_t *w, uint64_t now_ns) {
+  gtimer_t *fired = NULL;
+  uint64_t target = now_ns / TIMER_TICK_NS;
+
+  take_due(w, &fired);
+
+  while (w->now < target) {
+    // Skip straight over ticks where nothing is filed
+    uint64_t next = wheel_next_tick(w);
+    if (next > target) {
+      w->now = target;
+      break;
+    }
+    w->now = next;
+
+    // Cascade higher levels whose slot starts at this tick
+    for (int level = TIMER_LEVELS - 1; level > 0; level--) {
+      if (w->now & ((1ULL << LEVEL_SHIFT(level)) - 1))
+        continue;
+      gtimer_t *t = slot_take(w, level, (w->now >> LEVEL_SHIFT(level)) &
+                                            SLOT_MASK);
+      while (t) {
+        gtimer_t *next_t = t->next;
+        wheel_link(w, t);
+        t = next_t;
+      }
+    }
+
+    // Everything in the level 0 slot expires exactly now
+    gtimer_t *t = slot_take(w, 0, w->now & SLOT_MASK);
+    while (t) {
+      gtimer_t *next_t = t->next;
+      t->level = TIMER_LEVELS;
+      list_push(&w->due, t);
+      t = next_t;
+    }
+    take_due(w, &fired);
+  }
+
+  return fired;
+}
+
+uint64_t timer_next_ns(const timer_wheel_t *w) {
+  if (w->due)
+    return 0;
+  uint64_t tick = wheel_next_tick(w);
+  return tick == TIMER_NEVER ? TIMER_NEVER : tick * TIMER_TICK_NS;
+}
@@ -0,0 +1,325 @@
+#include "uring.h"
+#include "reactor.h"
+#include "scheduler.h"
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define URING_ENTRIES 256
+#define URING_BATCH 32     // Submit once this many SQEs are queued...
+#define URING_MAX_DEFER 4  // ...or after this many busy scheduler passes
+#define URING_MAX_RW 0x7ffff000 // Largest single read/write Linux performs
+
+/* Raw syscalls: no liburing dependency */
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p) {
+  return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned flags) {
+  return (int)syscall(__NR_io_uring_enter, fd, to_submit, 0, flags, NULL, 0);
+}
+
+/* One request per parked thread, on that thread's stack */
+typedef struct {
+  gthread_t *thread;
+  int res;
+} uring_req_t;
+
+static int ring_fd = -1;
+static int enabled = 0;
+
+// SQ ring
+static unsigned *sq_head;
+static unsigned *sq_tail;
+static unsigned *sq_mask;
+static unsigned *sq_flags;
+static unsigned *sq_array;
+static unsigned sq_entries;
+static struct io_uring_sqe *sqes;
+
+// CQ ring
+static unsigned *cq_head;
+static unsigned *cq_tail;
+static unsigned *cq_mask;
+static struct io_uring_cqe *cqes;
+
+static unsigned sqe_tail = 0;   // Our tail, including unsubmitted SQEs
+static int queued = 0;          // SQEs not yet handed to the kernel
+static int defer_passes = 0;
+static int inflight = 0;        // Queued + submitted, not yet reaped
+static gspinlock_t ring_lock = GSPINLOCK_INIT;
+
+int uring_init(void) {
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+
+  int fd = sys_io_uring_setup(URING_ENTRIES, &p);
+  if (fd < 0)
+    return -1;
+
+  // Need offset -1 reads/writes (5.6) and internal poll retry for sockets
+  // (5.7); older kernels stay on the epoll reactor
+  unsigned need = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_RW_CUR_POS |
+                  IORING_FEAT_FAST_POLL;
+  if ((p.features & need) != need) {
+    close(fd);
+    return -1;
+  }
+
+  size_t sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  size_t ring_size = sq_size > cq_size ? sq_size : cq_size;
+
+  char *ring = mmap(NULL, ring_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (ring == MAP_FAILED) {
+    close(fd);
+    return -1;
+  }
+  sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+              PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+              IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    munmap(ring, ring_size);
+    close(fd);
+    return -1;
+  }
+
+  sq_head = (unsigned *)(ring + p.sq_off.head);
+  sq_tail = (unsigned *)(ring + p.sq_off.tail);
+  sq_mask = (unsigned *)(ring + p.sq_off.ring_mask);
+  sq_flags = (unsigned *)(ring + p.sq_off.flags);
+  sq_array = (unsigned *)(ring + p.sq_off.array);
+  sq_entries = p.sq_entries;
+
+  cq_head = (unsigned *)(ring + p.cq_off.head);
+  cq_tail = (unsigned *)(ring + p.cq_off.tail);
+  cq_mask = (unsigned *)(ring + p.cq_off.ring_mask);
+  cqes = (struct io_uring_cqe *)(ring + p.cq_off.cqes);
+
+  sqe_tail = *sq_tail;
+  ring_fd = fd;
+  enabled = 1;
+
+  // The ring fd is readable while completions are waiting, which is what
+  // wakes a worker blocked in epoll_wait
+  reactor_watch(ring_fd);
+  return 0;
+}
+
+int uring_enabled(void) { return enabled; }
+
+int uring_inflight(void) {
+  return __atomic_load_n(&inflight, __ATOMIC_ACQUIRE);
+}
+
+/* Hand queued SQEs to the kernel. Caller holds ring_lock. */
+static void uring_submit_locked(void) {
+  int ret = sys_io_uring_enter(ring_fd, queued, 0);
+  if (ret > 0)
+    queued -= ret;
+  // On EINTR/EBUSY the SQEs stay queued for the next pass
+  defer_passes = 0;
+}
+
+/* Next free SQE, or NULL if the SQ is still full after a submit. Caller
+   holds ring_lock. */
+static struct io_uring_sqe *uring_get_sqe_locked(void) {
+  if (sqe_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries) {
+    uring_submit_locked();
+    if (sqe_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries)
+      return NULL;
+  }
+  struct io_uring_sqe *sqe = &sqes[sqe_tail & *sq_mask];
+  memset(sqe, 0, sizeof(*sqe));
+  return sqe;
+}
+
+/* Wake the thread behind every CQE. Caller holds ring_lock. */
+static int uring_reap_locked(void) {
+  int woke = 0;
+  unsigned head = *cq_head;
+  unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+
+  while (head != tail) {
+    struct io_uring_cqe *cqe = &cqes[head & *cq_mask];
+    head++;
+    // Phase 41: A linked timeout's own CQE; its op reports what it did
+    if (!cqe->user_data) {
+      __atomic_sub_fetch(&inflight, 1, __ATOMIC_RELEASE);
+      continue;
+    }
+    uring_req_t *req = (uring_req_t *)(uintptr_t)cqe->user_data;
+    gthread_t *t = req->thread;
+    req->res = cqe->res;
+
+    // req lives on t's stack: done with it once t is queued
+    t->waiting_fd = -1; // Phase 13
+    scheduler_enqueue_locked(t);
+    __atomic_sub_fetch(&inflight, 1, __ATOMIC_RELEASE);
+    woke++;
+  }
+  __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+
+  // Completions the kernel could not post: flush them into the CQ
+  if (__atomic_load_n(sq_flags, __ATOMIC_RELAXED) & IORING_SQ_CQ_OVERFLOW)
+    sys_io_uring_enter(ring_fd, 0, IORING_ENTER_GETEVENTS);
+
+  return woke;
+}
+
+int uring_poll(int idle) {
+  if (!enabled || __atomic_load_n(&inflight, __ATOMIC_RELAXED) == 0)
+    return 0;
+
+  // About to block: must not leave anything unsubmitted behind
+  if (idle)
+    gspin_lock(&ring_lock);
+  else if (!gspin_trylock(&ring_lock))
+    return 0;
+
+  if (queued > 0 &&
+      (idle || queued >= URING_BATCH || ++defer_passes >= URING_MAX_DEFER))
+    uring_submit_locked();
+  int woke = uring_reap_locked();
+  gspin_unlock(&ring_lock);
+
+  return woke;
+}
+
+/* Queue one SQE. Caller holds ring_lock. */
+static void uring_push_locked(void) {
+  sq_array[sqe_tail & *sq_mask] = sqe_tail & *sq_mask;
+  sqe_tail++;
+  __atomic_store_n(sq_tail, sqe_tail, __ATOMIC_RELEASE);
+  queued++;
+}
+
+/* Room for n more SQEs, submitting to make it if need be. Caller holds
+   ring_lock. */
+static int uring_has_room_locked(unsigned n) {
+  if (sqe_tail + n - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) > sq_entries)
+    uring_submit_locked();
+  return sqe_tail + n - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) <=
+         sq_entries;
+}
+
+/* Queue one operation for the current thread and park it until its CQE is
+   reaped. Returns the CQE result (-errno on failure). Phase 41: With a
+   deadline_ns, a linked timeout cancels the op then (-ECANCELED); the
+   kernel drops the timeout itself if the op completes first. */
+static int uring_op(uint8_t opcode, int fd, const void *addr, unsigned len,
+                    uint64_t off, uint64_t deadline_ns) {
+  gthread_t *cur = g_current_thread;
+  uring_req_t req = {cur, 0};
+  // Read by the kernel at submit, which is before the op can complete
+  struct __kernel_timespec ts = {(int64_t)(deadline_ns / 1000000000ULL),
+                                 (long long)(deadline_ns % 1000000000ULL)};
+
+  gspin_lock(&ring_lock);
+  struct io_uring_sqe *sqe;
+  while (!uring_has_room_locked(deadline_ns ? 2 : 1) ||
+         !(sqe = uring_get_sqe_locked())) {
+    // Kernel is backed up (CQ overflow): let completions drain
+    uring_reap_locked();
+    gspin_unlock(&ring_lock);
+    gthread_yield();
+    gspin_lock(&ring_lock);
+  }
+
+  sqe->opcode = opcode;
+  sqe->fd = fd;
+  sqe->addr = (uint64_t)(uintptr_t)addr;
+  sqe->len = len;
+  sqe->off = off; // addr2 for accept
+  sqe->user_data = (uint64_t)(uintptr_t)&req;
+  if (deadline_ns) {
+    sqe->flags |= IOSQE_IO_LINK;
+    uring_push_locked();
+    sqe = uring_get_sqe_locked(); // Room was made above
+    sqe->opcode = IORING_OP_LINK_TIMEOUT;
+    sqe->fd = -1;
+    sqe->addr = (uint64_t)(uintptr_t)&ts;
+    sqe->len = 1;
+    sqe->timeout_flags = IORING_TIMEOUT_ABS;
+    sqe->user_data = 0;
+  }
+  uring_push_locked();
+
+  cur->state = GTHREAD_BLOCKED;
+  cur->waiting_fd = fd; // Phase 13
+  // The timeout counts until its CQE is reaped too
+  __atomic_add_fetch(&inflight, deadline_ns ? 2 : 1, __ATOMIC_RELAXED);
+  gspin_unlock(&ring_lock);
+
+  // Submission happens in this or a later scheduler pass
+  scheduler_schedule();
+  return req.res;
+}
+
+/* Map a CQE result to the read(2)-style contract. -EAGAIN means the fd is
+   O_NONBLOCK; fall back to the reactor (until deadline_ns, if set) and
+   retry. */
+static int uring_retry(int *res, int fd, int events, uint64_t deadline_ns) {
+  if (*res != -EAGAIN)
+    return 0;
+  if (scheduler_wait_io_until(fd, events, deadline_ns) < 0) {
+    *res = -ETIMEDOUT;
+    return 0;
+  }
+  return 1;
+}
+
+static ssize_t uring_result(int res) {
+  if (res == -ECANCELED)
+    res = -ETIMEDOUT; // Phase 41: Only linked timeouts cancel our ops
+  if (res < 0) {
+    errno = -res;
+    return -1;
+  }
+  return res;
+}
+
+ssize_t uring_read(int fd, void *buf, size_t count) {
+  return uring_read_until(fd, buf, count, 0);
+}
+
+ssize_t uring_read_until(int fd, void *buf, size_t count,
+                         uint64_t deadline_ns) {
+  int res;
+  do {
+    res = uring_op(IORING_OP_READ, fd, buf,
+                   count > URING_MAX_RW ? URING_MAX_RW : count, (uint64_t)-1,
+                   deadline_ns);
+  } while (uring_retry(&res, fd, POLLIN, deadline_ns));
+  return uring_result(res);
+}
+
+ssize_t uring_write(int fd, const void *buf, size_t count) {
+  int res;
+  do {
+    res = uring_op(IORING_OP_WRITE, fd, buf,
+                   count > URING_MAX_RW ? URING_MAX_RW : count, (uint64_t)-1,
+                   0);
+  } while (uring_retry(&res, fd, POLLOUT, 0));
+  return uring_result(res);
+}
+
+int uring_accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen) {
+  return uring_accept_until(sockfd, addr, addrlen, 0);
+}
+
+int uring_accept_until(int sockfd, struct sockaddr *addr, socklen_t *addrlen,
+                       uint64_t deadline_ns) {
+  int res;
+  do {
+    res = uring_op(IORING_OP_ACCEPT, sockfd, addr, 0,
+                   (uint64_t)(uintptr_t)addrlen, deadline_ns);
+  } while (uring_retry(&res, sockfd, POLLIN, deadline_ns));
+  return (int)uring_result(res);
+}